@@ -1,5 +1,6 @@
 import glob
 import os
+import platform
 import re
 import subprocess
 import sys
@@ -20,8 +21,7 @@ HEADER_FILES = glob.glob("src/**/*.h", recursive=True)
 
 
 # A CMakeExtension needs a sourcedir instead of a file list.
-# The name must be the _single_ output extension from the CMake build.
-# If you need multiple extensions, see scikit-build.
+# The last component of its name is the CMake target that builds it.
 class CMakeExtension(Extension):
     def __init__(self, name, sourcedir=""):
         Extension.__init__(self, name, sources=[])
@@ -105,8 +105,6 @@ class CMakeBuild(build_ext):
                 cmake_args += ["-DCMAKE_OSX_ARCHITECTURES={}".format(";".join(archs))]
             else:
                 # If archflag not set, use platform.machine() to detect architecture
-                import platform
-
                 arch = platform.machine()
                 if arch:
                     cmake_args += [f"-DCMAKE_OSX_ARCHITECTURES={platform.machine()}"]
@@ -128,16 +126,29 @@ class CMakeBuild(build_ext):
                 # CMake 3.12+ only.
                 build_args += [f"-j{self.parallel}"]
 
-        build_temp = os.path.join(self.build_temp, ext.name)
+        # The extensions share a build tree, so stim and the sources are compiled once per variant.
+        build_temp = os.path.join(self.build_temp, "leaky")
         if not os.path.exists(build_temp):
             os.makedirs(build_temp)
         subprocess.check_call(["cmake", ext.sourcedir] + cmake_args, cwd=build_temp)
+        # Each extension is a target of the same CMake project.
         subprocess.check_call(
-            ["cmake", "--build", ".", "--target", "_cpp_leaky"] + build_args,
+            ["cmake", "--build", ".", "--target", ext.name.split(".")[-1]] + build_args,
             cwd=build_temp,
         )
 
 
+# The AVX2 variant of the extension is only built on x86_64, and picked at import time on CPUs
+# supporting AVX2, see `src/leaky/_cpp.py`.
+EXTENSIONS = [CMakeExtension("leaky._cpp_leaky"), CMakeExtension("leaky._cpp_leaky_cpu")]
+if (
+    platform.machine().lower() in ("x86_64", "amd64")
+    and not sys.platform.startswith("win")
+    and "arm64" not in os.environ.get("ARCHFLAGS", "")
+    and "-DLEAKY_AVX2_VARIANT=OFF" not in os.environ.get("CMAKE_ARGS", "")
+):
+    EXTENSIONS.append(CMakeExtension("leaky._cpp_leaky_avx2"))
+
 version = {}
 with open("src/leaky/_version.py") as fp:
     exec(fp.read(), version)
@@ -153,7 +164,7 @@ setup(
     description="An implementation of Google's Pauli+ simulator.",
     long_description=long_description,
     long_description_content_type="text/markdown",
-    ext_modules=[CMakeExtension("leaky._cpp_leaky")],
+    ext_modules=EXTENSIONS,
     packages=find_packages("src"),
     package_dir={"": "src"},
     package_data={
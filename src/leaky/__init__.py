@@ -1,12 +1,18 @@
-from leaky._cpp_leaky import (
-    randomize,
-    set_seed,
-    rand_float,
-    LeakyPauliChannel,
-    Instruction,
-    Simulator,
-    ReadoutStrategy,
-)
+from leaky._cpp import module as _cpp_leaky
+
+randomize = _cpp_leaky.randomize
+set_seed = _cpp_leaky.set_seed
+rand_float = _cpp_leaky.rand_float
+simd_width = _cpp_leaky.simd_width
+LeakyPauliChannel = _cpp_leaky.LeakyPauliChannel
+Instruction = _cpp_leaky.Instruction
+Simulator = _cpp_leaky.Simulator
+ReadoutStrategy = _cpp_leaky.ReadoutStrategy
+Engine = _cpp_leaky.Engine
+SampleChunkIterator = _cpp_leaky.SampleChunkIterator
+CompiledSampler = _cpp_leaky.CompiledSampler
+run_shard = _cpp_leaky.run_shard
+
 from leaky._version import __version__
 
 from leaky.utils import (
@@ -20,9 +26,13 @@ __all__ = [
     "Instruction",
     "Simulator",
     "ReadoutStrategy",
+    "Engine",
+    "CompiledSampler",
+    "run_shard",
     "randomize",
     "set_seed",
     "rand_float",
+    "simd_width",
     "decompose_kraus_operators_to_leaky_pauli_channel",
     "leakage_status_tuple_to_int",
 ]
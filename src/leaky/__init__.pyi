@@ -4,7 +4,7 @@
 from __future__ import annotations
 
 import enum
-from typing import Iterable, Sequence, Tuple, Optional, TYPE_CHECKING, Union
+from typing import Any, Dict, Iterable, List, Sequence, Tuple, Optional, TYPE_CHECKING, Union
 
 import numpy as np
 import numpy.typing as npt
@@ -25,7 +25,12 @@ def randomize() -> None:
 
 def set_seed(seed: int) -> None:
     """
-    Set the random seed used by the simulator.
+    Set the random seed of the module-level generator.
+
+    The module-level generator is shared by all threads. It drives `rand_float` and
+    `LeakyPauliChannel.sample`, and seeds the simulators constructed without an
+    explicit seed. Each simulator owns its random engines afterwards, so simulators
+    never disturb each other.
 
     Args:
         seed: The seed to use.
@@ -56,6 +61,25 @@ def rand_float(begin: float, end: float) -> float:
     """
     ...
 
+def simd_width() -> int:
+    """
+    The width in bits of the words stim's bit-parallel kernels run on in the loaded build.
+
+    `import leaky` loads the AVX2 build of the extension, with 256-bit words, on CPUs
+    supporting AVX2 when it was built, and the portable build, with 128-bit words on
+    x86_64, otherwise. Setting the environment variable `LEAKY_DISABLE_AVX2` before the
+    import always loads the portable build.
+
+    Returns:
+        The `stim::MAX_BITWORD_WIDTH` the loaded build was compiled with.
+
+    Examples:
+        >>> import leaky
+        >>> leaky.simd_width()
+        256
+    """
+    ...
+
 class LeakyPauliChannel:
     """A generalized Pauli channel incorporating incoherent leakage transitions."""
     def __init__(self, is_single_qubit_channel: bool = True) -> None:
@@ -75,6 +99,23 @@ class LeakyPauliChannel:
         """The number of transitions in the channel."""
         ...
 
+    @property
+    def transitions(self) -> List[Tuple[int, int, int, float]]:
+        """The `(initial_status, final_status, pauli_channel_idx, probability)` of
+        every transition, grouped by initial status and in the order they were
+        added within each group.
+
+        Examples:
+            >>> import leaky
+            >>> channel = leaky.LeakyPauliChannel()
+            >>> channel.add_transition(0, 1, 0, 0.5)
+            >>> channel.add_transition(1, 1, 0, 1.0)
+            >>> channel.add_transition(0, 0, 1, 0.5)
+            >>> channel.transitions
+            [(0, 1, 0, 0.5), (0, 0, 1, 0.5), (1, 1, 0, 1.0)]
+        """
+        ...
+
     def add_transition(
         self,
         initial_status: int,
@@ -173,6 +214,27 @@ class LeakyPauliChannel:
         """
         ...
 
+    def freeze(self) -> None:
+        """Build the constant-time sampling tables of the channel.
+
+        Channels are frozen automatically when they are bound to a simulator.
+        Adding a transition afterwards unfreezes the channel.
+
+        Examples:
+            >>> import leaky
+            >>> channel = leaky.LeakyPauliChannel()
+            >>> channel.add_transition(0, 1, 0, 1.0)
+            >>> channel.freeze()
+            >>> channel.is_frozen
+            True
+        """
+        ...
+
+    @property
+    def is_frozen(self) -> bool:
+        """Whether the channel is frozen, see `freeze`."""
+        ...
+
     def __str__(self) -> str:
         """The readable string representation of the channel.
 
@@ -243,6 +305,111 @@ class ReadoutStrategy(enum.Enum):
     RandomLeakageProjection: int
     DeterministicLeakageProjection: int
 
+class Engine(enum.Enum):
+    """The simulation engine used by `Simulator.sample_batch`.
+
+    `Tableau` runs one stabilizer tableau simulation per shot. `Frame` samples
+    blocks of shots at once with a leakage-aware Pauli frame simulator, which
+    is much faster for large circuits. The frame engine treats leaked qubits as
+    maximally mixed when they interact with other qubits, whereas the tableau
+    engine skips gates acting on leaked qubits.
+
+    `Branching` follows the tableau engine exactly, but simulates the part of
+    the circuit where shots only differ by their leakage transitions and Pauli
+    errors once, and starts every shot from where it first samples a non-trivial
+    transition or an error. Its samples have the distribution of the tableau
+    engine, not the same values. The shared part ends at the first `REPEAT`
+    block, measurement or reset of a qubit whose Z value is random, measurement
+    or reset in another basis, or noise other than `X_ERROR`, `Y_ERROR`,
+    `Z_ERROR`, `DEPOLARIZE1`, `DEPOLARIZE2`, `PAULI_CHANNEL_1` and
+    `PAULI_CHANNEL_2`. So it pays off on flattened circuits whose noiseless
+    measurements are deterministic, such as repetition code memories, and
+    hardly on circuits with a `REPEAT` block or random measurements early on,
+    such as the rotated surface code memories of `stim.Circuit.generated`.
+    """
+
+    Tableau: int
+    Frame: int
+    Branching: int
+
+class SampleChunkIterator:
+    """An iterator over the chunks of a sampling job, see `Simulator.sample_chunks`."""
+    def __iter__(self) -> "SampleChunkIterator": ...
+    def __next__(self) -> npt.NDArray[np.uint8]: ...
+
+class CompiledSampler:
+    """A circuit compiled once for repeated sampling, see `Simulator.compile_sampler`."""
+
+    num_measurements: int
+    num_detectors: int
+    num_observables: int
+    counters: Dict[str, Any]
+    """The instrumentation counters of the samples drawn so far, see `Simulator.counters`."""
+    def sample(
+        self,
+        shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        bit_packed: bool = False,
+        leakage_bias: Optional[float] = None,
+    ) -> Union[npt.NDArray[np.uint8], Tuple[npt.NDArray[Any], ...]]:
+        """Batch sample the measurement results of the compiled circuit.
+
+        The arguments and results are those of `Simulator.sample_batch`.
+        """
+        ...
+
+    def sample_detectors(
+        self,
+        shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        leakage_flags: bool = False,
+        leakage_bias: Optional[float] = None,
+    ) -> Tuple[npt.NDArray[Any], ...]:
+        """Batch sample the detection events and observable flips of the compiled circuit.
+
+        The arguments and results are those of `Simulator.sample_detectors`.
+        """
+        ...
+
+    def sample_sweep(
+        self,
+        variants: Sequence[Tuple[Sequence[Tuple["leaky.Instruction", "leaky.LeakyPauliChannel"]], int]],
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+    ) -> npt.NDArray[np.uint8]:
+        """Sample channel variants of the compiled circuit.
+
+        The arguments and results are those of `Simulator.sample_sweep`.
+        """
+        ...
+
+    def sample_statistics(
+        self,
+        shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        max_failures: Optional[int] = None,
+    ) -> Dict[str, Any]:
+        """Sample the compiled circuit, keeping only the aggregated counts.
+
+        The arguments and results are those of `Simulator.sample_statistics`.
+        """
+        ...
+
 class Simulator:
     """A simulator for stabilizer quantum circuits with incoherent leakage transitions."""
     def __init__(
@@ -255,7 +422,8 @@ class Simulator:
 
         Args:
             num_qubits: The number of qubits in the simulator.
-            seed: The random seed to use for the simulator.
+            seed: The random seed to use for the simulator. If None, the seed is
+                drawn from the module-level generator, see `leaky.set_seed`.
 
         Examples:
             >>> import leaky
@@ -360,7 +528,8 @@ class Simulator:
         """Bind a leaky channel to a circuit instruction.
 
         A bound channel will be applied to the simulator whenever the bound
-        instruction is applied.
+        instruction is applied. An instruction acting on several qubits (or
+        qubit pairs) binds the channel to each of them separately.
 
         Args:
             ideal_inst: The ideal circuit instruction to bind the channel to.
@@ -376,6 +545,85 @@ class Simulator:
         """
         ...
 
+    def save_bound_leaky_channels(self, filepath: str) -> None:
+        """Save the bound leaky channels and their bindings to a binary channel library.
+
+        The file is written next to `filepath` and renamed over it, so processes
+        still using a previous version of the library are not disturbed.
+
+        Args:
+            filepath: The path of the library file to write.
+        """
+        ...
+
+    def load_bound_leaky_channels(self, filepath: str, safety_check: bool = True) -> None:
+        """Bind the channels of a library written by `save_bound_leaky_channels`.
+
+        The file is memory-mapped read-only, except on Windows, and the loaded
+        channels sample straight from the alias tables stored in it, so loading
+        a device model takes milliseconds and the processes of a node loading
+        the same library share one copy of those tables. Loaded bindings
+        replace existing bindings of the same instructions.
+
+        Args:
+            filepath: The path of the library file to read.
+            safety_check: If True, check every loaded channel with
+                `LeakyPauliChannel.safety_check`. Default is True.
+
+        Examples:
+            >>> import leaky
+            >>> channel = leaky.LeakyPauliChannel()
+            >>> channel.add_transition(0, 1, 0, 1.0)
+            >>> simulator = leaky.Simulator(1)
+            >>> simulator.bind_leaky_channel(leaky.Instruction("X", [0]), channel)
+            >>> simulator.save_bound_leaky_channels("device.leaky")
+            >>> worker = leaky.Simulator(1)
+            >>> worker.load_bound_leaky_channels("device.leaky")
+        """
+        ...
+
+    @property
+    def bound_leaky_channels(self) -> Dict[str, "leaky.LeakyPauliChannel"]:
+        """The bound leaky channels, keyed by the text of their instruction.
+
+        Examples:
+            >>> import leaky
+            >>> channel = leaky.LeakyPauliChannel()
+            >>> channel.add_transition(0, 1, 0, 1.0)
+            >>> simulator = leaky.Simulator(2)
+            >>> simulator.bind_leaky_channel(leaky.Instruction("X", [0, 1]), channel)
+            >>> sorted(simulator.bound_leaky_channels)
+            ['X 0', 'X 1']
+        """
+        ...
+
+    @property
+    def counters(self) -> Dict[str, Any]:
+        """The instrumentation counters accumulated by the simulator and its tableau samplers.
+
+        The counters are only recorded by builds configured with
+        `-DLEAKY_ENABLE_COUNTERS=ON`, e.g. `CMAKE_ARGS="-DLEAKY_ENABLE_COUNTERS=ON" pip install .`;
+        otherwise `"enabled"` is False and the counts stay zero. The frame engine is not
+        instrumented.
+
+        Returns:
+            A dict with the keys:
+                "enabled": Whether this build records the counters.
+                "num_shots": The number of shots sampled.
+                "channel_samples": The number of times each bound channel was applied, keyed
+                    by the text of its instruction.
+                "transitions": The number of single-qubit "R", "U", "D" and "L" transitions.
+                "leaked_qubits_per_layer": The number of leaked qubits at the k-th TICK,
+                    summed over the shots.
+                "tableau_seconds", "channel_seconds", "readout_seconds": The time spent in the
+                    stim tableau simulator, in the leaky channels and in the readout.
+        """
+        ...
+
+    def clear_counters(self) -> None:
+        """Reset the instrumentation counters to zero."""
+        ...
+
     def clear(self, clear_bound_channels: bool = False) -> None:
         """Clear the simulator's state.
 
@@ -393,21 +641,68 @@ class Simulator:
     def current_measurement_record(
         self,
         readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
+        *,
+        into: Optional[npt.NDArray[np.uint8]] = None,
     ) -> npt.NDArray[np.uint8]:
         """Get the current measurement record.
 
         Args:
             readout_strategy: The strategy for readout simulating results.
+            into: If given, a C-contiguous `uint8` numpy array of shape
+                `(simulator.num_measurements,)` the record is written into, so that
+                per-shot loops can reuse one buffer instead of allocating a new array
+                on every call.
 
         Returns:
-            The measurement record.
+            The measurement record, which is `into` when it is given.
 
         Examples:
             >>> import leaky
+            >>> import numpy as np
             >>> simulator = leaky.Simulator(1)
             >>> simulator.do(leaky.Instruction("M", [0]))
             >>> simulator.current_measurement_record()
             array([0], dtype=uint8)
+            >>> record = np.empty(simulator.num_measurements, dtype=np.uint8)
+            >>> simulator.current_measurement_record(into=record)
+            array([0], dtype=uint8)
+        """
+        ...
+
+    @property
+    def num_measurements(self) -> int:
+        """The number of measurements in the current measurement record."""
+        ...
+
+    @property
+    def leakage_status(self) -> npt.NDArray[np.uint8]:
+        """A read-only view of the current leakage status of every qubit, 0 when unleaked.
+
+        The view shares the memory of the simulator, so it is not copied and always
+        shows the current status.
+        """
+        ...
+
+    def compile_sampler(self, circuit: "stim.Circuit") -> "leaky.CompiledSampler":
+        """Compile a circuit once for many calls to `CompiledSampler.sample`.
+
+        Parsing the circuit and looking up the channels bound to its instructions are
+        done here rather than on every call. The sampler keeps a copy of the bound
+        channels, so later changes to the simulator do not affect it. Its random stream
+        is seeded from the simulator's.
+
+        Args:
+            circuit: The circuit to sample.
+
+        Returns:
+            A `leaky.CompiledSampler` for the circuit.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> circuit = stim.Circuit.generated("repetition_code:memory", rounds=3, distance=3)
+            >>> sampler = leaky.Simulator(circuit.num_qubits).compile_sampler(circuit)
+            >>> results = sampler.sample(1000)
         """
         ...
 
@@ -416,29 +711,370 @@ class Simulator:
         circuit: "stim.Circuit",
         shots: int,
         readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
-    ) -> npt.NDArray[np.uint8]:
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        bit_packed: bool = False,
+        leakage_bias: Optional[float] = None,
+    ) -> Union[npt.NDArray[np.uint8], Tuple[npt.NDArray[Any], ...]]:
         """Batch sample the measurement results of a circuit.
 
+        The shots are split into fixed-size blocks, each simulated with a random
+        stream derived from the simulator's seed and the block index, so the
+        samples are reproducible regardless of `num_threads`.
+
         Args:
             circuit: The circuit to sample.
             shots: The number of shots.
             readout_strategy: The readout strategy to use.
+            num_threads: The number of worker threads to sample with. Each worker
+                owns a copy of the simulator and the GIL is released while sampling.
+                If 0, use all available hardware threads. Default is 1.
+            engine: The simulation engine to use, see `leaky.Engine`. Default is
+                `Engine.Tableau`.
+            sparse_leakage: Whether the frame engine stores only the leakage statuses
+                of the leaked qubits, rather than one byte per qubit and shot. This
+                saves memory on circuits with many qubits and few leaked at a time,
+                and gives the same samples. If None, it is used for circuits of at
+                least 1024 qubits. The other engines ignore it. Default is None.
+            bit_packed: If True, pack the measurements of every shot into
+                `ceil(circuit.num_measurements / 8)` bytes, measurement `m` being bit
+                `m % 8` of byte `m // 8`. This is the layout of stim's `b8` format
+                and of `np.packbits(..., bitorder="little")`. Default is False.
+            leakage_bias: If given, importance sample the leakage: the transitions
+                that leak a qubit out of the computational subspace are drawn
+                `leakage_bias` times as often, relative to the ones that do not, and
+                the weights of the shots are returned. Default is None.
 
         Returns:
             A numpy array of measurement results with `dtype=uint8`. The shape of the array
             is `(shots, circuit.num_measurements)`.
+
+            With `bit_packed=True`, the array has shape
+            `(shots, ceil(circuit.num_measurements / 8))`. For `ReadoutStrategy.RawLabel`
+            a tuple `(bits, leakage_flags)` of two such arrays is returned instead:
+            `bits` holds the measurements that returned 1 and `leakage_flags` the
+            measurements of a leaked qubit. The leaked levels themselves are not kept.
+
+            With `leakage_bias`, a float64 array of the `shots` likelihood ratios of
+            the sampled trajectories is appended to the results. A statistic averaged
+            with these weights is an unbiased estimate of its unbiased average, e.g.
+            `np.mean(weights * failed)` for a logical error rate.
+        """
+        ...
+
+    def sample_detectors(
+        self,
+        circuit: "stim.Circuit",
+        shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        leakage_flags: bool = False,
+        leakage_bias: Optional[float] = None,
+    ) -> Tuple[npt.NDArray[Any], ...]:
+        """Batch sample the detection events and observable flips of a circuit.
+
+        The `DETECTOR` and `OBSERVABLE_INCLUDE` annotations of the circuit are evaluated
+        in C++ on the sampled measurements, which are never returned.
+
+        Args:
+            circuit: The circuit to sample.
+            shots: The number of shots.
+            readout_strategy: The readout strategy to use. Detection events need
+                measurement bits, so `ReadoutStrategy.RawLabel` is not allowed. Default
+                is `ReadoutStrategy.RandomLeakageProjection`.
+            num_threads: The number of worker threads to sample with, see `sample_batch`.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            sparse_leakage: How the frame engine stores leakage, see `sample_batch`.
+            leakage_flags: If True, also return a plane flagging the detectors that
+                include a measurement of a leaked qubit. Default is False.
+            leakage_bias: If given, importance sample the leakage, see `sample_batch`.
+
+        Returns:
+            A tuple `(detection_events, observable_flips)` of bit-packed numpy arrays
+            with shapes `(shots, ceil(circuit.num_detectors / 8))` and
+            `(shots, ceil(circuit.num_observables / 8))`, in the layout of stim's `b8`
+            format. With `leakage_flags=True`, the leakage flags are appended as a third
+            array shaped like the detection events. With `leakage_bias`, the weights of
+            the shots are appended last, see `sample_batch`.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> circuit = stim.Circuit.generated("repetition_code:memory", rounds=3, distance=3)
+            >>> simulator = leaky.Simulator(circuit.num_qubits)
+            >>> dets, obs, flags = simulator.sample_detectors(circuit, 1000, leakage_flags=True)
+        """
+        ...
+
+    def sample_sweep(
+        self,
+        circuit: "stim.Circuit",
+        variants: Sequence[Tuple[Sequence[Tuple["leaky.Instruction", "leaky.LeakyPauliChannel"]], int]],
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+    ) -> npt.NDArray[np.uint8]:
+        """Sample several channel variants of a circuit, compiling it only once.
+
+        Every variant rebinds some of the instructions bound in the simulator to other
+        channels, e.g. to sweep the leakage rate of the `CZ` gates. The circuit is
+        parsed and its bindings resolved once for all the variants, and the sampling
+        blocks of all the variants share one pool of worker threads. The variants are
+        sampled from the same seeds, so their differences are less noisy than with
+        independent calls to `sample_batch`.
+
+        Args:
+            circuit: The circuit to sample.
+            variants: A `(bindings, shots)` pair per variant, where `bindings` is a
+                list of `(instruction, channel)` pairs, each like a call to
+                `bind_leaky_channel`. Only instructions bound in the simulator can be
+                rebound, and the others keep their channels.
+            readout_strategy: The readout strategy to use.
+            num_threads: The number of worker threads to sample with, see `sample_batch`.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            sparse_leakage: How the frame engine stores leakage, see `sample_batch`.
+
+        Returns:
+            The measurement records of all the variants stacked in order, a numpy array
+            of shape `(total_shots, circuit.num_measurements)` with `dtype=uint8`.
+
+        Examples:
+            >>> import leaky
+            >>> import numpy as np
+            >>> import stim
+            >>> circuit = stim.Circuit("H 0\nCZ 0 1\nM 0 1")
+            >>> simulator = leaky.Simulator(2)
+            >>> cz = leaky.Instruction("CZ", [0, 1])
+            >>> def leaky_cz(p):
+            ...     channel = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+            ...     channel.add_transition(0x00, 0x00, 0, 1 - p)
+            ...     channel.add_transition(0x00, 0x10, 0, p)
+            ...     return channel
+            >>> simulator.bind_leaky_channel(cz, leaky_cz(0.01))
+            >>> rates = [0.001, 0.01, 0.1]
+            >>> results = simulator.sample_sweep(circuit, [([(cz, leaky_cz(p))], 1000) for p in rates])
+            >>> per_rate = np.split(results, len(rates))
+        """
+        ...
+
+    def sample_statistics(
+        self,
+        circuit: "stim.Circuit",
+        shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        max_failures: Optional[int] = None,
+    ) -> Dict[str, Any]:
+        """Sample a circuit, keeping only the counts aggregated over the shots.
+
+        The records of the shots are reduced in C++ as they are sampled and never
+        returned, so the memory used does not grow with the number of shots. The
+        shots are the same as those of `sample_batch` with the same seed.
+
+        Args:
+            circuit: The circuit to sample.
+            shots: The maximum number of shots.
+            readout_strategy: The readout strategy to use. Observable flips need
+                measurement bits, so `ReadoutStrategy.RawLabel` is only allowed for
+                circuits without observables.
+            num_threads: The number of worker threads to sample with, see `sample_batch`.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            sparse_leakage: How the frame engine stores leakage, see `sample_batch`.
+            max_failures: If given and not 0, stop early at the end of the first
+                sampling block by which this many shots have flipped an observable.
+                The blocks are counted in order, so where the sampling stops does not
+                depend on `num_threads`.
+
+        Returns:
+            A dict with the number of `shots` sampled, the `num_failures` among them
+            that flipped at least one observable, and two `uint64` numpy arrays:
+            `leaked_counts`, the number of shots in which each measurement hit a
+            leaked qubit, and `observable_flip_counts`, the number of shots in which
+            each observable flipped.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> circuit = stim.Circuit.generated("repetition_code:memory", rounds=3, distance=3)
+            >>> simulator = leaky.Simulator(circuit.num_qubits)
+            >>> stats = simulator.sample_statistics(circuit, 10**6, max_failures=100)
+        """
+        ...
+
+    def sample_chunks(
+        self,
+        circuit: "stim.Circuit",
+        shots: int,
+        chunk_shots: int,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RawLabel,
+        *,
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+        prefetch: int = 0,
+    ) -> "leaky.SampleChunkIterator":
+        """Sample the measurement results of a circuit chunk by chunk.
+
+        The circuit is compiled once for the whole job and only one chunk is held in
+        memory at a time, or `prefetch` more when prefetching. The concatenated chunks
+        are the same as the result of `sample_batch` with the same seed. The bound
+        channels must not be cleared while iterating.
+
+        Args:
+            circuit: The circuit to sample.
+            shots: The total number of shots.
+            chunk_shots: The number of shots per chunk, rounded up to a whole number
+                of sampling blocks.
+            readout_strategy: The readout strategy to use.
+            num_threads: The number of worker threads to sample each chunk with.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            sparse_leakage: How the frame engine stores leakage, see `sample_batch`.
+            prefetch: If positive, the chunks are sampled without the GIL on a background
+                thread, up to `prefetch` chunks ahead of the iteration. Python code
+                consuming a chunk, e.g. a decoder, then runs while the next chunks are
+                simulated. Default is 0, which samples each chunk when it is requested.
+
+        Returns:
+            An iterator over numpy arrays of shape `(n, circuit.num_measurements)` with
+            `dtype=uint8`.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> simulator = leaky.Simulator(1)
+            >>> for chunk in simulator.sample_chunks(stim.Circuit("X 0\nM 0"), 10**6, 4096):
+            ...     pass
+        """
+        ...
+
+    def sample_to_file(
+        self,
+        circuit: "stim.Circuit",
+        shots: int,
+        filepath: str,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        format: str = "01",
+        num_threads: int = 1,
+        engine: "leaky.Engine" = Engine.Tableau,
+        sparse_leakage: Optional[bool] = None,
+    ) -> None:
+        """Sample the measurement results of a circuit into a file in a stim result format.
+
+        The samples are the same as those of `sample_batch` with the same seed. They are
+        sampled into two alternating chunk buffers and written by a background thread,
+        so the memory used does not grow with `shots` and sampling does not wait on
+        the disk.
+
+        Args:
+            circuit: The circuit to sample.
+            shots: The number of shots.
+            filepath: The path of the file to write.
+            readout_strategy: The readout strategy to use. The stim formats can only
+                hold bits, so `ReadoutStrategy.RawLabel` is not allowed. Default is
+                `ReadoutStrategy.RandomLeakageProjection`.
+            format: The stim result format, one of "01", "b8" or "r8". Default is "01".
+            num_threads: The number of worker threads to sample with, see `sample_batch`.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            sparse_leakage: How the frame engine stores leakage, see `sample_batch`.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> simulator = leaky.Simulator(1)
+            >>> simulator.sample_to_file(stim.Circuit("X 0\nM 0"), 10, "out.b8", format="b8")
         """
         ...
 
+    def save_job(
+        self,
+        circuit: "stim.Circuit",
+        shots: int,
+        filepath: str,
+        readout_strategy: "leaky.ReadoutStrategy" = ReadoutStrategy.RandomLeakageProjection,
+        *,
+        engine: "leaky.Engine" = Engine.Tableau,
+        seed: Optional[int] = None,
+    ) -> None:
+        """Save a sampling job to a file, to be sampled in shards with `leaky.run_shard`.
+
+        The job file holds the circuit, the leaky channels bound to its gates, the
+        number of shots, the seed, the readout strategy and the engine, so that any
+        machine with the file can sample any of its shards.
+
+        Args:
+            circuit: The circuit to sample.
+            shots: The total number of shots of the job.
+            filepath: The path of the job file to write.
+            readout_strategy: The readout strategy to use. The shards are written in
+                stim result formats, so `ReadoutStrategy.RawLabel` is not allowed.
+                Default is `ReadoutStrategy.RandomLeakageProjection`.
+            engine: The simulation engine to use, see `leaky.Engine`.
+            seed: The seed of the job. If None, it is drawn from the simulator's
+                random stream. Default is None.
+
+        Examples:
+            >>> import leaky
+            >>> import stim
+            >>> simulator = leaky.Simulator(1)
+            >>> simulator.save_job(stim.Circuit("X 0\nM 0"), 10**6, "job.leaky", seed=7)
+            >>> counts = leaky.run_shard("job.leaky", 0, 100, "shard_000.b8")
+        """
+        ...
+
+def run_shard(
+    job_filepath: str,
+    shard_index: int,
+    num_shards: int,
+    filepath: str,
+    *,
+    format: str = "b8",
+    num_threads: int = 1,
+) -> npt.NDArray[np.uint64]:
+    """Sample one shard of a job saved by `Simulator.save_job` into a file.
+
+    The shots of the job are split into `num_shards` contiguous shards of whole
+    sampling blocks. The random stream of every block is derived from the seed of
+    the job and the index of the block, so a shard is the same whichever process
+    samples it and whenever. Concatenating the shard files in shard order gives the
+    file `Simulator.sample_to_file` writes for the whole job with the same seed.
+
+    Args:
+        job_filepath: The path of the job file.
+        shard_index: The index of the shard to sample, in `[0, num_shards)`.
+        num_shards: The number of shards the job is split into.
+        filepath: The path of the file to write the shard to.
+        format: The stim result format, one of "01", "b8" or "r8". Default is "b8".
+        num_threads: The number of worker threads to sample with. Default is 1.
+
+    Returns:
+        For every measurement, the number of shots of the shard in which it returned
+        1. Summing these counts over the shards aggregates the whole job.
+    """
+    ...
+
 def decompose_kraus_operators_to_leaky_pauli_channel(
     kraus_operators: Sequence[np.ndarray],
     num_qubits: int,
     num_level: int,
     safety_check: bool = True,
+    num_threads: int = 1,
 ) -> LeakyPauliChannel:
     """Decompose the Kraus operators into a leaky pauli channel representation with
     Generalized Pauli Twirling(GPT).
 
+    The decomposition runs in C++, without the GIL.
+
     Args:
         kraus_operators: A sequence of Kraus operators corresponding to an operation's error channel.
         num_qubits: The number of qubits in the operation.
@@ -448,6 +1084,9 @@ def decompose_kraus_operators_to_leaky_pauli_channel(
             from a given initial status is 1. And the pauli channel related to the
             qubits with transition type that not in R(stay in the computational space)
             should always be I. Default is True.
+        num_threads: The number of threads to decompose the Kraus operators with. If 0,
+            use all available hardware threads. The result does not depend on it.
+            Default is 1.
 
     Returns:
         A LeakyPauliChannel object representing the error channel.
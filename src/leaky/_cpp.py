@@ -0,0 +1,25 @@
+"""Selects the build of the C++ extension to load.
+
+The portable `_cpp_leaky` module runs on any CPU. Where it was built, `_cpp_leaky_avx2` runs
+stim's bit-parallel kernels on 256-bit words and is loaded instead on CPUs supporting AVX2.
+Only one of them is ever imported, since both register the same pybind11 types.
+"""
+
+import importlib
+import importlib.util
+import os
+
+
+def _module_name() -> str:
+    if os.environ.get("LEAKY_DISABLE_AVX2"):
+        return "leaky._cpp_leaky"
+    try:
+        from leaky._cpp_leaky_cpu import supports_avx2
+    except ImportError:
+        return "leaky._cpp_leaky"
+    if supports_avx2() and importlib.util.find_spec("leaky._cpp_leaky_avx2") is not None:
+        return "leaky._cpp_leaky_avx2"
+    return "leaky._cpp_leaky"
+
+
+module = importlib.import_module(_module_name())
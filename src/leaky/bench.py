@@ -0,0 +1,271 @@
+"""End-to-end benchmarks of leaky on standard surface code workloads.
+
+The workloads are rotated surface code memory circuits generated by stim, compiled to CZ gates,
+with a leaky channel decomposed from the Kraus operators of a leaking CZ bound to every CZ. The
+construction of a workload, the binding of its channels, its compilation and the sampling of the
+compiled circuit for every engine and readout strategy are timed, and the results are reported as
+JSON, so that the numbers of two releases, engines or machines can be compared:
+
+    python -m leaky.bench --distances 3 5 7 --shots 10000 --num-threads 8 --output bench.json
+"""
+from typing import Any, Dict, List, Optional, Sequence, Tuple
+import argparse
+import json
+import platform
+import sys
+import time
+
+import numpy as np
+import stim
+
+import leaky
+from leaky.utils import decompose_kraus_operators_to_leaky_pauli_channel
+
+ENGINES = ["Tableau", "Frame", "Branching"]
+READOUT_STRATEGIES = ["RawLabel", "RandomLeakageProjection", "DeterministicLeakageProjection"]
+
+
+def leaky_cz_kraus_operators(leakage_probability: float) -> List[np.ndarray]:
+    """The Kraus operator of the error of a CZ gate between two qutrits leaking `|11>` to `|02>`.
+
+    Args:
+        leakage_probability: The probability that `|11>` leaks to `|02>`, and that `|02>`
+            returns to `|11>`.
+
+    Returns:
+        A list holding the single 9x9 unitary Kraus operator, in the basis `|ab>` with index `3a + b`.
+    """
+    cos = np.sqrt(1 - leakage_probability)
+    sin = np.sqrt(leakage_probability)
+    kraus = np.eye(9, dtype=complex)
+    kraus[np.ix_([4, 2], [4, 2])] = [[cos, -sin], [sin, cos]]
+    return [kraus]
+
+
+def _cx_to_cz(circuit: stim.Circuit) -> stim.Circuit:
+    """Replace every CX of a circuit by a CZ conjugated by Hadamards on the targets."""
+    result = stim.Circuit()
+    for instruction in circuit:
+        if isinstance(instruction, stim.CircuitRepeatBlock):
+            result.append(stim.CircuitRepeatBlock(instruction.repeat_count, _cx_to_cz(instruction.body_copy())))
+        elif instruction.name == "CX":
+            targets = instruction.targets_copy()
+            result.append("H", targets[1::2])
+            result.append("CZ", targets)
+            result.append("H", targets[1::2])
+        else:
+            result.append(instruction)
+    return result
+
+
+def _cz_pairs(circuit: stim.Circuit) -> List[Tuple[int, int]]:
+    """The distinct qubit pairs of the CZ gates of a circuit, in order of first appearance."""
+    pairs: Dict[Tuple[int, int], None] = {}
+    for instruction in circuit:
+        if isinstance(instruction, stim.CircuitRepeatBlock):
+            pairs.update(dict.fromkeys(_cz_pairs(instruction.body_copy())))
+        elif instruction.name == "CZ":
+            qubits = [target.value for target in instruction.targets_copy()]
+            pairs.update(dict.fromkeys(zip(qubits[::2], qubits[1::2])))
+    return list(pairs)
+
+
+def surface_code_circuit(distance: int, rounds: Optional[int] = None, noise: float = 1e-3) -> stim.Circuit:
+    """A rotated surface code memory circuit, with CZ as its only two-qubit gate.
+
+    Args:
+        distance: The distance of the code.
+        rounds: The number of rounds of stabilizer measurements. If None, `distance` rounds.
+        noise: The probability of the depolarizing errors after every gate, and of the
+            errors of resets and measurements.
+
+    Returns:
+        The `stim.Circuit` of the memory experiment.
+    """
+    circuit = stim.Circuit.generated(
+        "surface_code:rotated_memory_z",
+        distance=distance,
+        rounds=distance if rounds is None else rounds,
+        after_clifford_depolarization=noise,
+        after_reset_flip_probability=noise,
+        before_measure_flip_probability=noise,
+        before_round_data_depolarization=noise,
+    )
+    return _cx_to_cz(circuit)
+
+
+def _peak_rss_bytes() -> Optional[int]:
+    """The high-water mark of the resident memory of the process, or None where it is unknown."""
+    try:
+        import resource
+    except ImportError:
+        return None
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # Linux reports kilobytes, macOS bytes.
+    return peak if sys.platform == "darwin" else peak * 1024
+
+
+def _best_time(function, repeat: int) -> float:
+    """The shortest time in seconds of `repeat` calls to `function`."""
+    best = float("inf")
+    for _ in range(repeat):
+        start = time.perf_counter()
+        function()
+        best = min(best, time.perf_counter() - start)
+    return best
+
+
+def benchmark_surface_code(
+    distance: int,
+    *,
+    rounds: Optional[int] = None,
+    shots: int = 10000,
+    noise: float = 1e-3,
+    leakage_probability: float = 1e-3,
+    engines: Sequence[str] = ENGINES,
+    readout_strategies: Sequence[str] = READOUT_STRATEGIES,
+    num_threads: int = 1,
+    repeat: int = 3,
+    seed: int = 0,
+) -> Dict[str, Any]:
+    """Benchmark one surface code workload.
+
+    Args:
+        distance: The distance of the code.
+        rounds: The number of rounds. If None, `distance` rounds.
+        shots: The number of shots of every sampling call.
+        noise: The probability of the Pauli errors of the circuit, see `surface_code_circuit`.
+        leakage_probability: The leakage probability of every CZ, see `leaky_cz_kraus_operators`.
+        engines: The names of the `leaky.Engine` values to sample with.
+        readout_strategies: The names of the `leaky.ReadoutStrategy` values to sample with.
+        num_threads: The number of sampling threads, 0 for all hardware threads.
+        repeat: The number of times every sampling call is timed, the shortest time
+            being reported.
+        seed: The seed of the simulator.
+
+    Returns:
+        A JSON-serializable dict. The times are in seconds, and `max_rss_bytes` is the peak
+        resident memory of the process after the call, which never decreases during a run.
+        The entries of `"sample_batch"` time `CompiledSampler.sample` on the circuit compiled
+        once, as `timings["compile_sampler"]`, so their `shots_per_second` excludes compilation.
+    """
+    timings: Dict[str, float] = {}
+    start = time.perf_counter()
+    circuit = surface_code_circuit(distance, rounds, noise)
+    timings["generate_circuit"] = time.perf_counter() - start
+
+    start = time.perf_counter()
+    channel = decompose_kraus_operators_to_leaky_pauli_channel(
+        leaky_cz_kraus_operators(leakage_probability), num_qubits=2, num_level=3
+    )
+    timings["decompose_kraus_operators"] = time.perf_counter() - start
+
+    start = time.perf_counter()
+    simulator = leaky.Simulator(circuit.num_qubits, seed=seed)
+    timings["construct_simulator"] = time.perf_counter() - start
+
+    pairs = _cz_pairs(circuit)
+    start = time.perf_counter()
+    for pair in pairs:
+        simulator.bind_leaky_channel(leaky.Instruction("CZ", pair), channel)
+    timings["bind_leaky_channel"] = time.perf_counter() - start
+
+    start = time.perf_counter()
+    sampler = simulator.compile_sampler(circuit)
+    timings["compile_sampler"] = time.perf_counter() - start
+
+    # The circuit is compiled once above, so the sampling times leave out parsing and compiling it.
+    samples = []
+    for engine in engines:
+        for readout_strategy in readout_strategies:
+            seconds = _best_time(
+                lambda: sampler.sample(
+                    shots,
+                    getattr(leaky.ReadoutStrategy, readout_strategy),
+                    num_threads=num_threads,
+                    engine=getattr(leaky.Engine, engine),
+                ),
+                repeat,
+            )
+            samples.append(
+                {
+                    "engine": engine,
+                    "readout_strategy": readout_strategy,
+                    "shots": shots,
+                    "seconds": seconds,
+                    "shots_per_second": shots / seconds if seconds > 0 else None,
+                    "max_rss_bytes": _peak_rss_bytes(),
+                }
+            )
+    return {
+        "distance": distance,
+        "rounds": distance if rounds is None else rounds,
+        "noise": noise,
+        "leakage_probability": leakage_probability,
+        "num_qubits": circuit.num_qubits,
+        "num_measurements": circuit.num_measurements,
+        "num_bound_channels": len(pairs),
+        "timings": timings,
+        "sample_batch": samples,
+        "max_rss_bytes": _peak_rss_bytes(),
+    }
+
+
+def run_benchmarks(distances: Sequence[int] = (3, 5, 7), **kwargs: Any) -> Dict[str, Any]:
+    """Benchmark the surface code workloads of the given distances.
+
+    Args:
+        distances: The code distances of the workloads, run in order.
+        **kwargs: The options of every workload, see `benchmark_surface_code`.
+
+    Returns:
+        A JSON-serializable dict describing the machine and the build of leaky, with the
+        results of every workload under `"workloads"`.
+    """
+    return {
+        "leaky_version": leaky.__version__,
+        "stim_version": stim.__version__,
+        "simd_width": leaky.simd_width(),
+        "python_version": platform.python_version(),
+        "platform": platform.platform(),
+        "machine": platform.machine(),
+        "workloads": [benchmark_surface_code(distance, **kwargs) for distance in distances],
+    }
+
+
+def main(argv: Optional[Sequence[str]] = None) -> None:
+    parser = argparse.ArgumentParser(prog="python -m leaky.bench", description=__doc__.split("\n\n")[0])
+    parser.add_argument("--distances", type=int, nargs="+", default=[3, 5, 7])
+    parser.add_argument("--rounds", type=int, default=None, help="Default: the distance.")
+    parser.add_argument("--shots", type=int, default=10000)
+    parser.add_argument("--noise", type=float, default=1e-3)
+    parser.add_argument("--leakage-probability", type=float, default=1e-3)
+    parser.add_argument("--engines", nargs="+", choices=ENGINES, default=ENGINES)
+    parser.add_argument("--readout-strategies", nargs="+", choices=READOUT_STRATEGIES, default=READOUT_STRATEGIES)
+    parser.add_argument("--num-threads", type=int, default=1)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--output", default=None, help="The JSON file to write. Default: stdout.")
+    args = parser.parse_args(argv)
+    results = run_benchmarks(
+        args.distances,
+        rounds=args.rounds,
+        shots=args.shots,
+        noise=args.noise,
+        leakage_probability=args.leakage_probability,
+        engines=args.engines,
+        readout_strategies=args.readout_strategies,
+        num_threads=args.num_threads,
+        repeat=args.repeat,
+        seed=args.seed,
+    )
+    text = json.dumps(results, indent=2)
+    if args.output is None:
+        print(text)
+    else:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,52 @@
+import json
+
+import numpy as np
+import pytest
+
+from leaky import bench
+
+
+def test_surface_code_circuit_has_only_cz():
+    circuit = bench.surface_code_circuit(3)
+    names = {instruction.name for instruction in circuit.flattened()}
+    assert "CZ" in names
+    assert "CX" not in names
+    # Compiling CX to CZ keeps the circuit's detectors deterministic.
+    circuit.detector_error_model(decompose_errors=True)
+
+
+def test_leaky_cz_kraus_operators_are_unitary():
+    (kraus,) = bench.leaky_cz_kraus_operators(0.25)
+    np.testing.assert_allclose(kraus.conj().T @ kraus, np.eye(9), atol=1e-12)
+    assert abs(kraus[2, 4]) ** 2 == pytest.approx(0.25)
+
+
+def test_run_benchmarks(tmp_path):
+    output = tmp_path / "bench.json"
+    bench.main(
+        [
+            "--distances", "3",
+            "--rounds", "2",
+            "--shots", "300",
+            "--engines", "Tableau", "Frame",
+            "--repeat", "1",
+            "--output", str(output),
+        ]
+    )
+    results = json.loads(output.read_text())
+    (workload,) = results["workloads"]
+    assert workload["distance"] == 3
+    assert workload["num_bound_channels"] > 0
+    assert set(workload["timings"]) == {
+        "generate_circuit",
+        "decompose_kraus_operators",
+        "construct_simulator",
+        "bind_leaky_channel",
+        "compile_sampler",
+    }
+    assert [(s["engine"], s["readout_strategy"]) for s in workload["sample_batch"]] == [
+        (engine, readout_strategy)
+        for engine in ["Tableau", "Frame"]
+        for readout_strategy in bench.READOUT_STRATEGIES
+    ]
+    assert all(s["shots"] == 300 and s["seconds"] >= 0 for s in workload["sample_batch"])
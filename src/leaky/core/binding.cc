@@ -0,0 +1,109 @@
+#include "leaky/core/binding.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "leaky/core/rand_gen.h"
+#include "stim.h"
+
+std::string leaky::BindingKey::str() const {
+    std::vector<stim::GateTarget> targets;
+    for (size_t i = 0; i < num_targets; i++) {
+        targets.push_back(stim::GateTarget{target_data[i]});
+    }
+    return stim::CircuitInstruction{gate_type, {}, targets}.str();
+}
+
+size_t leaky::BindingKeyHash::operator()(const leaky::BindingKey &key) const {
+    uint64_t h = leaky::splitmix64(((uint64_t)key.gate_type << 8) | key.num_targets);
+    h = leaky::splitmix64(h ^ (((uint64_t)key.target_data[0] << 32) | key.target_data[1]));
+    return leaky::splitmix64(h ^ key.args_digest);
+}
+
+leaky::BindingKey leaky::make_binding_key(
+    stim::GateType gate_type, stim::SpanRef<const stim::GateTarget> targets, stim::SpanRef<const double> args) {
+    if (targets.size() == 0 || targets.size() > 2) {
+        throw std::invalid_argument("A leaky channel can only be bound to one or two targets at a time.");
+    }
+    BindingKey key{gate_type, (uint8_t)targets.size(), {targets[0].data, 0}, 0};
+    if (targets.size() == 2) {
+        key.target_data[1] = targets[1].data;
+    }
+    for (double arg : args) {
+        uint64_t bits;
+        std::memcpy(&bits, &arg, sizeof(bits));
+        key.args_digest = leaky::splitmix64(key.args_digest ^ bits);
+    }
+    return key;
+}
+
+void leaky::bind_leaky_channel(
+    leaky::BoundChannelMap &bound_leaky_channels,
+    const stim::CircuitInstruction &ideal_inst,
+    const leaky::LeakyPauliChannel &channel) {
+    auto flags = stim::GATE_DATA[ideal_inst.gate_type].flags;
+    if (!(flags & stim::GATE_IS_UNITARY)) {
+        throw std::invalid_argument("Only unitary gates can be binded with a leaky channel.");
+    }
+    size_t step = (flags & stim::GATE_IS_SINGLE_QUBIT_GATE) ? 1 : 2;
+    auto targets = ideal_inst.targets;
+    // Frozen once, so the bindings of all the target groups share its alias arena.
+    auto frozen = channel;
+    frozen.freeze();
+    for (size_t i = 0; i < targets.size(); i += step) {
+        auto key = leaky::make_binding_key(ideal_inst.gate_type, targets.sub(i, i + step), ideal_inst.args);
+        bound_leaky_channels.insert(key, frozen);
+    }
+}
+
+bool leaky::has_shared_target_qubits(stim::SpanRef<const stim::GateTarget> targets) {
+    std::vector<uint32_t> qubits;
+    qubits.reserve(targets.size());
+    for (const auto &t : targets) {
+        qubits.push_back(t.qubit_value());
+    }
+    std::sort(qubits.begin(), qubits.end());
+    return std::adjacent_find(qubits.begin(), qubits.end()) != qubits.end();
+}
+
+uint32_t leaky::BoundChannelMap::find(const leaky::BindingKey &key) const {
+    auto it = indices.find(key);
+    return it == indices.end() ? NOT_FOUND : it->second;
+}
+
+std::pair<uint32_t, bool> leaky::BoundChannelMap::insert(
+    const leaky::BindingKey &key, leaky::LeakyPauliChannel channel) {
+    auto [it, inserted] = indices.insert({key, (uint32_t)keys.size()});
+    if (inserted) {
+        keys.push_back(key);
+        channels.push_back(std::move(channel));
+    }
+    return {it->second, inserted};
+}
+
+uint32_t leaky::BoundChannelMap::insert_or_assign(const leaky::BindingKey &key, leaky::LeakyPauliChannel channel) {
+    auto [it, inserted] = indices.insert({key, (uint32_t)keys.size()});
+    if (inserted) {
+        keys.push_back(key);
+        channels.push_back(std::move(channel));
+    } else {
+        channels[it->second] = std::move(channel);
+    }
+    return it->second;
+}
+
+void leaky::BoundChannelMap::reserve(size_t num_bindings) {
+    keys.reserve(num_bindings);
+    channels.reserve(num_bindings);
+    indices.reserve(num_bindings);
+}
+
+void leaky::BoundChannelMap::clear() {
+    keys.clear();
+    channels.clear();
+    indices.clear();
+}
@@ -0,0 +1,96 @@
+#ifndef LEAKY_BINDING_H
+#define LEAKY_BINDING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "leaky/core/channel.h"
+#include "stim.h"
+
+namespace leaky {
+
+/**
+ * @brief Identifies a single- or two-qubit instruction a leaky channel is bound to.
+ *
+ * Built from the gate type, the raw target data and a digest of the parens arguments, so
+ * looking a binding up never formats or allocates.
+ */
+struct BindingKey {
+    stim::GateType gate_type;
+    uint8_t num_targets;
+    std::array<uint32_t, 2> target_data;
+    uint64_t args_digest;
+
+    bool operator==(const BindingKey &other) const = default;
+    /// The instruction text of the key, e.g. "CX 0 1".
+    [[nodiscard]] std::string str() const;
+};
+
+struct BindingKeyHash {
+    size_t operator()(const BindingKey &key) const;
+};
+
+/**
+ * @brief The leaky channels bound to instructions, stored contiguously and referred to by index.
+ *
+ * The hash map only holds the index of each binding, so looking a channel up touches one small
+ * node and the channels themselves sit next to each other in `channels`.
+ */
+struct BoundChannelMap {
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+    /// `channels[i]` is bound to `keys[i]`.
+    std::vector<BindingKey> keys;
+    std::vector<LeakyPauliChannel> channels;
+
+    [[nodiscard]] size_t size() const {
+        return keys.size();
+    }
+    [[nodiscard]] bool empty() const {
+        return keys.empty();
+    }
+    /// The index of the channel bound to `key`, or `NOT_FOUND`.
+    [[nodiscard]] uint32_t find(const BindingKey &key) const;
+    /// Bind `channel` to `key` unless a channel is already bound to it.
+    /// @return The index of the channel bound to `key`, and whether `channel` was inserted.
+    std::pair<uint32_t, bool> insert(const BindingKey &key, LeakyPauliChannel channel);
+    /// Bind `channel` to `key`, replacing any channel already bound to it.
+    uint32_t insert_or_assign(const BindingKey &key, LeakyPauliChannel channel);
+    void reserve(size_t num_bindings);
+    void clear();
+
+   private:
+    std::unordered_map<BindingKey, uint32_t, BindingKeyHash> indices;
+};
+
+/**
+ * @brief Build the binding key of an instruction acting on one or two targets.
+ */
+BindingKey make_binding_key(
+    stim::GateType gate_type, stim::SpanRef<const stim::GateTarget> targets, stim::SpanRef<const double> args);
+
+/**
+ * @brief Bind a frozen copy of `channel` to every single- or two-qubit target group of a unitary instruction.
+ *
+ * Target groups that already have a channel keep it.
+ */
+void bind_leaky_channel(
+    BoundChannelMap &bound_leaky_channels,
+    const stim::CircuitInstruction &ideal_inst,
+    const LeakyPauliChannel &channel);
+
+/**
+ * @brief Whether a qubit appears in more than one target group of an instruction, like qubit 1 in `CX 0 1 1 2`.
+ *
+ * The channels bound to the groups of such an instruction act between its groups, so it cannot be
+ * handed to stim whole before its channels.
+ */
+bool has_shared_target_qubits(stim::SpanRef<const stim::GateTarget> targets);
+
+}  // namespace leaky
+
+#endif  // LEAKY_BINDING_H
@@ -0,0 +1,272 @@
+#include "leaky/core/branching.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/simulator.h"
+#include "stim.h"
+
+/// The probability of a channel to keep an unleaked target unleaked with the identity Pauli, as sampled.
+static double trivial_probability(const leaky::LeakyPauliChannel &channel) {
+    auto it = std::find(channel.initial_status_vec.begin(), channel.initial_status_vec.end(), 0);
+    if (it == channel.initial_status_vec.end()) {
+        return 1.0;
+    }
+    auto idx = std::distance(channel.initial_status_vec.begin(), it);
+    uint32_t begin = channel.transition_offsets[idx];
+    uint32_t end = channel.transition_offsets[idx + 1];
+    const auto &weights = channel.sampling_cumulative_weights();
+    double trivial = 0.0;
+    for (uint32_t j = begin; j < end; j++) {
+        if (channel.transitions[j] == leaky::transition(0, 0)) {
+            trivial += weights[j] - (j == begin ? 0.0 : weights[j - 1]);
+        }
+    }
+    return trivial / weights[end - 1];
+}
+
+/// The non-trivial transitions of a channel out of status 0 with their sampling weights renormalized, and
+/// the same likelihood ratios.
+static leaky::LeakyPauliChannel nontrivial_channel(const leaky::LeakyPauliChannel &channel) {
+    leaky::LeakyPauliChannel result(channel.is_single_qubit_channel);
+    result.leakage_likelihood_ratio = channel.leakage_likelihood_ratio;
+    result.retention_likelihood_ratio = channel.retention_likelihood_ratio;
+    auto it = std::find(channel.initial_status_vec.begin(), channel.initial_status_vec.end(), 0);
+    if (it != channel.initial_status_vec.end()) {
+        auto idx = std::distance(channel.initial_status_vec.begin(), it);
+        uint32_t begin = channel.transition_offsets[idx];
+        uint32_t end = channel.transition_offsets[idx + 1];
+        const auto &weights = channel.sampling_cumulative_weights();
+        std::vector<double> probs(end - begin);
+        double total = 0.0;
+        for (uint32_t j = begin; j < end; j++) {
+            double prob = weights[j] - (j == begin ? 0.0 : weights[j - 1]);
+            probs[j - begin] = channel.transitions[j] == leaky::transition(0, 0) ? 0.0 : prob;
+            total += probs[j - begin];
+        }
+        for (uint32_t j = begin; j < end; j++) {
+            if (probs[j - begin] > 0) {
+                const auto &[final_status, pauli_idx] = channel.transitions[j];
+                result.add_transition(0, final_status, pauli_idx, probs[j - begin] / total);
+            }
+        }
+    }
+    result.freeze();
+    return result;
+}
+
+/// The probabilities of the Paulis a Pauli noise operation applies to each of its target groups, indexed
+/// like the Paulis of leaky transitions: I, X, Y and Z are 0 to 3, and `(p1 << 2) | p2` on two qubits.
+/// Empty if `op` is not Pauli noise.
+static std::vector<double> pauli_error_probabilities(const stim::CircuitInstruction &op) {
+    const auto &args = op.args;
+    switch (op.gate_type) {
+        case stim::GateType::X_ERROR:
+            return {1 - args[0], args[0], 0, 0};
+        case stim::GateType::Y_ERROR:
+            return {1 - args[0], 0, args[0], 0};
+        case stim::GateType::Z_ERROR:
+            return {1 - args[0], 0, 0, args[0]};
+        case stim::GateType::DEPOLARIZE1:
+            return {1 - args[0], args[0] / 3, args[0] / 3, args[0] / 3};
+        case stim::GateType::PAULI_CHANNEL_1:
+            return {1 - args[0] - args[1] - args[2], args[0], args[1], args[2]};
+        case stim::GateType::DEPOLARIZE2: {
+            std::vector<double> probs(16, args[0] / 15);
+            probs[0] = 1 - args[0];
+            return probs;
+        }
+        case stim::GateType::PAULI_CHANNEL_2: {
+            // The arguments are the probabilities of IX, IY, IZ, XI, ..., ZZ, the first Pauli acting on
+            // the first target.
+            std::vector<double> probs(16, 0.0);
+            probs[0] = 1.0;
+            for (size_t k = 0; k < 15; k++) {
+                probs[k + 1] = args[k];
+                probs[0] -= args[k];
+            }
+            return probs;
+        }
+        default:
+            return {};
+    }
+}
+
+/// The errors of `pauli_error_probabilities`, renormalized to the case where some error occurs.
+static leaky::LeakyPauliChannel pauli_error_channel(const std::vector<double> &probs) {
+    leaky::LeakyPauliChannel result(probs.size() == 4);
+    double total = 1 - probs[0];
+    for (size_t pauli = 1; pauli < probs.size(); pauli++) {
+        if (probs[pauli] > 0) {
+            result.add_transition(0, 0, (uint8_t)pauli, probs[pauli] / total);
+        }
+    }
+    result.freeze();
+    return result;
+}
+
+/// Apply the Pauli of index `pauli` to `qubit`, prepended like `stim::TableauSimulator::do_X` does.
+static void apply_pauli(leaky::Simulator &simulator, uint32_t qubit, uint8_t pauli) {
+    auto &inv_state = simulator.tableau_simulator.inv_state;
+    if (pauli == 1) {
+        inv_state.prepend_X(qubit);
+    } else if (pauli == 2) {
+        inv_state.prepend_Y(qubit);
+    } else if (pauli == 3) {
+        inv_state.prepend_Z(qubit);
+    }
+}
+
+/// Whether `op` takes every shot still on the trajectory to the same state, without drawing a random number.
+/// Pauli noise does so when it applies no error.
+static bool is_shared(
+    const stim::TableauSimulator<stim::MAX_BITWORD_WIDTH> &tableau_simulator, const stim::CircuitInstruction &op) {
+    auto flags = stim::GATE_DATA[op.gate_type].flags;
+    if (op.gate_type == stim::GateType::REPEAT) {
+        return false;
+    }
+    if (flags & stim::GATE_HAS_NO_EFFECT_ON_QUBITS) {
+        return true;
+    }
+    if (!pauli_error_probabilities(op).empty()) {
+        return true;
+    }
+    if (op.gate_type == stim::GateType::M || op.gate_type == stim::GateType::R ||
+        op.gate_type == stim::GateType::MR) {
+        if (!op.args.empty() && op.args[0] != 0) {
+            return false;
+        }
+        return std::all_of(op.targets.begin(), op.targets.end(), [&tableau_simulator](const stim::GateTarget &t) {
+            return tableau_simulator.is_deterministic_z(t.qubit_value());
+        });
+    }
+    if (flags & (stim::GATE_PRODUCES_RESULTS | stim::GATE_IS_RESET | stim::GATE_IS_NOISY)) {
+        return false;
+    }
+    return flags & stim::GATE_IS_UNITARY;
+}
+
+leaky::LeakageFreeTrajectory::LeakageFreeTrajectory(Simulator &simulator, const CompiledCircuit &compiled_circuit)
+    : first_operation(compiled_circuit.num_prefix_operations),
+      end_operation(compiled_circuit.num_prefix_operations),
+      branch_points(),
+      snapshots(),
+      nontrivial_channels(),
+      pauli_errors() {
+    std::vector<double> trivial_probabilities;
+    for (const auto &channel : compiled_circuit.channels) {
+        trivial_probabilities.push_back(trivial_probability(channel));
+        nontrivial_channels.push_back(nontrivial_channel(channel));
+    }
+    simulator.clear();
+    simulator.do_compiled_circuit(compiled_circuit, 0, first_operation);
+    const auto &operations = compiled_circuit.circuit.operations;
+    const auto &block = compiled_circuit.blocks[0];
+    double survival = 1.0;
+    for (; end_operation < operations.size(); end_operation++) {
+        const auto &op = operations[end_operation];
+        // The channels of an interleaved instruction act between its target groups.
+        if (!is_shared(simulator.tableau_simulator, op) || block.interleaved[end_operation]) {
+            break;
+        }
+        auto error_probs = pauli_error_probabilities(op);
+        if (!error_probs.empty()) {
+            // The trajectory applies no error, and every target group may branch off with one.
+            if (error_probs[0] < 1.0) {
+                snapshots.push_back(simulator.snapshot());
+                pauli_errors.push_back(pauli_error_channel(error_probs));
+                size_t step = error_probs.size() == 4 ? 1 : 2;
+                for (size_t g = 0; g < op.targets.size() / step; g++) {
+                    survival *= error_probs[0];
+                    branch_points.push_back(
+                        {end_operation,
+                         (uint32_t)g,
+                         (uint32_t)(snapshots.size() - 1),
+                         survival,
+                         (uint32_t)(pauli_errors.size() - 1)});
+                }
+            }
+            continue;
+        }
+        size_t ref_begin = block.channel_offsets[end_operation];
+        size_t ref_end = block.channel_offsets[end_operation + 1];
+        bool may_branch = std::any_of(
+            block.channels.begin() + ref_begin, block.channels.begin() + ref_end, [&](const BoundChannelRef &ref) {
+                return trivial_probabilities[ref.channel] < 1.0;
+            });
+        if (may_branch) {
+            snapshots.push_back(simulator.snapshot());
+        }
+        simulator.do_gate(op, false);
+        for (size_t r = ref_begin; r < ref_end; r++) {
+            uint32_t channel_index = block.channels[r].channel;
+            if (trivial_probabilities[channel_index] < 1.0) {
+                survival *= trivial_probabilities[channel_index];
+                branch_points.push_back(
+                    {end_operation, (uint32_t)(r - ref_begin), (uint32_t)(snapshots.size() - 1), survival, 0});
+            }
+            // Trivial transitions still carry the likelihood ratio of biased channels.
+            simulator.shot_weight *= compiled_circuit.channels[channel_index].retention_likelihood_ratio;
+        }
+    }
+    snapshots.push_back(simulator.snapshot());
+}
+
+void leaky::LeakageFreeTrajectory::sample_shot(Simulator &simulator, const CompiledCircuit &compiled_circuit) const {
+    // The shot stays on the trajectory through the branch points whose survival exceeds `u`.
+    double u = simulator.rng.uniform();
+    auto branch = std::partition_point(branch_points.begin(), branch_points.end(), [u](const BranchPoint &point) {
+        return u < point.survival;
+    });
+    if (branch == branch_points.end()) {
+        simulator.restore(snapshots.back());
+        simulator.do_compiled_circuit(compiled_circuit, end_operation);
+        return;
+    }
+    const auto &op = compiled_circuit.circuit.operations[branch->operation];
+    simulator.restore(snapshots[branch->snapshot]);
+    if (stim::GATE_DATA[op.gate_type].flags & stim::GATE_IS_NOISY) {
+        // The groups before `branch->index` apply no error, and the ones after it are sampled as usual.
+        const auto &errors = pauli_errors[branch->pauli_error];
+        size_t step = errors.is_single_qubit_channel ? 1 : 2;
+        size_t group_begin = branch->index * step;
+        leaky::transition sample;
+        errors.sample_into(0, simulator.rng, sample);
+        uint8_t pauli = sample.second;
+        if (step == 1) {
+            apply_pauli(simulator, op.targets[group_begin].qubit_value(), pauli);
+        } else {
+            apply_pauli(simulator, op.targets[group_begin].qubit_value(), pauli >> 2);
+            apply_pauli(simulator, op.targets[group_begin + 1].qubit_value(), pauli & 0x03);
+        }
+        simulator.do_gate({op.gate_type, op.args, op.targets.sub(group_begin + step, op.targets.size())}, false);
+        simulator.do_compiled_circuit(compiled_circuit, branch->operation + 1);
+        return;
+    }
+    const auto &block = compiled_circuit.blocks[0];
+    size_t ref_begin = block.channel_offsets[branch->operation];
+    size_t ref_end = block.channel_offsets[branch->operation + 1];
+    simulator.do_gate(op, false);
+    for (size_t r = ref_begin; r < ref_end; r++) {
+        const auto &[target_begin, target_end, channel_index] = block.channels[r];
+        const auto *channel = &compiled_circuit.channels[channel_index];
+        if (r < ref_begin + branch->index) {
+            simulator.shot_weight *= channel->retention_likelihood_ratio;
+            continue;
+        }
+        if (r == ref_begin + branch->index) {
+            channel = &nontrivial_channels[channel_index];
+        }
+        auto targets = op.targets.sub(target_begin, target_end);
+        if (targets.size() == 1) {
+            simulator.apply_1q_leaky_pauli_channel(targets, *channel);
+        } else {
+            simulator.apply_2q_leaky_pauli_channel(targets, *channel);
+        }
+    }
+    simulator.do_compiled_circuit(compiled_circuit, branch->operation + 1);
+}
@@ -0,0 +1,72 @@
+#ifndef LEAKY_BRANCHING_H
+#define LEAKY_BRANCHING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/simulator.h"
+
+namespace leaky {
+
+/**
+ * @brief The trajectory a compiled circuit takes when none of its channels and Pauli noise does anything.
+ *
+ * From the end of the deterministic prefix of the circuit up to the first operation whose outcome
+ * is random in that trajectory, shots only differ from it once some channel samples a transition
+ * other than staying unleaked with the identity Pauli, called a trivial transition here, or some
+ * Pauli noise operation applies an error to one of its target groups. So the trajectory is
+ * simulated once, with a snapshot before every operation with bound channels or Pauli noise, and
+ * every shot draws the first channel application or noisy target group at which it branches off
+ * from a single uniform. The shot then resumes from the snapshot before that operation, with a
+ * non-trivial transition or an error, and is simulated as usual from there on.
+ *
+ * The Pauli noise operations are `X_ERROR`, `Y_ERROR`, `Z_ERROR`, `DEPOLARIZE1`, `DEPOLARIZE2`,
+ * `PAULI_CHANNEL_1` and `PAULI_CHANNEL_2`. The shared part of the trajectory ends at the first
+ * `REPEAT` block, other noisy operation, measurement or reset of a qubit whose Z value is random,
+ * measurement or reset in another basis, or instruction whose channels act between its target
+ * groups, see `CompiledBlock::interleaved`. The samples follow the distribution of `Simulator`
+ * exactly, but are not the same samples, since the random numbers are drawn differently.
+ */
+struct LeakageFreeTrajectory {
+    /// A channel application of the shared part, the `index`-th one following `operation`, or with
+    /// a Pauli noise `operation`, its `index`-th target group.
+    struct BranchPoint {
+        size_t operation;
+        uint32_t index;
+        /// The snapshot before `operation` in `snapshots`.
+        uint32_t snapshot;
+        /// The probability that every channel application and noisy target group up to this one,
+        /// included, leaves the shot on the trajectory.
+        double survival;
+        /// With a Pauli noise `operation`, its errors in `pauli_errors`.
+        uint32_t pauli_error;
+    };
+
+    /// The top-level operations `[first_operation, end_operation)` are shared.
+    size_t first_operation;
+    size_t end_operation;
+    std::vector<BranchPoint> branch_points;
+    /// The snapshots of the branch points, followed by the snapshot at `end_operation`.
+    std::vector<SimulatorSnapshot> snapshots;
+    /// `compiled_circuit.channels[c]` restricted to its non-trivial transitions out of status 0.
+    std::vector<LeakyPauliChannel> nontrivial_channels;
+    /// The Pauli errors of each noise operation of the shared part, given that it applies one to a
+    /// target group, as the Paulis of transitions out of status 0 to status 0.
+    std::vector<LeakyPauliChannel> pauli_errors;
+
+    /// Simulate the trajectory with `simulator`, whose state is cleared first and left at its end.
+    LeakageFreeTrajectory(Simulator &simulator, const CompiledCircuit &compiled_circuit);
+
+    /**
+     * @brief Simulate a shot of `compiled_circuit` with `simulator`, of the same size as the one the
+     * trajectory was simulated with.
+     */
+    void sample_shot(Simulator &simulator, const CompiledCircuit &compiled_circuit) const;
+};
+
+}  // namespace leaky
+
+#endif  // LEAKY_BRANCHING_H
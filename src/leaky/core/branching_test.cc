@@ -0,0 +1,199 @@
+#include "leaky/core/branching.h"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+static LeakyPauliChannel leaky_cx_channel() {
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.8);
+    channel.add_transition(0x00, 0x00, 1, 0.1);
+    channel.add_transition(0x00, 0x01, 0, 0.1);
+    channel.add_transition(0x01, 0x01, 0, 0.5);
+    channel.add_transition(0x01, 0x00, 0, 0.5);
+    return channel;
+}
+
+TEST(branching, shares_the_deterministic_part) {
+    Simulator sim(2);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, leaky_cx_channel());
+    // The measurement of qubit 1 is deterministic on the trajectory, the one of qubit 0 is not.
+    auto compiled = compile_circuit(stim::Circuit("H 0\nCX 0 1\nCX 0 1\nM 1\nM 0"), sim.bound_leaky_channels);
+    Simulator trajectory_sim(compiled.num_qubits, 0);
+    LeakageFreeTrajectory trajectory(trajectory_sim, compiled);
+    ASSERT_EQ(trajectory.first_operation, 1);
+    ASSERT_EQ(trajectory.end_operation, 4);
+    ASSERT_EQ(trajectory.branch_points.size(), 2);
+    ASSERT_EQ(trajectory.snapshots.size(), 3);
+    ASSERT_EQ(trajectory.branch_points[0].operation, 1);
+    ASSERT_EQ(trajectory.branch_points[1].operation, 2);
+    ASSERT_NEAR(trajectory.branch_points[0].survival, 0.8, 1e-12);
+    ASSERT_NEAR(trajectory.branch_points[1].survival, 0.64, 1e-12);
+    ASSERT_EQ(trajectory.snapshots.back().measurement_record, std::vector<bool>{false});
+    // Only the non-trivial transitions are left, renormalized.
+    const auto &nontrivial = trajectory.nontrivial_channels[0];
+    ASSERT_NEAR(nontrivial.get_prob_from_to(0x00, 0x00, 1), 0.5, 1e-12);
+    ASSERT_NEAR(nontrivial.get_prob_from_to(0x00, 0x01, 0), 0.5, 1e-12);
+    ASSERT_EQ(nontrivial.get_prob_from_to(0x00, 0x00, 0), 0.0);
+}
+
+TEST(branching, statistics_match_tableau_engine) {
+    Simulator sim(3);
+    auto channel = leaky_cx_channel();
+    for (uint32_t a : {0, 1}) {
+        for (uint32_t b : {1, 2}) {
+            if (a != b) {
+                std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(a), stim::GateTarget::qubit(b)};
+                sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+            }
+        }
+    }
+    auto compiled = compile_circuit(
+        stim::Circuit("R 0 1 2\nCX 0 1\nCX 1 2\nCX 0 1\nM 2\nH 0\nCX 0 2\nM 0 1 2"), sim.bound_leaky_channels);
+    size_t shots = 20000;
+    auto histogram = [&](Engine engine) {
+        std::vector<uint8_t> results(shots * compiled.num_measurements);
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, results.data(), 3, 2, engine);
+        std::map<std::vector<uint8_t>, double> frequencies;
+        for (size_t i = 0; i < shots; i++) {
+            auto row = results.begin() + i * compiled.num_measurements;
+            frequencies[std::vector<uint8_t>(row, row + compiled.num_measurements)] += 1.0 / shots;
+        }
+        return frequencies;
+    };
+    auto tableau = histogram(Engine::Tableau);
+    auto branching = histogram(Engine::Branching);
+    for (const auto &[row, frequency] : tableau) {
+        ASSERT_NEAR(branching[row], frequency, 0.015);
+    }
+    for (const auto &[row, frequency] : branching) {
+        ASSERT_NEAR(tableau[row], frequency, 0.015);
+    }
+}
+
+TEST(branching, branches_at_pauli_noise) {
+    Simulator sim(2);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, leaky_cx_channel());
+    auto compiled = compile_circuit(
+        stim::Circuit("R 0 1\nX_ERROR(0.1) 0 1\nCX 0 1\nDEPOLARIZE2(0.2) 0 1\nX_ERROR(0) 0\nM 0 1"),
+        sim.bound_leaky_channels);
+    Simulator trajectory_sim(compiled.num_qubits, 0);
+    LeakageFreeTrajectory trajectory(trajectory_sim, compiled);
+    // The noise applies no error on the trajectory, which goes on to the end of the circuit.
+    ASSERT_EQ(trajectory.first_operation, 1);
+    ASSERT_EQ(trajectory.end_operation, 6);
+    ASSERT_EQ(trajectory.branch_points.size(), 4);
+    ASSERT_EQ(trajectory.snapshots.size(), 4);
+    ASSERT_EQ(trajectory.pauli_errors.size(), 2);
+    ASSERT_EQ(trajectory.branch_points[1].operation, 1);
+    ASSERT_EQ(trajectory.branch_points[1].index, 1);
+    ASSERT_NEAR(trajectory.branch_points[0].survival, 0.9, 1e-12);
+    ASSERT_NEAR(trajectory.branch_points[1].survival, 0.81, 1e-12);
+    ASSERT_NEAR(trajectory.branch_points[2].survival, 0.648, 1e-12);
+    ASSERT_NEAR(trajectory.branch_points[3].survival, 0.5184, 1e-12);
+    ASSERT_EQ(trajectory.snapshots.back().measurement_record, (std::vector<bool>{false, false}));
+    ASSERT_NEAR(trajectory.pauli_errors[1].get_prob_from_to(0x00, 0x00, 5), 1.0 / 15, 1e-12);
+}
+
+TEST(branching, pauli_noise_statistics_match_tableau_engine) {
+    Simulator sim(3);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(1), stim::GateTarget::qubit(2)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, leaky_cx_channel());
+    // Every measurement is deterministic without noise, so the whole circuit is shared.
+    auto compiled = compile_circuit(
+        stim::Circuit(R"CIRCUIT(
+            R 0 1 2
+            X_ERROR(0.1) 1
+            CX 1 2
+            DEPOLARIZE2(0.1) 0 1
+            H 2
+            Z_ERROR(0.1) 2
+            H 2
+            PAULI_CHANNEL_1(0.05, 0.05, 0.1) 0
+            PAULI_CHANNEL_2(0.1, 0, 0, 0.02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) 0 2
+            Y_ERROR(0.05) 1
+            DEPOLARIZE1(0.1) 2
+            M 0 1 2
+        )CIRCUIT"),
+        sim.bound_leaky_channels);
+    Simulator trajectory_sim(compiled.num_qubits, 0);
+    ASSERT_EQ(LeakageFreeTrajectory(trajectory_sim, compiled).end_operation, compiled.circuit.operations.size());
+    size_t shots = 20000;
+    auto histogram = [&](Engine engine) {
+        std::vector<uint8_t> results(shots * compiled.num_measurements);
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, results.data(), 5, 2, engine);
+        std::map<std::vector<uint8_t>, double> frequencies;
+        for (size_t i = 0; i < shots; i++) {
+            auto row = results.begin() + i * compiled.num_measurements;
+            frequencies[std::vector<uint8_t>(row, row + compiled.num_measurements)] += 1.0 / shots;
+        }
+        return frequencies;
+    };
+    auto tableau = histogram(Engine::Tableau);
+    auto branching = histogram(Engine::Branching);
+    for (const auto &[row, frequency] : tableau) {
+        ASSERT_NEAR(branching[row], frequency, 0.015);
+    }
+    for (const auto &[row, frequency] : branching) {
+        ASSERT_NEAR(tableau[row], frequency, 0.015);
+    }
+}
+
+TEST(branching, independent_of_num_threads_and_weighted) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.99);
+    channel.add_transition(0, 1, 0, 0.01);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nX 0\nM 0 1"), sim.bound_leaky_channels);
+    compiled = with_leakage_bias(std::move(compiled), 20);
+    size_t shots = 3 * SHOTS_PER_BLOCK + 17;
+    std::vector<uint8_t> r1(shots * 2), r3(shots * 2);
+    std::vector<double> w1(shots), w3(shots);
+    auto run = [&](std::vector<uint8_t> &results, std::vector<double> &weights, size_t num_threads) {
+        sample_batch(
+            compiled,
+            shots,
+            ReadoutStrategy::RawLabel,
+            results.data(),
+            7,
+            num_threads,
+            Engine::Branching,
+            false,
+            nullptr,
+            0,
+            nullptr,
+            weights.data());
+    };
+    run(r1, w1, 1);
+    run(r3, w3, 3);
+    ASSERT_EQ(r1, r3);
+    ASSERT_EQ(w1, w3);
+    // Either both X leave qubit 0 unleaked, or one of them leaks it and the gates after are skipped.
+    const auto &biased = compiled.channels[0];
+    double r = biased.retention_likelihood_ratio;
+    double l = biased.leakage_likelihood_ratio;
+    for (size_t i = 0; i < shots; i++) {
+        ASSERT_EQ(r1[2 * i + 1], 1);
+        if (r1[2 * i] == 0) {
+            ASSERT_DOUBLE_EQ(w1[i], r * r);
+        } else {
+            ASSERT_EQ(r1[2 * i], 2);
+            ASSERT_TRUE(w1[i] == l || w1[i] == r * l);
+        }
+    }
+}
@@ -4,13 +4,18 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <ios>
+#include <memory>
 #include <iostream>
 #include <optional>
 #include <ostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "leaky/core/rand_gen.h"
 
@@ -60,27 +65,45 @@ std::string leaky::pauli_idx_to_string(uint8_t idx, bool is_single_qubit_channel
 }
 
 leaky::LeakyPauliChannel::LeakyPauliChannel(bool is_single_qubit_transition)
-    : initial_status_vec(0), transitions(0), cumulative_probs(0), is_single_qubit_channel(is_single_qubit_transition) {
+    : initial_status_vec(0),
+      transition_offsets{0},
+      transitions(0),
+      cumulative_probs(0),
+      cumulative_weights(0),
+      is_single_qubit_channel(is_single_qubit_transition),
+      is_frozen(false),
+      alias_arena(nullptr),
+      num_alias_statuses(0),
+      leakage_likelihood_ratio(1.0),
+      retention_likelihood_ratio(1.0) {
 }
 
 void leaky::LeakyPauliChannel::add_transition(
     uint8_t initial_status, uint8_t final_status, uint8_t pauli_channel_idx, double probability) {
+    if (!cumulative_weights.empty()) {
+        throw std::invalid_argument("Transitions can not be added to a biased channel.");
+    }
+    is_frozen = false;
     auto it = std::find(initial_status_vec.begin(), initial_status_vec.end(), initial_status);
     if (it != initial_status_vec.end()) {
         auto idx = std::distance(initial_status_vec.begin(), it);
-        transitions[idx].emplace_back(std::make_pair(final_status, pauli_channel_idx));
-        auto &probs = cumulative_probs[idx];
-        auto cum_prob = probs.back() + probability;
+        uint32_t end = transition_offsets[idx + 1];
+        auto cum_prob = cumulative_probs[end - 1] + probability;
         if (cum_prob - 1.0 > 1e-6) {
             std::string error_msg =
                 "sum of probabilities for each initial status should not exceed 1, but get " + std::to_string(cum_prob);
             throw std::runtime_error(error_msg);
         }
-        probs.push_back(cum_prob);
+        transitions.insert(transitions.begin() + end, std::make_pair(final_status, pauli_channel_idx));
+        cumulative_probs.insert(cumulative_probs.begin() + end, cum_prob);
+        for (size_t i = idx + 1; i < transition_offsets.size(); i++) {
+            transition_offsets[i]++;
+        }
     } else {
         initial_status_vec.push_back(initial_status);
-        transitions.push_back(std::vector<transition>{std::make_pair(final_status, pauli_channel_idx)});
-        cumulative_probs.push_back(std::vector<double>{probability});
+        transitions.emplace_back(final_status, pauli_channel_idx);
+        cumulative_probs.push_back(probability);
+        transition_offsets.push_back(transitions.size());
     }
 }
 
@@ -91,31 +114,106 @@ double leaky::LeakyPauliChannel::get_prob_from_to(
         return 0.0;
     }
     auto idx = std::distance(initial_status_vec.begin(), it);
-    auto &transitions_from_initial = transitions[idx];
-    auto &probs = cumulative_probs[idx];
-    auto it2 = std::find_if(
-        transitions_from_initial.begin(), transitions_from_initial.end(), [final_status, pauli_idx](auto &trans) {
-            return trans.first == final_status && trans.second == pauli_idx;
-        });
-    if (it2 == transitions_from_initial.end()) {
+    auto begin = transitions.begin() + transition_offsets[idx];
+    auto end = transitions.begin() + transition_offsets[idx + 1];
+    auto it2 = std::find_if(begin, end, [final_status, pauli_idx](auto &trans) {
+        return trans.first == final_status && trans.second == pauli_idx;
+    });
+    if (it2 == end) {
         return 0.0;
     }
-    auto idx2 = std::distance(transitions_from_initial.begin(), it2);
-    auto prob = idx2 == 0 ? probs[idx2] : probs[idx2] - probs[idx2 - 1];
+    auto idx2 = std::distance(transitions.begin(), it2);
+    auto prob = it2 == begin ? cumulative_probs[idx2] : cumulative_probs[idx2] - cumulative_probs[idx2 - 1];
     return prob;
 }
 
 std::optional<leaky::transition> leaky::LeakyPauliChannel::sample(uint8_t initial_status) const {
+    return sample_with_uniform(initial_status, leaky::rand_float(0.0, 1.0));
+}
+
+std::optional<leaky::transition> leaky::LeakyPauliChannel::sample(
+    uint8_t initial_status, leaky::Xoshiro256pp &rng) const {
+    transition result;
+    if (!sample_into(initial_status, rng, result)) {
+        return std::nullopt;
+    }
+    return {result};
+}
+
+std::optional<leaky::transition> leaky::LeakyPauliChannel::sample_with_uniform(
+    uint8_t initial_status, double uniform) const {
     auto it = std::find(initial_status_vec.begin(), initial_status_vec.end(), initial_status);
     if (it == initial_status_vec.end()) {
         return std::nullopt;
     }
     auto idx = std::distance(initial_status_vec.begin(), it);
-    auto &probabilities = cumulative_probs[idx];
-    auto rand_num = leaky::rand_float(0.0, probabilities.back());
-    auto it2 = std::upper_bound(probabilities.begin(), probabilities.end(), rand_num);
-    auto idx2 = std::distance(probabilities.begin(), it2);
-    return {transitions[idx][idx2]};
+    const auto &weights = sampling_cumulative_weights();
+    auto begin = weights.begin() + transition_offsets[idx];
+    auto end = weights.begin() + transition_offsets[idx + 1];
+    auto rand_num = uniform * *(end - 1);
+    auto it2 = std::upper_bound(begin, end, rand_num);
+    // Guard against `rand_num` being rounded up to the total weight.
+    auto idx2 = std::distance(weights.begin(), std::min(it2, end - 1));
+    return {transitions[idx2]};
+}
+
+void leaky::LeakyPauliChannel::freeze() {
+    size_t num_status = 0;
+    for (auto status : initial_status_vec) {
+        num_status = std::max<size_t>(num_status, status + 1);
+    }
+    std::vector<std::vector<AliasEntry>> tables(num_status);
+    for (size_t i = 0; i < initial_status_vec.size(); i++) {
+        const double *probs = sampling_cumulative_weights().data() + transition_offsets[i];
+        const transition *outcomes = transitions.data() + transition_offsets[i];
+        size_t n = transition_offsets[i + 1] - transition_offsets[i];
+        // Also rejects NaN. The channel is left as it was, as the tables are only installed at the end.
+        if (!(probs[n - 1] > 0) || !std::isfinite(probs[n - 1])) {
+            throw std::invalid_argument(
+                "The probabilities of each initial status of a channel must be finite and positive in total.");
+        }
+        // Vose's alias method on the probabilities scaled to a mean of 1.
+        std::vector<double> scaled(n);
+        for (size_t j = 0; j < n; j++) {
+            scaled[j] = (j == 0 ? probs[0] : probs[j] - probs[j - 1]) * n / probs[n - 1];
+        }
+        std::vector<size_t> small, large;
+        for (size_t j = 0; j < n; j++) {
+            (scaled[j] < 1.0 ? small : large).push_back(j);
+        }
+        auto &table = tables[initial_status_vec[i]];
+        table.resize(n);
+        for (size_t j = 0; j < n; j++) {
+            table[j] = {1.0f, outcomes[j], outcomes[j]};
+        }
+        while (!small.empty() && !large.empty()) {
+            size_t s = small.back();
+            size_t l = large.back();
+            small.pop_back();
+            table[s].threshold = (float)scaled[s];
+            table[s].alias = outcomes[l];
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is 1 up to rounding, and keeps its threshold of 1.
+    }
+    auto arena = std::make_shared<uint32_t[]>(num_status + 1 + 2 * transitions.size());
+    uint32_t *columns = arena.get() + num_status + 1;
+    uint32_t num_columns = 0;
+    for (size_t status = 0; status < num_status; status++) {
+        arena[status] = num_columns;
+        for (const auto &entry : tables[status]) {
+            leaky::store_alias_entry(entry, columns + 2 * num_columns);
+            num_columns++;
+        }
+    }
+    arena[num_status] = num_columns;
+    alias_arena = std::shared_ptr<const uint32_t>(arena, arena.get());
+    num_alias_statuses = num_status;
+    is_frozen = true;
 }
 
 /// Do safety check for the channel
@@ -124,14 +222,13 @@ std::optional<leaky::transition> leaky::LeakyPauliChannel::sample(uint8_t initia
 void leaky::LeakyPauliChannel::safety_check() const {
     for (size_t i = 0; i < initial_status_vec.size(); i++) {
         auto initial_status = initial_status_vec[i];
-        auto &transitions_from_initial = transitions[i];
-        auto &probs = cumulative_probs[i];
-        if (std::fabs(probs.back() - 1.0) > 1e-6) {
+        double total = cumulative_probs[transition_offsets[i + 1] - 1];
+        if (std::fabs(total - 1.0) > 1e-6) {
             throw std::runtime_error(
-                "The sum of probabilities for each initial status should be 1, but get " +
-                std::to_string(probs.back()));
+                "The sum of probabilities for each initial status should be 1, but get " + std::to_string(total));
         }
-        for (auto [final_status, pauli_channel_idx] : transitions_from_initial) {
+        for (size_t j = transition_offsets[i]; j < transition_offsets[i + 1]; j++) {
+            auto [final_status, pauli_channel_idx] = transitions[j];
             if (is_single_qubit_channel) {
                 auto transition_type = leaky::get_transition_type(initial_status, final_status);
                 if (transition_type != leaky::TransitionType::R && pauli_channel_idx != 0) {
@@ -155,6 +252,45 @@ void leaky::LeakyPauliChannel::safety_check() const {
     }
 }
 
+leaky::LeakyPauliChannel leaky::LeakyPauliChannel::with_leakage_bias(double leakage_bias) const {
+    if (!(leakage_bias > 0) || !std::isfinite(leakage_bias)) {
+        throw std::invalid_argument("The leakage bias should be a positive finite number.");
+    }
+    if (leakage_likelihood_ratio != 1.0 || retention_likelihood_ratio != 1.0) {
+        throw std::invalid_argument("The channel is already biased.");
+    }
+    LeakyPauliChannel biased = *this;
+    auto it = std::find(initial_status_vec.begin(), initial_status_vec.end(), 0);
+    if (it == initial_status_vec.end()) {
+        return biased;
+    }
+    auto idx = std::distance(initial_status_vec.begin(), it);
+    uint32_t begin = transition_offsets[idx];
+    uint32_t end = transition_offsets[idx + 1];
+    double total = cumulative_probs[end - 1];
+    double leaked = 0.0;
+    double cum_weight = 0.0;
+    std::vector<double> weights = cumulative_probs;
+    for (uint32_t j = begin; j < end; j++) {
+        double prob = cumulative_probs[j] - (j == begin ? 0.0 : cumulative_probs[j - 1]);
+        bool leaks = transitions[j].first != 0;
+        leaked += leaks ? prob : 0.0;
+        cum_weight += leaks ? prob * leakage_bias : prob;
+        weights[j] = cum_weight;
+    }
+    if (leaked == 0.0) {
+        return biased;
+    }
+    biased.cumulative_weights = std::move(weights);
+    // Both distributions are normalized by their totals when sampled.
+    biased.retention_likelihood_ratio = cum_weight / total;
+    biased.leakage_likelihood_ratio = cum_weight / (total * leakage_bias);
+    if (is_frozen) {
+        biased.freeze();
+    }
+    return biased;
+}
+
 std::string leakage_status_to_string(uint8_t status) {
     if (status == 0) {
         return "|C>";
@@ -171,12 +307,8 @@ std::string initial_status_to_string(uint8_t initial_status, bool is_single_qubi
                : leakage_status_to_string(initial_status >> 4) + leakage_status_to_string(initial_status & 0x0F);
 }
 
-uint8_t leaky::LeakyPauliChannel::num_transitions() const {
-    uint8_t count = 0;
-    for (size_t i = 0; i < initial_status_vec.size(); i++) {
-        count += transitions[i].size();
-    }
-    return count;
+size_t leaky::LeakyPauliChannel::num_transitions() const {
+    return transitions.size();
 }
 
 std::string leaky::LeakyPauliChannel::str() const {
@@ -185,9 +317,9 @@ std::string leaky::LeakyPauliChannel::str() const {
     for (size_t i = 0; i < initial_status_vec.size(); i++) {
         auto initial_status = initial_status_vec[i];
         std::string initial_status_str = initial_status_to_string(initial_status, is_single_qubit_channel);
-        for (size_t j = 0; j < transitions[i].size(); j++) {
-            auto prob = j == 0 ? cumulative_probs[i][j] : cumulative_probs[i][j] - cumulative_probs[i][j - 1];
-            auto [final_status, pauli_channel_idx] = transitions[i][j];
+        for (size_t j = transition_offsets[i]; j < transition_offsets[i + 1]; j++) {
+            auto prob = cumulative_probs[j] - (j == transition_offsets[i] ? 0.0 : cumulative_probs[j - 1]);
+            auto [final_status, pauli_channel_idx] = transitions[j];
             auto final_status_str = initial_status_to_string(final_status, is_single_qubit_channel);
             auto pauli_str = leaky::pauli_idx_to_string(pauli_channel_idx, is_single_qubit_channel);
             out << "    " << initial_status_str << " --" << pauli_str << "--> " << final_status_str << ": " << prob
@@ -203,6 +335,6 @@ std::string leaky::LeakyPauliChannel::str() const {
 std::string leaky::LeakyPauliChannel::repr() const {
     std::stringstream out;
     out << "LeakyPauliChannel(is_single_qubit_channel=" << std::boolalpha << is_single_qubit_channel << ", with "
-        << unsigned(num_transitions()) << " transitions attached)\n";
+        << num_transitions() << " transitions attached)\n";
     return out.str();
 }
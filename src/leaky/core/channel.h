@@ -1,13 +1,18 @@
 #ifndef LEAKY_CHANNEL_H
 #define LEAKY_CHANNEL_H
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory>
 #include <optional>
 #include <string>
 #include <sys/types.h>
 #include <utility>
 #include <vector>
 
+#include "leaky/core/rand_gen.h"
+
 namespace leaky {
 
 enum TransitionType : uint8_t {
@@ -23,20 +28,137 @@ std::string pauli_idx_to_string(uint8_t idx, bool is_single_qubit_channel);
 
 typedef std::pair<uint8_t, uint8_t> transition;
 
+/// One column of a Walker/Vose alias table: `primary` is drawn with probability `threshold`,
+/// `alias` otherwise.
+struct AliasEntry {
+    float threshold;
+    transition primary;
+    transition alias;
+};
+
+/// Read an `AliasEntry` from the two words of `LeakyPauliChannel::alias_arena` it is stored in: the
+/// bits of the threshold, then the statuses and Paulis of the primary and alias transitions, one byte each.
+inline AliasEntry load_alias_entry(const uint32_t *words) {
+    AliasEntry entry;
+    std::memcpy(&entry.threshold, words, sizeof(float));
+    const auto *bytes = reinterpret_cast<const uint8_t *>(words + 1);
+    entry.primary = {bytes[0], bytes[1]};
+    entry.alias = {bytes[2], bytes[3]};
+    return entry;
+}
+
+inline void store_alias_entry(const AliasEntry &entry, uint32_t *words) {
+    std::memcpy(words, &entry.threshold, sizeof(float));
+    auto *bytes = reinterpret_cast<uint8_t *>(words + 1);
+    bytes[0] = entry.primary.first;
+    bytes[1] = entry.primary.second;
+    bytes[2] = entry.alias.first;
+    bytes[3] = entry.alias.second;
+}
+
 struct LeakyPauliChannel {
     std::vector<uint8_t> initial_status_vec;
-    std::vector<std::vector<transition>> transitions;
-    std::vector<std::vector<double>> cumulative_probs;
+    /// The transitions from `initial_status_vec[i]` are `transitions[transition_offsets[i]:transition_offsets[i + 1]]`,
+    /// and `cumulative_probs` holds their running sums. These arrays describe the channel exactly, for building,
+    /// checking and biasing it, while sampling a frozen channel only reads `alias_arena`.
+    std::vector<uint32_t> transition_offsets;
+    std::vector<transition> transitions;
+    std::vector<double> cumulative_probs;
+    /// The running sums of the weights the transitions are sampled with, in the layout of `cumulative_probs`.
+    /// Empty, sampling the true probabilities, unless the channel was made by `with_leakage_bias`.
+    std::vector<double> cumulative_weights;
     bool is_single_qubit_channel;
+    /// Whether the alias tables below are up to date, see `freeze()`.
+    bool is_frozen;
+    /**
+     * The alias tables, which are all `sample_into` reads, in one block of 32-bit words: the
+     * `num_alias_statuses + 1` offsets of `alias_offsets()`, then the `AliasEntry` columns, two words
+     * each. The table of status `s` is columns `[alias_offsets()[s], alias_offsets()[s + 1])`, and
+     * statuses past `num_alias_statuses` have no transition.
+     *
+     * The block is never modified once built, so the copies of a channel share it, and it may be a
+     * view into a mapped channel library, see `load_channel_library`.
+     */
+    std::shared_ptr<const uint32_t> alias_arena;
+    uint32_t num_alias_statuses;
+    /// The likelihood ratios, true over sampled probability, of the transitions out of status 0 that
+    /// leak some qubit or that do not. Both are 1 unless the channel was made by `with_leakage_bias`.
+    double leakage_likelihood_ratio;
+    double retention_likelihood_ratio;
 
     explicit LeakyPauliChannel(bool is_single_qubit_transition = true);
     void add_transition(uint8_t initial_status, uint8_t final_status, uint8_t pauli_channel_idx, double probability);
     [[nodiscard]] double get_prob_from_to(uint8_t initial_status, uint8_t final_status, uint8_t pauli_idx) const;
-    [[nodiscard]] uint8_t num_transitions() const;
+    /// The running sums the transitions are sampled in proportion to: `cumulative_weights` if any, else the
+    /// true `cumulative_probs`.
+    [[nodiscard]] inline const std::vector<double> &sampling_cumulative_weights() const {
+        return cumulative_weights.empty() ? cumulative_probs : cumulative_weights;
+    }
+    [[nodiscard]] inline const uint32_t *alias_offsets() const {
+        return alias_arena.get();
+    }
+    /// The number of words of `alias_arena`, zero unless the channel is frozen.
+    [[nodiscard]] inline size_t alias_arena_size() const {
+        return is_frozen ? num_alias_statuses + 1 + 2 * (size_t)alias_offsets()[num_alias_statuses] : 0;
+    }
+    [[nodiscard]] size_t num_transitions() const;
     [[nodiscard]] std::optional<transition> sample(uint8_t initial_status) const;
+    [[nodiscard]] std::optional<transition> sample(uint8_t initial_status, Xoshiro256pp &rng) const;
+    /**
+     * @brief Sample a transition from `initial_status` into `result`.
+     *
+     * Frozen channels are sampled in constant time from a single uniform draw.
+     *
+     * @return false if there is no transition from `initial_status`.
+     */
+    inline bool sample_into(uint8_t initial_status, Xoshiro256pp &rng, transition &result) const {
+        if (!is_frozen) {
+            auto sample = sample_with_uniform(initial_status, rng.uniform());
+            if (sample.has_value()) {
+                result = sample.value();
+            }
+            return sample.has_value();
+        }
+        if (initial_status >= num_alias_statuses) {
+            return false;
+        }
+        const uint32_t *offsets = alias_offsets();
+        uint32_t begin = offsets[initial_status];
+        uint32_t size = offsets[initial_status + 1] - begin;
+        if (size == 0) {
+            return false;
+        }
+        double x = rng.uniform() * size;
+        uint32_t column = (uint32_t)x;
+        auto entry = load_alias_entry(offsets + num_alias_statuses + 1 + 2 * (size_t)(begin + column));
+        result = x - column < entry.threshold ? entry.primary : entry.alias;
+        return true;
+    }
+    /**
+     * @brief Build the alias tables used by `sample_into`; adding a transition unfreezes the channel.
+     *
+     * Meant to be called once the channel is complete and has passed `safety_check()`. Like
+     * `sample`, the sampling weights of each initial status are normalized by their sum, and
+     * `std::invalid_argument` is thrown when that sum is not finite and positive.
+     */
+    void freeze();
     void safety_check() const;
+    /**
+     * @brief Copy the channel with the transitions out of status 0 that leak some qubit made `leakage_bias`
+     * times as likely, relative to the ones that do not.
+     *
+     * The copy keeps the true probabilities, so `safety_check`, `str` and `get_prob_from_to` describe the
+     * physical channel, and is sampled from the biased `cumulative_weights` instead. The likelihood ratios of
+     * the biased transitions are kept in `leakage_likelihood_ratio` and `retention_likelihood_ratio`, so
+     * importance samplers can weight their shots back to the true distribution. The other statuses are
+     * sampled unchanged. Transitions can not be added to the copy.
+     */
+    [[nodiscard]] LeakyPauliChannel with_leakage_bias(double leakage_bias) const;
     [[nodiscard]] std::string str() const;
     [[nodiscard]] std::string repr() const;
+
+   private:
+    [[nodiscard]] std::optional<transition> sample_with_uniform(uint8_t initial_status, double uniform) const;
 };
 
 }  // namespace leaky
@@ -1,10 +1,17 @@
 #include "leaky/core/channel.pybind.h"
 
+#include <complex>
 #include <pybind11/cast.h>
+#include <pybind11/complex.h>
+#include <pybind11/numpy.h>
 #include <pybind11/pytypes.h>
 #include <pybind11/stl.h>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
 
 #include "leaky/core/channel.h"
+#include "leaky/core/decomposition.h"
 #include "pybind11/pybind11.h"
 
 py::class_<leaky::LeakyPauliChannel> leaky_pybind::pybind_channel(py::module &m) {
@@ -14,6 +21,18 @@ py::class_<leaky::LeakyPauliChannel> leaky_pybind::pybind_channel(py::module &m)
 void leaky_pybind::pybind_channel_methods(py::module &m, py::class_<leaky::LeakyPauliChannel> &c) {
     c.def(py::init<bool>(), py::arg("is_single_qubit_channel") = py::bool_(true));
     c.def_property_readonly("num_transitions", &leaky::LeakyPauliChannel::num_transitions);
+    c.def_property_readonly("transitions", [](const leaky::LeakyPauliChannel &self) {
+        std::vector<std::tuple<uint8_t, uint8_t, uint8_t, double>> transitions;
+        for (size_t i = 0; i < self.initial_status_vec.size(); i++) {
+            uint32_t begin = self.transition_offsets[i];
+            for (uint32_t j = begin; j < self.transition_offsets[i + 1]; j++) {
+                double prob = self.cumulative_probs[j] - (j == begin ? 0.0 : self.cumulative_probs[j - 1]);
+                transitions.emplace_back(
+                    self.initial_status_vec[i], self.transitions[j].first, self.transitions[j].second, prob);
+            }
+        }
+        return transitions;
+    });
     c.def(
         "add_transition",
         &leaky::LeakyPauliChannel::add_transition,
@@ -27,8 +46,39 @@ void leaky_pybind::pybind_channel_methods(py::module &m, py::class_<leaky::Leaky
         py::arg("initial_status"),
         py::arg("final_status"),
         py::arg("pauli_idx"));
-    c.def("sample", &leaky::LeakyPauliChannel::sample, py::arg("initial_status"));
+    c.def(
+        "sample",
+        py::overload_cast<uint8_t>(&leaky::LeakyPauliChannel::sample, py::const_),
+        py::arg("initial_status"));
     c.def("safety_check", &leaky::LeakyPauliChannel::safety_check);
+    c.def("freeze", &leaky::LeakyPauliChannel::freeze);
+    c.def_readonly("is_frozen", &leaky::LeakyPauliChannel::is_frozen);
     c.def("__str__", &leaky::LeakyPauliChannel::str);
     c.def("__repr__", &leaky::LeakyPauliChannel::repr);
+
+    m.def(
+        "decompose_kraus_operators",
+        [](const py::array_t<std::complex<double>, py::array::c_style | py::array::forcecast> &kraus_operators,
+           uint8_t num_qubits,
+           uint8_t num_level,
+           size_t num_threads) {
+            if (kraus_operators.ndim() != 3 || kraus_operators.shape(1) != kraus_operators.shape(2)) {
+                throw std::invalid_argument("Expected a stack of square Kraus operators.");
+            }
+            py::ssize_t dim = num_level;
+            for (uint8_t q = 1; q < num_qubits; q++) {
+                dim *= num_level;
+            }
+            if (kraus_operators.shape(1) != dim) {
+                throw std::invalid_argument("The Kraus operators should be of dimension num_level ** num_qubits.");
+            }
+            const std::complex<double> *data = kraus_operators.data();
+            size_t num_kraus_operators = kraus_operators.shape(0);
+            py::gil_scoped_release release;
+            return leaky::decompose_kraus_operators(data, num_kraus_operators, num_qubits, num_level, num_threads);
+        },
+        py::arg("kraus_operators"),
+        py::arg("num_qubits"),
+        py::arg("num_level"),
+        py::arg("num_threads") = 1);
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/rand_gen.h"
+
+using namespace leaky;
+
+static LeakyPauliChannel make_2q_channel() {
+    LeakyPauliChannel channel(false);
+    for (uint8_t p = 0; p < 16; p++) {
+        channel.add_transition(0x00, 0x00, p, 0.98 / 16);
+    }
+    channel.add_transition(0x00, 0x10, 0, 0.01);
+    channel.add_transition(0x00, 0x01, 0, 0.01);
+    channel.add_transition(0x10, 0x10, 0, 0.5);
+    channel.add_transition(0x10, 0x00, 0, 0.5);
+    return channel;
+}
+
+static void BM_channel_sample(benchmark::State &state) {
+    auto channel = make_2q_channel();
+    Xoshiro256pp rng(0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(channel.sample(0x00, rng));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_channel_sample);
+
+static void BM_channel_sample_frozen(benchmark::State &state) {
+    auto channel = make_2q_channel();
+    channel.freeze();
+    Xoshiro256pp rng(0);
+    transition result;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(channel.sample_into(0x00, rng, result));
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_channel_sample_frozen);
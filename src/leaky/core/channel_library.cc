@@ -0,0 +1,334 @@
+#include "leaky/core/channel_library.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel.h"
+#include "stim.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The alias arenas are used in place, so their little-endian words must be native ones.
+static_assert(
+    std::endian::native == std::endian::little, "Channel libraries are only supported on little-endian hosts.");
+
+static const char LIBRARY_MAGIC[8] = {'L', 'E', 'A', 'K', 'Y', 'L', 'I', 'B'};
+static const uint32_t LIBRARY_VERSION = 2;
+
+static void put_uint(std::string &out, uint64_t value, size_t num_bytes) {
+    for (size_t k = 0; k < num_bytes; k++) {
+        out.push_back((char)((value >> (8 * k)) & 0xFF));
+    }
+}
+
+static void put_double(std::string &out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_uint(out, bits, 8);
+}
+
+/// Reads little-endian values from a byte range, throwing instead of reading past its end.
+struct LibraryReader {
+    /// The start of the library, which the alias arenas are aligned relative to.
+    const uint8_t *begin;
+    const uint8_t *ptr;
+    const uint8_t *end;
+
+    void skip_padding() {
+        size_t padding = (4 - (size_t)(ptr - begin) % 4) % 4;
+        get_uint(padding);
+    }
+
+    uint64_t get_uint(size_t num_bytes) {
+        if ((size_t)(end - ptr) < num_bytes) {
+            throw std::invalid_argument("The channel library is truncated.");
+        }
+        uint64_t value = 0;
+        for (size_t k = 0; k < num_bytes; k++) {
+            value |= (uint64_t)ptr[k] << (8 * k);
+        }
+        ptr += num_bytes;
+        return value;
+    }
+
+    double get_double() {
+        uint64_t bits = get_uint(8);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+std::string leaky::serialize_channel_library(const BoundChannelMap &bound_leaky_channels) {
+    // Sorted by key, so equal channel sets give byte-identical libraries.
+    const auto &keys = bound_leaky_channels.keys;
+    std::vector<size_t> entries(keys.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i] = i;
+    }
+    std::sort(entries.begin(), entries.end(), [&keys](size_t a, size_t b) {
+        const auto &ka = keys[a];
+        const auto &kb = keys[b];
+        return std::tie(ka.gate_type, ka.num_targets, ka.target_data, ka.args_digest) <
+               std::tie(kb.gate_type, kb.num_targets, kb.target_data, kb.args_digest);
+    });
+
+    std::string out(LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC));
+    put_uint(out, LIBRARY_VERSION, 4);
+    put_uint(out, entries.size(), 4);
+    for (size_t entry : entries) {
+        const auto &key = keys[entry];
+        const auto &channel = bound_leaky_channels.channels[entry];
+        // Gates are stored by name, which unlike `stim::GateType` is stable across stim versions.
+        std::string name(stim::GATE_DATA[key.gate_type].name);
+        put_uint(out, name.size(), 1);
+        out.append(name.data(), name.size());
+        put_uint(out, key.num_targets, 1);
+        put_uint(out, key.target_data[0], 4);
+        put_uint(out, key.target_data[1], 4);
+        put_uint(out, key.args_digest, 8);
+        put_uint(out, channel.is_single_qubit_channel, 1);
+        put_uint(out, channel.initial_status_vec.size(), 2);
+        for (size_t i = 0; i < channel.initial_status_vec.size(); i++) {
+            uint32_t begin = channel.transition_offsets[i];
+            uint32_t end = channel.transition_offsets[i + 1];
+            put_uint(out, channel.initial_status_vec[i], 1);
+            put_uint(out, end - begin, 4);
+            for (uint32_t j = begin; j < end; j++) {
+                put_uint(out, channel.transitions[j].first, 1);
+                put_uint(out, channel.transitions[j].second, 1);
+                put_double(out, channel.cumulative_probs[j]);
+            }
+        }
+        // The alias arena word for word, aligned to 4 bytes from the start of the library. It samples
+        // the true probabilities, which are all the library keeps of a biased channel.
+        const leaky::LeakyPauliChannel *frozen = &channel;
+        leaky::LeakyPauliChannel copy(channel.is_single_qubit_channel);
+        if (!channel.is_frozen || !channel.cumulative_weights.empty()) {
+            copy = channel;
+            copy.cumulative_weights.clear();
+            copy.freeze();
+            frozen = &copy;
+        }
+        put_uint(out, frozen->num_alias_statuses, 4);
+        put_uint(out, frozen->alias_arena_size(), 4);
+        out.append((4 - out.size() % 4) % 4, '\0');
+        for (size_t w = 0; w < frozen->alias_arena_size(); w++) {
+            put_uint(out, frozen->alias_arena.get()[w], 4);
+        }
+    }
+    return out;
+}
+
+void leaky::save_channel_library(const BoundChannelMap &bound_leaky_channels, const std::string &filepath) {
+    auto out = serialize_channel_library(bound_leaky_channels);
+    // Written next to the library and renamed over it, so the channels of a previous version still
+    // mapped by some process keep their pages.
+    auto temp_filepath = filepath + ".tmp";
+    FILE *file = fopen(temp_filepath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::invalid_argument("Failed to open '" + temp_filepath + "' to write.");
+    }
+    size_t written = fwrite(out.data(), 1, out.size(), file);
+    fclose(file);
+    if (written != out.size()) {
+        std::remove(temp_filepath.c_str());
+        throw std::runtime_error("Failed to write the channel library to '" + temp_filepath + "'.");
+    }
+#if defined(_WIN32)
+    std::remove(filepath.c_str());
+#endif
+    if (std::rename(temp_filepath.c_str(), filepath.c_str()) != 0) {
+        std::remove(temp_filepath.c_str());
+        throw std::runtime_error("Failed to move the channel library to '" + filepath + "'.");
+    }
+}
+
+/// Read the alias arena of `channel`, whose other fields are read already, and check that it
+/// matches them, so `sample_into` stays within the arena.
+static void read_alias_arena(
+    LibraryReader &reader, const std::shared_ptr<const void> &owner, leaky::LeakyPauliChannel &channel) {
+    auto num_alias_statuses = (uint32_t)reader.get_uint(4);
+    size_t arena_size = reader.get_uint(4);
+    reader.skip_padding();
+    if (arena_size < (size_t)num_alias_statuses + 1 || (size_t)(reader.end - reader.ptr) / 4 < arena_size) {
+        throw std::invalid_argument("The channel library is truncated.");
+    }
+    const uint8_t *words = reader.ptr;
+    reader.ptr += 4 * arena_size;
+    std::shared_ptr<const uint32_t> arena;
+    if (owner != nullptr && (uintptr_t)words % alignof(uint32_t) == 0) {
+        arena = std::shared_ptr<const uint32_t>(owner, reinterpret_cast<const uint32_t *>(words));
+    } else {
+        auto copy = std::make_shared<uint32_t[]>(arena_size);
+        std::memcpy(copy.get(), words, 4 * arena_size);
+        arena = std::shared_ptr<const uint32_t>(copy, copy.get());
+    }
+
+    const uint32_t *offsets = arena.get();
+    size_t num_status = 0;
+    for (auto status : channel.initial_status_vec) {
+        num_status = std::max<size_t>(num_status, status + 1);
+    }
+    bool matches = num_alias_statuses == num_status && offsets[0] == 0 &&
+                   arena_size == num_alias_statuses + 1 + 2 * (size_t)offsets[num_alias_statuses];
+    for (size_t status = 0; matches && status < num_alias_statuses; status++) {
+        matches = offsets[status] <= offsets[status + 1];
+    }
+    for (size_t i = 0; matches && i < channel.initial_status_vec.size(); i++) {
+        auto status = channel.initial_status_vec[i];
+        matches = offsets[status + 1] - offsets[status] ==
+                  channel.transition_offsets[i + 1] - channel.transition_offsets[i];
+    }
+    for (size_t column = 0; matches && column < offsets[num_alias_statuses]; column++) {
+        auto entry = leaky::load_alias_entry(offsets + num_alias_statuses + 1 + 2 * column);
+        matches = entry.threshold >= 0.0f && entry.threshold <= 1.0f;
+    }
+    if (!matches) {
+        throw std::invalid_argument("A channel library alias table does not match the transitions of its channel.");
+    }
+    channel.alias_arena = std::move(arena);
+    channel.num_alias_statuses = num_alias_statuses;
+    channel.is_frozen = true;
+}
+
+static leaky::BoundChannelMap parse_library(
+    LibraryReader reader, const std::shared_ptr<const void> &owner, bool safety_check) {
+    if ((size_t)(reader.end - reader.ptr) < sizeof(LIBRARY_MAGIC) ||
+        std::memcmp(reader.ptr, LIBRARY_MAGIC, sizeof(LIBRARY_MAGIC)) != 0) {
+        throw std::invalid_argument("Not a leaky channel library.");
+    }
+    reader.ptr += sizeof(LIBRARY_MAGIC);
+    if (reader.get_uint(4) != LIBRARY_VERSION) {
+        throw std::invalid_argument("Unsupported channel library version.");
+    }
+    size_t num_entries = reader.get_uint(4);
+    leaky::BoundChannelMap bound_leaky_channels;
+    bound_leaky_channels.reserve(num_entries);
+    for (size_t e = 0; e < num_entries; e++) {
+        size_t name_size = reader.get_uint(1);
+        if ((size_t)(reader.end - reader.ptr) < name_size) {
+            throw std::invalid_argument("The channel library is truncated.");
+        }
+        std::string name((const char *)reader.ptr, name_size);
+        reader.ptr += name_size;
+        leaky::BindingKey key{stim::GATE_DATA.at(name).id, 0, {0, 0}, 0};
+        // The structure is checked regardless of `safety_check`, as `bind_leaky_channel` and the flat
+        // layout of the channels rely on it.
+        auto flags = stim::GATE_DATA[key.gate_type].flags;
+        if (!(flags & stim::GATE_IS_UNITARY)) {
+            throw std::invalid_argument("A channel library binding must be a unitary gate.");
+        }
+        key.num_targets = (uint8_t)reader.get_uint(1);
+        if (key.num_targets != ((flags & stim::GATE_IS_SINGLE_QUBIT_GATE) ? 1 : 2)) {
+            throw std::invalid_argument("A channel library binding must have as many targets as its gate.");
+        }
+        key.target_data[0] = (uint32_t)reader.get_uint(4);
+        key.target_data[1] = (uint32_t)reader.get_uint(4);
+        key.args_digest = reader.get_uint(8);
+
+        leaky::LeakyPauliChannel channel(reader.get_uint(1) != 0);
+        if (channel.is_single_qubit_channel != (key.num_targets == 1)) {
+            throw std::invalid_argument("A channel library channel must act on as many qubits as its binding.");
+        }
+        size_t num_initial_status = reader.get_uint(2);
+        for (size_t i = 0; i < num_initial_status; i++) {
+            auto initial_status = (uint8_t)reader.get_uint(1);
+            if (std::find(channel.initial_status_vec.begin(), channel.initial_status_vec.end(), initial_status) !=
+                channel.initial_status_vec.end()) {
+                throw std::invalid_argument("A channel library channel must not repeat an initial status.");
+            }
+            channel.initial_status_vec.push_back(initial_status);
+            size_t num_transitions = reader.get_uint(4);
+            if (num_transitions == 0) {
+                throw std::invalid_argument("A channel library status must have at least one transition.");
+            }
+            double previous = 0.0;
+            for (size_t j = 0; j < num_transitions; j++) {
+                auto final_status = (uint8_t)reader.get_uint(1);
+                auto pauli_channel_idx = (uint8_t)reader.get_uint(1);
+                double cum_prob = reader.get_double();
+                // Also rejects NaN, and a total of 0 which could not be normalized.
+                bool is_last = j + 1 == num_transitions;
+                if (!(cum_prob >= previous) || !std::isfinite(cum_prob) || (is_last && cum_prob == 0)) {
+                    throw std::invalid_argument(
+                        "The cumulative probabilities of a channel library status must be finite, non-decreasing "
+                        "and positive in total.");
+                }
+                previous = cum_prob;
+                channel.transitions.emplace_back(final_status, pauli_channel_idx);
+                channel.cumulative_probs.push_back(cum_prob);
+            }
+            channel.transition_offsets.push_back(channel.transitions.size());
+        }
+        read_alias_arena(reader, owner, channel);
+        if (safety_check) {
+            channel.safety_check();
+        }
+        bound_leaky_channels.insert_or_assign(key, std::move(channel));
+    }
+    return bound_leaky_channels;
+}
+
+leaky::BoundChannelMap leaky::parse_channel_library(const uint8_t *bytes, size_t size, bool safety_check) {
+    return parse_library({bytes, bytes, bytes + size}, nullptr, safety_check);
+}
+
+leaky::BoundChannelMap leaky::load_channel_library(const std::string &filepath, bool safety_check) {
+#if defined(_WIN32)
+    FILE *file = fopen(filepath.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::invalid_argument("Failed to open '" + filepath + "' to read.");
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    // One aligned buffer the loaded channels keep their alias arenas in.
+    auto words = std::make_shared<uint32_t[]>((bytes.size() + 3) / 4);
+    std::memcpy(words.get(), bytes.data(), bytes.size());
+    const auto *begin = reinterpret_cast<const uint8_t *>(words.get());
+    return parse_library({begin, begin, begin + bytes.size()}, words, safety_check);
+#else
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("Failed to open '" + filepath + "' to read.");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::invalid_argument("Not a leaky channel library.");
+    }
+    size_t size = (size_t)info.st_size;
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map '" + filepath + "' into memory.");
+    }
+    // Unmapped once the last loaded channel using one of its alias arenas is gone.
+    std::shared_ptr<const void> owner(mapping, [size](const void *ptr) {
+        munmap(const_cast<void *>(ptr), size);
+    });
+    const auto *begin = (const uint8_t *)mapping;
+    return parse_library({begin, begin, begin + size}, owner, safety_check);
+#endif
+}
@@ -0,0 +1,52 @@
+#ifndef LEAKY_CHANNEL_LIBRARY_H
+#define LEAKY_CHANNEL_LIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "leaky/core/binding.h"
+
+namespace leaky {
+
+/**
+ * @brief Save bound leaky channels, together with their bindings, to a binary channel library.
+ *
+ * The library stores the gate name, targets and argument digest of every binding followed by
+ * the transitions and cumulative probabilities of its channel, and the `LeakyPauliChannel::alias_arena`
+ * it is sampled from, in little-endian byte order. The arenas are aligned to 4 bytes, so that they
+ * can be used in place. The file is written next to `filepath` and renamed over it, so processes
+ * that mapped a previous version keep their channels.
+ */
+void save_channel_library(const BoundChannelMap &bound_leaky_channels, const std::string &filepath);
+
+/**
+ * @brief The bytes `save_channel_library` writes, for embedding a library into other files.
+ */
+std::string serialize_channel_library(const BoundChannelMap &bound_leaky_channels);
+
+/**
+ * @brief Parse the `size` bytes of a library made by `serialize_channel_library`.
+ *
+ * Unlike `load_channel_library`, the alias arenas are copied, since the bytes may not outlive the channels.
+ *
+ * @param safety_check Like for `load_channel_library`.
+ */
+BoundChannelMap parse_channel_library(const uint8_t *bytes, size_t size, bool safety_check = true);
+
+/**
+ * @brief Load a library written by `save_channel_library`.
+ *
+ * The file is memory-mapped read-only, except on Windows where it is read into one buffer, and the
+ * loaded channels are frozen with their alias arenas pointing into it, so the processes of a node
+ * loading the same library share one copy of everything sampling reads. The mapping lives as long
+ * as any channel using it. The cumulative probabilities, kept for inspecting and biasing the
+ * channels, are copied out of it, and the structure of every channel is checked against its arena.
+ *
+ * @param safety_check Whether to run `LeakyPauliChannel::safety_check` on every loaded channel.
+ */
+BoundChannelMap load_channel_library(const std::string &filepath, bool safety_check = true);
+
+}  // namespace leaky
+
+#endif  // LEAKY_CHANNEL_LIBRARY_H
@@ -0,0 +1,129 @@
+#include "leaky/core/channel_library.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+TEST(channel_library, save_and_load) {
+    LeakyPauliChannel channel_1q(true);
+    channel_1q.add_transition(0, 0, 0, 0.9);
+    channel_1q.add_transition(0, 1, 0, 0.1);
+    channel_1q.add_transition(1, 1, 0, 1);
+    LeakyPauliChannel channel_2q(false);
+    channel_2q.add_transition(0x00, 0x00, 5, 0.75);
+    channel_2q.add_transition(0x00, 0x10, 0, 0.25);
+    Simulator sim(4);
+    std::vector<stim::GateTarget> t0{stim::GateTarget::qubit(0), stim::GateTarget::qubit(2)};
+    std::vector<stim::GateTarget> t01{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, t0}, channel_1q);
+    sim.bind_leaky_channel({stim::GateType::CX, {}, t01}, channel_2q);
+
+    auto path = testing::TempDir() + "channel_library_test.bin";
+    save_channel_library(sim.bound_leaky_channels, path);
+    auto loaded = load_channel_library(path);
+    ASSERT_EQ(loaded.size(), 3);
+    ASSERT_EQ(loaded.size(), sim.bound_leaky_channels.size());
+    for (size_t i = 0; i < sim.bound_leaky_channels.size(); i++) {
+        const auto &channel = sim.bound_leaky_channels.channels[i];
+        auto index = loaded.find(sim.bound_leaky_channels.keys[i]);
+        ASSERT_NE(index, BoundChannelMap::NOT_FOUND);
+        const auto &loaded_channel = loaded.channels[index];
+        ASSERT_TRUE(loaded_channel.is_frozen);
+        ASSERT_EQ(loaded_channel.is_single_qubit_channel, channel.is_single_qubit_channel);
+        ASSERT_EQ(loaded_channel.initial_status_vec, channel.initial_status_vec);
+        ASSERT_EQ(loaded_channel.transition_offsets, channel.transition_offsets);
+        ASSERT_EQ(loaded_channel.transitions, channel.transitions);
+        ASSERT_EQ(loaded_channel.cumulative_probs, channel.cumulative_probs);
+        ASSERT_EQ(loaded_channel.num_alias_statuses, channel.num_alias_statuses);
+        ASSERT_EQ(
+            std::vector<uint32_t>(
+                loaded_channel.alias_arena.get(), loaded_channel.alias_arena.get() + loaded_channel.alias_arena_size()),
+            std::vector<uint32_t>(channel.alias_arena.get(), channel.alias_arena.get() + channel.alias_arena_size()));
+    }
+    std::remove(path.c_str());
+}
+
+TEST(channel_library, loaded_channels_outlive_the_file) {
+    LeakyPauliChannel leak(true);
+    leak.add_transition(0, 1, 0, 1);
+    LeakyPauliChannel stay(true);
+    stay.add_transition(0, 0, 0, 1);
+    BoundChannelMap channels;
+    std::vector<stim::GateTarget> t0{stim::GateTarget::qubit(0)};
+    bind_leaky_channel(channels, {stim::GateType::H, {}, t0}, leak);
+    auto path = testing::TempDir() + "channel_library_replaced.bin";
+    save_channel_library(channels, path);
+    auto loaded = load_channel_library(path);
+
+    BoundChannelMap replacement;
+    bind_leaky_channel(replacement, {stim::GateType::H, {}, t0}, stay);
+    save_channel_library(replacement, path);
+    std::remove(path.c_str());
+    Xoshiro256pp rng(0);
+    transition result;
+    ASSERT_TRUE(loaded.channels[0].sample_into(0, rng, result));
+    ASSERT_EQ(result, transition(1, 0));
+}
+
+TEST(channel_library, rejects_invalid_libraries) {
+    auto path = testing::TempDir() + "channel_library_invalid.bin";
+    FILE *file = fopen(path.c_str(), "wb");
+    fputs("not a library", file);
+    fclose(file);
+    ASSERT_THROW(load_channel_library(path), std::invalid_argument);
+
+    LeakyPauliChannel unnormalized(true);
+    unnormalized.add_transition(0, 0, 0, 0.5);
+    BoundChannelMap channels;
+    std::vector<stim::GateTarget> t0{stim::GateTarget::qubit(0)};
+    channels.insert(make_binding_key(stim::GateType::H, t0, {}), unnormalized);
+    save_channel_library(channels, path);
+    ASSERT_THROW(load_channel_library(path), std::runtime_error);
+    ASSERT_EQ(load_channel_library(path, false).size(), 1);
+    std::remove(path.c_str());
+}
+
+TEST(channel_library, rejects_malformed_channels) {
+    auto parse = [](const BindingKey &key, const LeakyPauliChannel &channel) {
+        BoundChannelMap channels;
+        channels.insert(key, channel);
+        auto bytes = serialize_channel_library(channels);
+        return parse_channel_library((const uint8_t *)bytes.data(), bytes.size(), false);
+    };
+    std::vector<stim::GateTarget> t0{stim::GateTarget::qubit(0)};
+    std::vector<stim::GateTarget> t01{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    auto h_key = make_binding_key(stim::GateType::H, t0, {});
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    ASSERT_EQ(parse(h_key, channel).size(), 1);
+
+    ASSERT_THROW(parse(make_binding_key(stim::GateType::M, t0, {}), channel), std::invalid_argument);
+    ASSERT_THROW(parse(make_binding_key(stim::GateType::H, t01, {}), channel), std::invalid_argument);
+    ASSERT_THROW(parse(h_key, LeakyPauliChannel(false)), std::invalid_argument);
+
+    auto repeated = channel;
+    repeated.initial_status_vec = {0, 0};
+    repeated.transition_offsets = {0, 1, 2};
+    ASSERT_THROW(parse(h_key, repeated), std::invalid_argument);
+
+    auto decreasing = channel;
+    decreasing.cumulative_probs = {0.5, 0.2};
+    ASSERT_THROW(parse(h_key, decreasing), std::invalid_argument);
+
+    BoundChannelMap channels;
+    channels.insert(h_key, channel);
+    auto bytes = serialize_channel_library(channels);
+    // The last offset of the alias arena, followed by its two columns.
+    bytes[bytes.size() - 4 * 5] = 3;
+    ASSERT_THROW(parse_channel_library((const uint8_t *)bytes.data(), bytes.size(), false), std::invalid_argument);
+}
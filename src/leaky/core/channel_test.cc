@@ -1,6 +1,8 @@
 #include "leaky/core/channel.h"
 
 #include <algorithm>
+#include <map>
+#include <stdexcept>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -61,6 +63,22 @@ TEST(channel, add_transition_2q) {
 )");
 }
 
+TEST(channel, flat_storage) {
+    auto channel = LeakyPauliChannel();
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(1, 0, 0, 1.0);
+    channel.add_transition(0, 1, 0, 0.25);
+    channel.add_transition(0, 0, 3, 0.25);
+    ASSERT_EQ(channel.initial_status_vec, (std::vector<uint8_t>{0, 1}));
+    ASSERT_EQ(channel.transition_offsets, (std::vector<uint32_t>{0, 3, 4}));
+    ASSERT_EQ(channel.transitions, (std::vector<transition>{{0, 0}, {1, 0}, {0, 3}, {0, 0}}));
+    ASSERT_EQ(channel.cumulative_probs, (std::vector<double>{0.5, 0.75, 1.0, 1.0}));
+    ASSERT_EQ(channel.num_transitions(), 4);
+    ASSERT_DOUBLE_EQ(channel.get_prob_from_to(0, 0, 3), 0.25);
+    ASSERT_DOUBLE_EQ(channel.get_prob_from_to(1, 0, 0), 1.0);
+    channel.safety_check();
+}
+
 TEST(channel, safety_check) {
     auto channel = LeakyPauliChannel();
     channel.add_transition(0, 0, 0, 0.2);
@@ -105,4 +123,101 @@ TEST(channel, sample) {
     }
 
     ASSERT_FALSE(channel.sample(1).has_value());
-}
\ No newline at end of file
+}
+
+TEST(channel, sample_with_rng) {
+    auto channel = LeakyPauliChannel();
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    Xoshiro256pp rng1(11);
+    Xoshiro256pp rng2(11);
+    size_t num_leaked = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        auto transition = channel.sample(0, rng1);
+        ASSERT_EQ(transition, channel.sample(0, rng2));
+        num_leaked += transition.value().first;
+    }
+    ASSERT_TRUE(400 < num_leaked && num_leaked < 600);
+    ASSERT_FALSE(channel.sample(1, rng1).has_value());
+}
+
+TEST(channel, freeze) {
+    auto channel = LeakyPauliChannel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.6);
+    channel.add_transition(0x00, 0x10, 0, 0.1);
+    channel.add_transition(0x00, 0x00, 5, 0.3);
+    channel.add_transition(0x11, 0x00, 0, 1.0);
+    ASSERT_FALSE(channel.is_frozen);
+    channel.freeze();
+    ASSERT_TRUE(channel.is_frozen);
+    ASSERT_EQ(channel.num_alias_statuses, 0x11 + 1);
+    ASSERT_EQ(channel.alias_offsets()[channel.num_alias_statuses], 4);
+    ASSERT_EQ(channel.alias_arena_size(), 0x11 + 2 + 2 * 4);
+    auto copy = channel;
+    ASSERT_EQ(copy.alias_arena.get(), channel.alias_arena.get());
+    Xoshiro256pp rng(3);
+    transition result;
+    std::map<transition, size_t> counts;
+    for (size_t i = 0; i < 10000; i++) {
+        ASSERT_TRUE(channel.sample_into(0x00, rng, result));
+        counts[result]++;
+    }
+    ASSERT_NEAR(counts[transition(0x00, 0)] / 10000.0, 0.6, 0.03);
+    ASSERT_NEAR(counts[transition(0x10, 0)] / 10000.0, 0.1, 0.02);
+    ASSERT_NEAR(counts[transition(0x00, 5)] / 10000.0, 0.3, 0.03);
+    ASSERT_TRUE(channel.sample_into(0x11, rng, result));
+    ASSERT_EQ(result, transition(0x00, 0));
+    ASSERT_FALSE(channel.sample_into(0x01, rng, result));
+
+    channel.add_transition(0x01, 0x01, 0, 1.0);
+    ASSERT_FALSE(channel.is_frozen);
+    ASSERT_TRUE(channel.sample_into(0x01, rng, result));
+}
+
+TEST(channel, freeze_rejects_statuses_without_weight) {
+    auto channel = LeakyPauliChannel(true);
+    channel.add_transition(0, 0, 0, 1.0);
+    channel.add_transition(1, 1, 0, 0.0);
+    ASSERT_THROW(channel.freeze(), std::invalid_argument);
+    ASSERT_FALSE(channel.is_frozen);
+    ASSERT_EQ(channel.alias_arena, nullptr);
+}
+
+TEST(channel, with_leakage_bias) {
+    auto channel = LeakyPauliChannel(true);
+    channel.add_transition(0, 0, 0, 0.98);
+    channel.add_transition(0, 1, 0, 0.02);
+    channel.add_transition(1, 0, 0, 0.5);
+    channel.add_transition(1, 1, 0, 0.5);
+    channel.freeze();
+    auto biased = channel.with_leakage_bias(10);
+    ASSERT_TRUE(biased.is_frozen);
+    double total = 0.98 + 0.2;
+    // The true probabilities are kept, and the biased ones only sampled.
+    ASSERT_EQ(biased.cumulative_probs, channel.cumulative_probs);
+    ASSERT_NEAR(biased.get_prob_from_to(0, 1, 0), 0.02, 1e-12);
+    ASSERT_EQ(biased.str(), channel.str());
+    biased.safety_check();
+    ASSERT_NEAR(biased.cumulative_weights[0] / total, 0.98 / total, 1e-12);
+    ASSERT_NEAR((biased.cumulative_weights[1] - biased.cumulative_weights[0]) / total, 0.2 / total, 1e-12);
+    ASSERT_NEAR(biased.retention_likelihood_ratio, total, 1e-12);
+    ASSERT_NEAR(biased.leakage_likelihood_ratio, total / 10, 1e-12);
+    ASSERT_EQ(biased.get_prob_from_to(1, 0, 0), 0.5);
+    ASSERT_EQ(biased.get_prob_from_to(1, 1, 0), 0.5);
+    // The weighted sampled probabilities are the true ones.
+    ASSERT_NEAR(0.98 / total * biased.retention_likelihood_ratio, 0.98, 1e-12);
+    ASSERT_NEAR(0.2 / total * biased.leakage_likelihood_ratio, 0.02, 1e-12);
+    Xoshiro256pp rng(5);
+    transition result;
+    size_t num_leaked = 0;
+    for (size_t i = 0; i < 10000; i++) {
+        ASSERT_TRUE(biased.sample_into(0, rng, result));
+        num_leaked += result.first != 0;
+    }
+    ASSERT_NEAR(num_leaked / 10000.0, 0.2 / total, 0.02);
+
+    ASSERT_EQ(channel.leakage_likelihood_ratio, 1.0);
+    ASSERT_THROW(channel.with_leakage_bias(0), std::invalid_argument);
+    ASSERT_THROW(biased.with_leakage_bias(2), std::invalid_argument);
+    ASSERT_THROW(biased.add_transition(2, 2, 0, 1.0), std::invalid_argument);
+}
@@ -0,0 +1,124 @@
+#include "leaky/core/chunk_producer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+
+/// Round `chunk_shots` up to a whole, non-zero number of blocks.
+static size_t whole_block_shots(size_t chunk_shots, leaky::Engine engine) {
+    size_t block_shots = leaky::shots_per_block(engine);
+    return std::max<size_t>((chunk_shots + block_shots - 1) / block_shots, 1) * block_shots;
+}
+
+leaky::ChunkProducer::ChunkProducer(
+    CompiledCircuit compiled_circuit,
+    size_t shots,
+    size_t chunk_shots,
+    ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    Engine engine,
+    size_t num_buffers,
+    std::optional<bool> sparse_leakage)
+    : compiled_circuit(std::move(compiled_circuit)),
+      shots(shots),
+      chunk_shots(whole_block_shots(chunk_shots, engine)),
+      readout_strategy(readout_strategy),
+      seed(seed),
+      num_threads(num_threads),
+      engine(engine),
+      sparse_leakage(sparse_leakage),
+      buffers(),
+      sampler(),
+      num_sampled(0),
+      num_consumed(0),
+      stopping(false),
+      error(),
+      mutex(),
+      changed(),
+      thread() {
+    if (num_buffers == 0) {
+        throw std::invalid_argument("A chunk producer needs at least one buffer.");
+    }
+    size_t buffer_size = std::min(this->chunk_shots, shots) * this->compiled_circuit.num_measurements;
+    buffers.assign(num_buffers, std::vector<uint8_t>(buffer_size));
+    thread = std::thread(&ChunkProducer::produce, this);
+}
+
+leaky::ChunkProducer::~ChunkProducer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+size_t leaky::ChunkProducer::next_chunk_shots() const {
+    size_t shot_begin = std::min(num_consumed * chunk_shots, shots);
+    return std::min(chunk_shots, shots - shot_begin);
+}
+
+void leaky::ChunkProducer::next(uint8_t *records_ptr) {
+    size_t num_shots = next_chunk_shots();
+    if (num_shots == 0) {
+        return;
+    }
+    // A chunk of a circuit without measurements has no bytes, but is still consumed.
+    size_t num_bytes = num_shots * compiled_circuit.num_measurements;
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return num_sampled > num_consumed || error; });
+    if (num_sampled == num_consumed) {
+        std::rethrow_exception(error);
+    }
+    // The producer never writes to a buffer holding a chunk that is not consumed yet.
+    const uint8_t *records = buffers[num_consumed % buffers.size()].data();
+    lock.unlock();
+    if (num_bytes > 0) {
+        std::memcpy(records_ptr, records, num_bytes);
+    }
+    lock.lock();
+    num_consumed++;
+    lock.unlock();
+    changed.notify_all();
+}
+
+void leaky::ChunkProducer::produce() {
+    size_t block_shots = shots_per_block(engine);
+    for (size_t shot_begin = 0, k = 0; shot_begin < shots; shot_begin += chunk_shots, k++) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() { return stopping || num_sampled - num_consumed < buffers.size(); });
+            if (stopping) {
+                return;
+            }
+        }
+        try {
+            if (!sampler.has_value()) {
+                sampler.emplace(compiled_circuit, readout_strategy, seed, num_threads, engine, false, sparse_leakage);
+            }
+            size_t n = std::min(chunk_shots, shots - shot_begin);
+            sampler->sample(shot_begin / block_shots, n, buffers[k % buffers.size()].data());
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            changed.notify_all();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            num_sampled++;
+        }
+        changed.notify_all();
+    }
+}
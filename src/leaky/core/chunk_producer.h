@@ -0,0 +1,82 @@
+#ifndef LEAKY_CHUNK_PRODUCER_H
+#define LEAKY_CHUNK_PRODUCER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+
+namespace leaky {
+
+/**
+ * @brief Samples the chunks of a job on a background thread, ahead of their consumer.
+ *
+ * Up to `num_buffers` sampled chunks wait in a ring of reusable buffers, so the chunks are
+ * simulated while the previous ones are consumed, and the producer blocks rather than using
+ * more memory when the consumer falls behind. The chunks are those of `sample_chunks` with the
+ * same arguments, handed out in order by `next`, and like for it are all sampled by one
+ * `BlockSampler`, set up by the producer thread before its first chunk.
+ */
+struct ChunkProducer {
+    CompiledCircuit compiled_circuit;
+    size_t shots;
+    /// Rounded up to whole blocks, like for `sample_chunks`.
+    size_t chunk_shots;
+    ReadoutStrategy readout_strategy;
+    uint64_t seed;
+    size_t num_threads;
+    Engine engine;
+    std::optional<bool> sparse_leakage;
+    std::vector<std::vector<uint8_t>> buffers;
+    /// Only used by the producer thread, which builds it.
+    std::optional<BlockSampler> sampler;
+    /// Chunk `k` is sampled into `buffers[k % buffers.size()]`.
+    size_t num_sampled;
+    size_t num_consumed;
+    bool stopping;
+    /// The error the producer stopped on, rethrown once the chunks sampled before it are consumed.
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    ChunkProducer(
+        CompiledCircuit compiled_circuit,
+        size_t shots,
+        size_t chunk_shots,
+        ReadoutStrategy readout_strategy,
+        uint64_t seed,
+        size_t num_threads = 1,
+        Engine engine = Engine::Tableau,
+        size_t num_buffers = 2,
+        std::optional<bool> sparse_leakage = std::nullopt);
+    ChunkProducer(const ChunkProducer &) = delete;
+    ChunkProducer &operator=(const ChunkProducer &) = delete;
+    /// Stops the producer after the chunk it is sampling, if any.
+    ~ChunkProducer();
+
+    /// The number of shots of the next chunk, 0 once every chunk has been handed out.
+    [[nodiscard]] size_t next_chunk_shots() const;
+    /**
+     * @brief Wait for the next chunk and copy its records to `records_ptr`.
+     *
+     * `records_ptr` must hold `next_chunk_shots() * compiled_circuit.num_measurements` bytes.
+     * Errors raised while sampling the chunk are rethrown here.
+     */
+    void next(uint8_t *records_ptr);
+
+   private:
+    void produce();
+};
+
+}  // namespace leaky
+
+#endif  // LEAKY_CHUNK_PRODUCER_H
@@ -0,0 +1,75 @@
+#include "leaky/core/chunk_producer.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+static CompiledCircuit leaky_circuit(Simulator &sim) {
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    return compile_circuit(stim::Circuit("H 1\nX 0 1\nM 0 1"), sim.bound_leaky_channels);
+}
+
+TEST(chunk_producer, chunks_match_sample_batch) {
+    Simulator sim(2);
+    auto compiled = leaky_circuit(sim);
+    size_t shots = 5 * SHOTS_PER_BLOCK + 9;
+    std::vector<uint8_t> expected(shots * 2);
+    sample_batch(compiled, shots, ReadoutStrategy::RawLabel, expected.data(), 17, 2);
+    for (size_t num_buffers : {1, 3}) {
+        ChunkProducer producer(
+            compiled, shots, SHOTS_PER_BLOCK + 1, ReadoutStrategy::RawLabel, 17, 2, Engine::Tableau, num_buffers);
+        ASSERT_EQ(producer.chunk_shots, 2 * SHOTS_PER_BLOCK);
+        std::vector<uint8_t> results;
+        while (size_t n = producer.next_chunk_shots()) {
+            std::vector<uint8_t> chunk(n * 2);
+            producer.next(chunk.data());
+            results.insert(results.end(), chunk.begin(), chunk.end());
+        }
+        ASSERT_EQ(results, expected);
+    }
+}
+
+TEST(chunk_producer, stops_when_abandoned) {
+    Simulator sim(2);
+    auto compiled = leaky_circuit(sim);
+    ChunkProducer producer(compiled, 100 * SHOTS_PER_BLOCK, SHOTS_PER_BLOCK, ReadoutStrategy::RawLabel, 3);
+    std::vector<uint8_t> chunk(SHOTS_PER_BLOCK * 2);
+    producer.next(chunk.data());
+    // Destroying the producer with chunks left must not wait for them to be consumed.
+}
+
+TEST(chunk_producer, rethrows_sampling_errors) {
+    Simulator sim(2);
+    auto compiled = compile_circuit(stim::Circuit("M 0"), sim.bound_leaky_channels);
+    ChunkProducer producer(compiled, 10, 10, (ReadoutStrategy)7, 3);
+    std::vector<uint8_t> chunk(10);
+    ASSERT_THROW(producer.next(chunk.data()), std::invalid_argument);
+}
+
+TEST(chunk_producer, consumes_chunks_without_measurements) {
+    Simulator sim(2);
+    auto compiled = compile_circuit(stim::Circuit("H 0\nCX 0 1"), sim.bound_leaky_channels);
+    ChunkProducer producer(compiled, 3 * SHOTS_PER_BLOCK + 1, SHOTS_PER_BLOCK, ReadoutStrategy::RawLabel, 3);
+    size_t num_chunks = 0;
+    size_t num_shots = 0;
+    while (size_t n = producer.next_chunk_shots()) {
+        producer.next(nullptr);
+        num_chunks++;
+        num_shots += n;
+    }
+    ASSERT_EQ(num_chunks, 4);
+    ASSERT_EQ(num_shots, 3 * SHOTS_PER_BLOCK + 1);
+}
@@ -0,0 +1,192 @@
+#include "leaky/core/compiled_circuit.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "stim.h"
+
+static size_t count_deterministic_prefix(const leaky::CompiledCircuit &compiled) {
+    std::vector<bool> touched(compiled.num_qubits, false);
+    const auto &operations = compiled.circuit.operations;
+    const auto &channel_offsets = compiled.blocks[0].channel_offsets;
+    for (size_t k = 0; k < operations.size(); k++) {
+        const auto &op = operations[k];
+        if (op.gate_type == stim::GateType::REPEAT) {
+            return k;
+        }
+        auto flags = stim::GATE_DATA[op.gate_type].flags;
+        if (flags & stim::GATE_HAS_NO_EFFECT_ON_QUBITS) {
+            continue;
+        }
+        bool has_bound_channels = channel_offsets[k] != channel_offsets[k + 1];
+        bool all_qubit_targets = std::all_of(op.targets.begin(), op.targets.end(), [](const stim::GateTarget &t) {
+            return t.is_qubit_target();
+        });
+        if ((flags & stim::GATE_IS_UNITARY) && !has_bound_channels && all_qubit_targets) {
+            for (const auto &t : op.targets) {
+                touched[t.qubit_value()] = true;
+            }
+            continue;
+        }
+        // Resetting a qubit still in |0> neither changes the state nor draws a random number.
+        if (op.gate_type == stim::GateType::R &&
+            std::none_of(op.targets.begin(), op.targets.end(), [&touched](const stim::GateTarget &t) {
+                return touched[t.qubit_value()];
+            })) {
+            continue;
+        }
+        return k;
+    }
+    return operations.size();
+}
+
+/// Resolve the channels of `body` into `compiled.blocks[block_index]`, and its `REPEAT` bodies after it.
+static void compile_block(
+    const stim::Circuit &body,
+    size_t block_index,
+    const leaky::BoundChannelMap &bound_leaky_channels,
+    std::vector<uint32_t> &channel_indices,
+    leaky::CompiledCircuit &compiled) {
+    leaky::CompiledBlock block{{}, {0}, {}, {}, 0, false};
+    block.bodies.resize(body.operations.size(), 0);
+    block.interleaved.resize(body.operations.size(), false);
+    for (size_t k = 0; k < body.operations.size(); k++) {
+        const auto &op = body.operations[k];
+        auto flags = stim::GATE_DATA[op.gate_type].flags;
+        if (op.gate_type == stim::GateType::REPEAT) {
+            auto inner_index = compiled.blocks.size();
+            compiled.blocks.emplace_back();
+            compile_block(op.repeat_block_body(body), inner_index, bound_leaky_channels, channel_indices, compiled);
+            const auto &inner_block = compiled.blocks[inner_index];
+            block.bodies[k] = (uint32_t)inner_index;
+            block.num_measurements += inner_block.num_measurements * op.repeat_block_rep_count();
+            block.has_annotations |= inner_block.has_annotations;
+        } else if (op.gate_type == stim::GateType::DETECTOR || op.gate_type == stim::GateType::OBSERVABLE_INCLUDE) {
+            block.has_annotations = true;
+        } else {
+            block.num_measurements += op.count_measurement_results();
+        }
+        if (!bound_leaky_channels.empty() && (flags & stim::GATE_IS_UNITARY)) {
+            size_t step = (flags & stim::GATE_IS_SINGLE_QUBIT_GATE) ? 1 : 2;
+            for (size_t i = 0; i < op.targets.size(); i += step) {
+                auto key = leaky::make_binding_key(op.gate_type, op.targets.sub(i, i + step), op.args);
+                auto index = bound_leaky_channels.find(key);
+                if (index == leaky::BoundChannelMap::NOT_FOUND) {
+                    continue;
+                }
+                if (channel_indices[index] == leaky::BoundChannelMap::NOT_FOUND) {
+                    channel_indices[index] = (uint32_t)compiled.channels.size();
+                    compiled.channels.push_back(bound_leaky_channels.channels[index]);
+                    compiled.channel_keys.push_back(key);
+                }
+                block.channels.push_back({(uint32_t)i, (uint32_t)(i + step), channel_indices[index]});
+            }
+            bool has_bound_channels = block.channel_offsets.back() != block.channels.size();
+            block.interleaved[k] = has_bound_channels && leaky::has_shared_target_qubits(op.targets);
+        }
+        block.channel_offsets.push_back(block.channels.size());
+    }
+    compiled.blocks[block_index] = std::move(block);
+}
+
+/// Resolve the measurement record targets of the annotations of `body`, run `repeats` times.
+static void resolve_annotations(
+    const stim::Circuit &body,
+    const leaky::CompiledBlock &block,
+    uint64_t repeats,
+    leaky::CompiledCircuit &compiled,
+    uint64_t &num_measurements,
+    std::vector<std::vector<uint64_t>> &observables) {
+    if (!block.has_annotations) {
+        num_measurements += block.num_measurements * repeats;
+        return;
+    }
+    auto to_measurement_index = [&num_measurements](stim::GateTarget target) {
+        if ((uint64_t)-target.rec_offset() > num_measurements) {
+            throw std::invalid_argument("A measurement record target looks back before the first measurement.");
+        }
+        return num_measurements + target.rec_offset();
+    };
+    for (uint64_t r = 0; r < repeats; r++) {
+        for (size_t k = 0; k < body.operations.size(); k++) {
+            const auto &op = body.operations[k];
+            if (op.gate_type == stim::GateType::REPEAT) {
+                resolve_annotations(
+                    op.repeat_block_body(body),
+                    compiled.blocks[block.bodies[k]],
+                    op.repeat_block_rep_count(),
+                    compiled,
+                    num_measurements,
+                    observables);
+            } else if (op.gate_type == stim::GateType::DETECTOR) {
+                for (const auto &target : op.targets) {
+                    if (target.is_measurement_record_target()) {
+                        compiled.detector_measurements.push_back(to_measurement_index(target));
+                    }
+                }
+                compiled.detector_offsets.push_back(compiled.detector_measurements.size());
+            } else if (op.gate_type == stim::GateType::OBSERVABLE_INCLUDE) {
+                auto index = (size_t)op.args[0];
+                if (index >= observables.size()) {
+                    observables.resize(index + 1);
+                }
+                for (const auto &target : op.targets) {
+                    if (target.is_measurement_record_target()) {
+                        observables[index].push_back(to_measurement_index(target));
+                    }
+                }
+            } else {
+                num_measurements += op.count_measurement_results();
+            }
+        }
+    }
+}
+
+leaky::CompiledCircuit leaky::compile_circuit(
+    stim::Circuit circuit, const leaky::BoundChannelMap &bound_leaky_channels) {
+    CompiledCircuit compiled{std::move(circuit), {}, {}, {}, 0, 0, 0, 0, 0, {0}, {}, {0}, {}};
+    compiled.num_qubits = compiled.circuit.count_qubits();
+    compiled.blocks.emplace_back();
+    std::vector<uint32_t> channel_indices(bound_leaky_channels.size(), leaky::BoundChannelMap::NOT_FOUND);
+    compile_block(compiled.circuit, 0, bound_leaky_channels, channel_indices, compiled);
+    std::vector<std::vector<uint64_t>> observables;
+    uint64_t num_measurements = 0;
+    resolve_annotations(compiled.circuit, compiled.blocks[0], 1, compiled, num_measurements, observables);
+    compiled.num_measurements = num_measurements;
+    compiled.num_prefix_operations = count_deterministic_prefix(compiled);
+    compiled.num_detectors = compiled.detector_offsets.size() - 1;
+    compiled.num_observables = observables.size();
+    for (const auto &observable : observables) {
+        compiled.observable_measurements.insert(
+            compiled.observable_measurements.end(), observable.begin(), observable.end());
+        compiled.observable_offsets.push_back(compiled.observable_measurements.size());
+    }
+    return compiled;
+}
+
+leaky::CompiledCircuit leaky::with_leakage_bias(CompiledCircuit compiled_circuit, double leakage_bias) {
+    for (auto &channel : compiled_circuit.channels) {
+        channel = channel.with_leakage_bias(leakage_bias);
+    }
+    return compiled_circuit;
+}
+
+leaky::CompiledCircuit leaky::with_bound_channels(
+    CompiledCircuit compiled_circuit, const BoundChannelMap &bound_leaky_channels) {
+    size_t num_rebound = 0;
+    for (size_t c = 0; c < compiled_circuit.channels.size(); c++) {
+        uint32_t index = bound_leaky_channels.find(compiled_circuit.channel_keys[c]);
+        if (index != BoundChannelMap::NOT_FOUND) {
+            compiled_circuit.channels[c] = bound_leaky_channels.channels[index];
+            num_rebound++;
+        }
+    }
+    if (num_rebound != bound_leaky_channels.size()) {
+        throw std::invalid_argument("Only the instructions bound with a channel when compiling can be rebound.");
+    }
+    return compiled_circuit;
+}
@@ -0,0 +1,174 @@
+#ifndef LEAKY_COMPILED_CIRCUIT_H
+#define LEAKY_COMPILED_CIRCUIT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel.h"
+#include "stim.h"
+
+namespace leaky {
+
+/// The leaky channel `CompiledCircuit::channels[channel]` applied to `targets[target_begin:target_end]`
+/// of an instruction.
+struct BoundChannelRef {
+    uint32_t target_begin;
+    uint32_t target_end;
+    uint32_t channel;
+};
+
+/**
+ * @brief The resolved channels of a circuit, or of the body of one of its `REPEAT` blocks.
+ *
+ * A body is resolved once however many times it repeats, since its bindings are the same in
+ * every iteration.
+ */
+struct CompiledBlock {
+    /// The channels following `operations[k]` are `channels[channel_offsets[k]:channel_offsets[k + 1]]`.
+    std::vector<BoundChannelRef> channels;
+    std::vector<size_t> channel_offsets;
+    /// If `operations[k]` is a `REPEAT` block, its body is compiled into `CompiledCircuit::blocks[bodies[k]]`.
+    std::vector<uint32_t> bodies;
+    /// Whether `operations[k]` has channels and target groups sharing a qubit, see `has_shared_target_qubits`.
+    std::vector<bool> interleaved;
+    /// The measurements of a single run of the block, and whether it contains detectors or observables.
+    uint64_t num_measurements;
+    bool has_annotations;
+};
+
+/**
+ * @brief A circuit whose bound leaky channels have been looked up once.
+ *
+ * `REPEAT` blocks are kept as they are, so the size of the compiled circuit scales with the
+ * circuit text rather than with the number of executed instructions.
+ *
+ * The channels used by the circuit are copied out of the `BoundChannelMap` they were resolved
+ * from into `channels`, so the compiled circuit does not depend on the map and its hot channels
+ * are packed together however many other bindings the map holds.
+ */
+struct CompiledCircuit {
+    stim::Circuit circuit;
+    /// The distinct channels bound to the instructions of `circuit`, in order of first use, and
+    /// the binding each of them was resolved from.
+    std::vector<LeakyPauliChannel> channels;
+    std::vector<BindingKey> channel_keys;
+    /// `blocks[0]` is `circuit` itself, the others are the bodies of its `REPEAT` blocks.
+    std::vector<CompiledBlock> blocks;
+    uint32_t num_qubits;
+    uint64_t num_measurements;
+    /// The leading top-level operations that take a cleared simulator to the same state in every
+    /// shot, without drawing any random number: annotations, unitary gates without bound channels
+    /// and Z-basis resets of qubits no gate has touched yet.
+    size_t num_prefix_operations;
+    uint64_t num_detectors;
+    uint64_t num_observables;
+    /// The absolute indices of the measurements of detector `d` are
+    /// `detector_measurements[detector_offsets[d]:detector_offsets[d + 1]]`.
+    std::vector<uint64_t> detector_offsets;
+    std::vector<uint64_t> detector_measurements;
+    /// Likewise for the measurements included in observable `k`.
+    std::vector<uint64_t> observable_offsets;
+    std::vector<uint64_t> observable_measurements;
+
+    /**
+     * @brief Call `callback(op, channels)` on every executed instruction, in order.
+     *
+     * Only the top-level operations `[first_operation, end_operation)` are visited, each `REPEAT`
+     * block among them being expanded into its iterations. `channels` is a
+     * `stim::SpanRef<const BoundChannelRef>` of the channels following `op`.
+     *
+     * An interleaved instruction is visited in pieces, each ending with a target group that has a
+     * channel, so its groups and their channels alternate like in `Simulator::do_gate`.
+     */
+    template <typename CALLBACK>
+    void for_each_operation(CALLBACK &&callback, size_t first_operation = 0, size_t end_operation = SIZE_MAX) const {
+        for_each_operation_in_block(circuit, blocks[0], callback, first_operation, end_operation);
+    }
+
+   private:
+    template <typename CALLBACK>
+    void for_each_operation_in_block(
+        const stim::Circuit &body,
+        const CompiledBlock &block,
+        CALLBACK &callback,
+        size_t first_operation,
+        size_t end_operation) const {
+        const auto &operations = body.operations;
+        end_operation = std::min(end_operation, operations.size());
+        for (size_t k = first_operation; k < end_operation; k++) {
+            const auto &op = operations[k];
+            if (op.gate_type == stim::GateType::REPEAT) {
+                const auto &inner_body = op.repeat_block_body(body);
+                const auto &inner_block = blocks[block.bodies[k]];
+                uint64_t repeats = op.repeat_block_rep_count();
+                for (uint64_t r = 0; r < repeats; r++) {
+                    for_each_operation_in_block(inner_body, inner_block, callback, 0, SIZE_MAX);
+                }
+                continue;
+            }
+            const BoundChannelRef *channels = block.channels.data();
+            const BoundChannelRef *refs_begin = channels + block.channel_offsets[k];
+            const BoundChannelRef *refs_end = channels + block.channel_offsets[k + 1];
+            if (block.interleaved[k]) {
+                for_each_piece(op, refs_begin, refs_end, callback);
+            } else {
+                callback(op, stim::SpanRef<const BoundChannelRef>(refs_begin, refs_end));
+            }
+        }
+    }
+
+    /// Call `callback` on the pieces of an interleaved instruction, see `for_each_operation`.
+    template <typename CALLBACK>
+    static void for_each_piece(
+        const stim::CircuitInstruction &op,
+        const BoundChannelRef *refs_begin,
+        const BoundChannelRef *refs_end,
+        CALLBACK &callback) {
+        uint32_t piece_begin = 0;
+        for (const BoundChannelRef *ref = refs_begin; ref != refs_end; ref++) {
+            // The channel of the last group of the piece, relative to the piece.
+            BoundChannelRef piece_ref{ref->target_begin - piece_begin, ref->target_end - piece_begin, ref->channel};
+            callback(
+                stim::CircuitInstruction{op.gate_type, op.args, op.targets.sub(piece_begin, ref->target_end)},
+                stim::SpanRef<const BoundChannelRef>(&piece_ref, &piece_ref + 1));
+            piece_begin = ref->target_end;
+        }
+        if (piece_begin < op.targets.size()) {
+            callback(
+                stim::CircuitInstruction{op.gate_type, op.args, op.targets.sub(piece_begin, op.targets.size())},
+                stim::SpanRef<const BoundChannelRef>(refs_end, refs_end));
+        }
+    }
+};
+
+/**
+ * @brief Resolve the channels bound to each instruction of a circuit, which is moved into the result.
+ *
+ * The measurement record targets of the `DETECTOR` and `OBSERVABLE_INCLUDE` annotations are
+ * resolved into absolute measurement indices along the way.
+ */
+CompiledCircuit compile_circuit(stim::Circuit circuit, const BoundChannelMap &bound_leaky_channels);
+
+/**
+ * @brief Replace the channels of a compiled circuit by their `LeakyPauliChannel::with_leakage_bias` copies.
+ *
+ * Sampling the result draws leaking trajectories more often, and the simulators multiply the
+ * likelihood ratios of the sampled transitions into per-shot weights that undo the bias.
+ */
+CompiledCircuit with_leakage_bias(CompiledCircuit compiled_circuit, double leakage_bias);
+
+/**
+ * @brief Replace the channels of a compiled circuit by those bound to the same instructions in `bound_leaky_channels`.
+ *
+ * The instructions without a binding in `bound_leaky_channels` keep their channels, so only the
+ * structure compiled once is reused and nothing is parsed or resolved again. Every binding must
+ * rebind an instruction that had a channel when compiling.
+ */
+CompiledCircuit with_bound_channels(CompiledCircuit compiled_circuit, const BoundChannelMap &bound_leaky_channels);
+
+}  // namespace leaky
+
+#endif  // LEAKY_COMPILED_CIRCUIT_H
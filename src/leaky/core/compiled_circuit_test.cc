@@ -0,0 +1,167 @@
+#include "leaky/core/compiled_circuit.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+TEST(compiled_circuit, binding_key) {
+    std::vector<stim::GateTarget> t01{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    std::vector<stim::GateTarget> t10{stim::GateTarget::qubit(1), stim::GateTarget::qubit(0)};
+    auto key = make_binding_key(stim::GateType::CX, t01, {});
+    ASSERT_EQ(key, make_binding_key(stim::GateType::CX, t01, {}));
+    ASSERT_EQ(BindingKeyHash{}(key), BindingKeyHash{}(make_binding_key(stim::GateType::CX, t01, {})));
+    ASSERT_NE(key, make_binding_key(stim::GateType::CX, t10, {}));
+    ASSERT_NE(key, make_binding_key(stim::GateType::CZ, t01, {}));
+    ASSERT_EQ(key.str(), "CX 0 1");
+    std::vector<stim::GateTarget> t012{t01[0], t01[1], t10[0]};
+    ASSERT_THROW(make_binding_key(stim::GateType::CX, t012, {}), std::invalid_argument);
+}
+
+TEST(compiled_circuit, bind_splits_target_groups) {
+    Simulator sim(3);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(2)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    ASSERT_EQ(sim.bound_leaky_channels.size(), 2);
+    auto circuit = stim::Circuit("H 2\nM 2");
+    sim.do_circuit(circuit);
+    ASSERT_EQ(sim.current_measurement_record(), std::vector<uint8_t>{2});
+}
+
+TEST(compiled_circuit, compile_circuit) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("REPEAT 2 {\nH 0 1\nTICK\n}\nM 0 1"), sim.bound_leaky_channels);
+    ASSERT_EQ(compiled.circuit.operations.size(), 2);
+    ASSERT_EQ(compiled.num_qubits, 2);
+    ASSERT_EQ(compiled.num_measurements, 2);
+    ASSERT_EQ(compiled.blocks.size(), 2);
+    ASSERT_EQ(compiled.blocks[0].channel_offsets, (std::vector<size_t>{0, 0, 0}));
+    ASSERT_EQ(compiled.blocks[0].bodies[0], 1);
+    ASSERT_EQ(compiled.blocks[1].channel_offsets, (std::vector<size_t>{0, 1, 1}));
+    ASSERT_EQ(compiled.blocks[1].channels[0].target_begin, 1);
+    ASSERT_EQ(compiled.blocks[1].channels[0].target_end, 2);
+    ASSERT_EQ(compiled.channels.size(), 1);
+    ASSERT_EQ(compiled.blocks[1].channels[0].channel, 0);
+    ASSERT_EQ(compiled.channels[0].str(), channel.str());
+    size_t num_executed = 0;
+    size_t num_channels = 0;
+    compiled.for_each_operation([&](const stim::CircuitInstruction &op, stim::SpanRef<const BoundChannelRef> channels) {
+        num_executed++;
+        num_channels += channels.size();
+    });
+    ASSERT_EQ(num_executed, 5);
+    ASSERT_EQ(num_channels, 2);
+
+    sim.clear();
+    sim.do_compiled_circuit(compiled);
+    auto record = sim.current_measurement_record();
+    ASSERT_EQ(record[1], 2);
+}
+
+TEST(compiled_circuit, deterministic_prefix) {
+    ASSERT_EQ(compile_circuit(stim::Circuit("R 0 1\nH 0\nR 1\nTICK\nR 0\nM 0"), {}).num_prefix_operations, 4);
+    ASSERT_EQ(compile_circuit(stim::Circuit("M 0\nH 0"), {}).num_prefix_operations, 0);
+
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("H 0\nH 1\nM 0 1"), sim.bound_leaky_channels);
+    ASSERT_EQ(compiled.num_prefix_operations, 1);
+}
+
+TEST(compiled_circuit, repeat_blocks_are_not_flattened) {
+    auto circuit = stim::Circuit(R"CIRCUIT(
+        R 0 1
+        REPEAT 100000 {
+            CX 0 1
+            REPEAT 3 {
+                M 1
+            }
+            DETECTOR rec[-1] rec[-2]
+        }
+    )CIRCUIT");
+    auto compiled = compile_circuit(circuit, {});
+    ASSERT_EQ(compiled.blocks.size(), 3);
+    ASSERT_EQ(compiled.blocks[1].num_measurements, 3);
+    ASSERT_EQ(compiled.num_measurements, 300000);
+    ASSERT_EQ(compiled.num_detectors, 100000);
+    ASSERT_EQ(compiled.num_prefix_operations, 1);
+    ASSERT_EQ(compiled.detector_measurements[2], 5);
+    ASSERT_EQ(compiled.detector_measurements[3], 4);
+}
+
+TEST(compiled_circuit, detectors_and_observables) {
+    auto circuit = stim::Circuit(R"CIRCUIT(
+        M 0 1
+        DETECTOR rec[-1] rec[-2]
+        REPEAT 2 {
+            M 1
+            DETECTOR rec[-1] rec[-2]
+        }
+        OBSERVABLE_INCLUDE(1) rec[-1]
+        OBSERVABLE_INCLUDE(1) rec[-4]
+    )CIRCUIT");
+    auto compiled = compile_circuit(circuit, {});
+    ASSERT_EQ(compiled.num_measurements, 4);
+    ASSERT_EQ(compiled.num_detectors, 3);
+    ASSERT_EQ(compiled.detector_offsets, (std::vector<uint64_t>{0, 2, 4, 6}));
+    ASSERT_EQ(compiled.detector_measurements, (std::vector<uint64_t>{1, 0, 2, 1, 3, 2}));
+    ASSERT_EQ(compiled.num_observables, 2);
+    ASSERT_EQ(compiled.observable_offsets, (std::vector<uint64_t>{0, 0, 2}));
+    ASSERT_EQ(compiled.observable_measurements, (std::vector<uint64_t>{3, 0}));
+}
+
+TEST(compiled_circuit, with_bound_channels) {
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    LeakyPauliChannel other(true);
+    other.add_transition(0, 0, 1, 1);
+    BoundChannelMap bindings;
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    bind_leaky_channel(bindings, {stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nM 0 1"), bindings);
+
+    BoundChannelMap variant;
+    bind_leaky_channel(variant, {stim::GateType::X, {}, {targets.data() + 1, targets.data() + 2}}, other);
+    auto rebound = with_bound_channels(compiled, variant);
+    ASSERT_EQ(rebound.channel_keys, compiled.channel_keys);
+    ASSERT_EQ(rebound.channels[0].get_prob_from_to(0, 1, 0), 1);
+    ASSERT_EQ(rebound.channels[1].get_prob_from_to(0, 0, 1), 1);
+    ASSERT_TRUE(rebound.channels[1].is_frozen);
+
+    bind_leaky_channel(variant, {stim::GateType::H, {}, targets}, other);
+    ASSERT_THROW(with_bound_channels(compiled, variant), std::invalid_argument);
+}
+
+TEST(compiled_circuit, interleaves_channels_between_shared_target_qubits) {
+    // The channel of `CX 0 1` leaks qubit 1 before `CX 1 2` acts on it.
+    Simulator sim(3);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x01, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+    auto circuit = stim::Circuit("X 1\nCX 0 1 1 2\nM 1 2");
+    auto compiled = compile_circuit(circuit, sim.bound_leaky_channels);
+    ASSERT_EQ(compiled.blocks[0].interleaved, (std::vector<bool>{false, true, false}));
+
+    sim.do_circuit(circuit);
+    auto expected = sim.current_measurement_record();
+    ASSERT_EQ(expected, (std::vector<uint8_t>{2, 0}));
+    sim.clear();
+    sim.do_compiled_circuit(compiled);
+    ASSERT_EQ(sim.current_measurement_record(), expected);
+}
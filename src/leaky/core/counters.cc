@@ -0,0 +1,37 @@
+#include "leaky/core/counters.h"
+
+#include <cstddef>
+
+leaky::SimulatorCounters::SimulatorCounters()
+    : num_shots(0),
+      channel_samples(),
+      transitions{},
+      leaked_qubits_per_layer(0),
+      current_layer(0),
+      tableau_seconds(0),
+      channel_seconds(0),
+      readout_seconds(0) {
+}
+
+void leaky::SimulatorCounters::clear() {
+    *this = SimulatorCounters();
+}
+
+void leaky::SimulatorCounters::merge(const leaky::SimulatorCounters &other) {
+    num_shots += other.num_shots;
+    for (const auto &[key, count] : other.channel_samples) {
+        channel_samples[key] += count;
+    }
+    for (size_t k = 0; k < transitions.size(); k++) {
+        transitions[k] += other.transitions[k];
+    }
+    if (leaked_qubits_per_layer.size() < other.leaked_qubits_per_layer.size()) {
+        leaked_qubits_per_layer.resize(other.leaked_qubits_per_layer.size(), 0);
+    }
+    for (size_t k = 0; k < other.leaked_qubits_per_layer.size(); k++) {
+        leaked_qubits_per_layer[k] += other.leaked_qubits_per_layer[k];
+    }
+    tableau_seconds += other.tableau_seconds;
+    channel_seconds += other.channel_seconds;
+    readout_seconds += other.readout_seconds;
+}
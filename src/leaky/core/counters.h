@@ -0,0 +1,90 @@
+#ifndef LEAKY_COUNTERS_H
+#define LEAKY_COUNTERS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "leaky/core/binding.h"
+
+/// `LEAKY_COUNT(statement)` only compiles `statement` in builds configured with `LEAKY_ENABLE_COUNTERS`,
+/// so the counters cost nothing otherwise.
+#ifdef LEAKY_COUNTERS
+#define LEAKY_COUNT(...) __VA_ARGS__
+#else
+#define LEAKY_COUNT(...)
+#endif
+
+namespace leaky {
+
+/// Whether this build records the instrumentation counters.
+#ifdef LEAKY_COUNTERS
+constexpr bool COUNTERS_ENABLED = true;
+#else
+constexpr bool COUNTERS_ENABLED = false;
+#endif
+
+/**
+ * @brief Instrumentation counters of a `Simulator`, accumulated over every shot it simulates.
+ *
+ * They stay zero unless the library is built with `LEAKY_ENABLE_COUNTERS`.
+ */
+struct SimulatorCounters {
+    /// The number of shots sampled by the samplers.
+    uint64_t num_shots;
+    /// The number of times the channel bound to each binding was applied to its targets.
+    std::unordered_map<BindingKey, uint64_t, BindingKeyHash> channel_samples;
+    /// The number of single-qubit transitions of each `TransitionType`.
+    std::array<uint64_t, 4> transitions;
+    /// `leaked_qubits_per_layer[k]` sums the number of leaked qubits at the `k`-th `TICK` of each shot.
+    std::vector<uint64_t> leaked_qubits_per_layer;
+    /// The number of `TICK`s met so far in the current shot.
+    uint32_t current_layer;
+    /// Time spent in the stim tableau simulator, in the leaky channels and in the readout.
+    double tableau_seconds;
+    double channel_seconds;
+    double readout_seconds;
+
+    SimulatorCounters();
+    void clear();
+    /// Add the counts of another simulator, for instance a sampling worker.
+    void merge(const SimulatorCounters &other);
+    inline void record_layer(uint32_t num_leaked_qubits) {
+        if (current_layer >= leaked_qubits_per_layer.size()) {
+            leaked_qubits_per_layer.resize(current_layer + 1, 0);
+        }
+        leaked_qubits_per_layer[current_layer++] += num_leaked_qubits;
+    }
+};
+
+/// Adds the time until its destruction to `seconds`, minus the time added to `nested_seconds`
+/// meanwhile, if given, so nested timers are not counted twice.
+struct ScopedTimer {
+    double &seconds;
+    const double *nested_seconds;
+    double nested_start;
+    std::chrono::steady_clock::time_point start;
+
+    explicit ScopedTimer(double &seconds, const double *nested_seconds = nullptr)
+        : seconds(seconds),
+          nested_seconds(nested_seconds),
+          nested_start(nested_seconds == nullptr ? 0 : *nested_seconds),
+          start(std::chrono::steady_clock::now()) {
+    }
+    ~ScopedTimer() {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (nested_seconds != nullptr) {
+            elapsed -= *nested_seconds - nested_start;
+        }
+        seconds += elapsed;
+    }
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+}  // namespace leaky
+
+#endif  // LEAKY_COUNTERS_H
@@ -0,0 +1,261 @@
+#include "leaky/core/decomposition.h"
+
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "leaky/core/channel.h"
+
+/// The Kraus-independent part of the decomposition of a transition between two leakage statuses.
+struct StatusPairPlan {
+    uint8_t initial_status;
+    uint8_t final_status;
+    /// `1 / 2 ** num_u` where `num_u` is the number of qubits leaking up.
+    double prefactor;
+    /// The number of qubits staying in the computational subspace.
+    uint8_t num_r;
+    /// The rows and columns of the Kraus operators selected by each pair of projectors.
+    std::vector<std::pair<std::vector<uint32_t>, std::vector<uint32_t>>> projections;
+    /// The X and Z masks and the channel index of the `i`-th Pauli on the qubits staying in the
+    /// computational subspace, in the order of `itertools.product(PAULIS, repeat=num_r)`.
+    std::vector<uint32_t> x_masks;
+    std::vector<uint32_t> z_masks;
+    std::vector<uint8_t> pauli_indices;
+};
+
+struct DecomposedTransition {
+    uint8_t initial_status;
+    uint8_t final_status;
+    uint8_t pauli_idx;
+    double probability;
+};
+
+typedef std::vector<std::vector<uint32_t>> LevelSets;
+
+/// The cartesian product of per-qubit choices, the first qubit varying the slowest.
+static std::vector<LevelSets> product(const std::vector<std::vector<std::vector<uint32_t>>> &choices) {
+    std::vector<LevelSets> result{{}};
+    for (const auto &qubit_choices : choices) {
+        std::vector<LevelSets> next;
+        for (const auto &prefix : result) {
+            for (const auto &levels : qubit_choices) {
+                next.push_back(prefix);
+                next.back().push_back(levels);
+            }
+        }
+        result = std::move(next);
+    }
+    return result;
+}
+
+/// The indices of the basis states whose level on each qubit is in the given set.
+static std::vector<uint32_t> projector_slice(const LevelSets &level_sets, uint32_t num_level) {
+    std::vector<uint32_t> slice{0};
+    for (const auto &levels : level_sets) {
+        std::vector<uint32_t> next;
+        for (auto index : slice) {
+            for (auto level : levels) {
+                next.push_back(index * num_level + level);
+            }
+        }
+        slice = std::move(next);
+    }
+    return slice;
+}
+
+static std::vector<uint32_t> project_status(uint32_t status) {
+    if (status == 0) {
+        return {0, 1};
+    }
+    return {status + 1};
+}
+
+static StatusPairPlan plan_status_pair(
+    const std::vector<uint32_t> &initial, const std::vector<uint32_t> &final, uint32_t num_level) {
+    size_t num_qubits = initial.size();
+    StatusPairPlan plan{0, 0, 1.0, 0, {}, {}, {}, {}};
+    std::vector<size_t> q_in_r;
+    std::vector<std::vector<std::vector<uint32_t>>> initial_choices;
+    std::vector<std::vector<std::vector<uint32_t>>> final_choices;
+    for (size_t q = 0; q < num_qubits; q++) {
+        plan.initial_status = (uint8_t)((plan.initial_status << 4) | initial[q]);
+        plan.final_status = (uint8_t)((plan.final_status << 4) | final[q]);
+        bool is_up = initial[q] == 0 && final[q] > 0;
+        bool is_down = initial[q] > 0 && final[q] == 0;
+        if (is_up) {
+            plan.prefactor /= 2;
+        }
+        if (initial[q] == 0 && final[q] == 0) {
+            q_in_r.push_back(q);
+        }
+        // A qubit leaking up (down) came from (ends in) either computational state.
+        initial_choices.push_back(is_up ? LevelSets{{0}, {1}} : LevelSets{project_status(initial[q])});
+        final_choices.push_back(is_down ? LevelSets{{0}, {1}} : LevelSets{project_status(final[q])});
+    }
+    plan.num_r = (uint8_t)q_in_r.size();
+    for (const auto &initial_levels : product(initial_choices)) {
+        for (const auto &final_levels : product(final_choices)) {
+            plan.projections.emplace_back(
+                projector_slice(final_levels, num_level), projector_slice(initial_levels, num_level));
+        }
+    }
+    uint32_t num_r = plan.num_r;
+    for (uint32_t i = 0; i < (1u << (2 * num_r)); i++) {
+        uint32_t x_mask = 0;
+        uint32_t z_mask = 0;
+        uint32_t pauli_idx = 0;
+        for (uint32_t j = 0; j < num_r; j++) {
+            // The Paulis in the order [I, X, Y, Z], the first qubit being the most significant.
+            uint32_t code = (i >> (2 * (num_r - j - 1))) & 0b11;
+            uint32_t bit = num_r - j - 1;
+            x_mask |= (uint32_t)(code == 1 || code == 2) << bit;
+            z_mask |= (uint32_t)(code == 2 || code == 3) << bit;
+            pauli_idx |= code << (2 * (num_qubits - q_in_r[j] - 1));
+        }
+        plan.x_masks.push_back(x_mask);
+        plan.z_masks.push_back(z_mask);
+        plan.pauli_indices.push_back((uint8_t)pauli_idx);
+    }
+    return plan;
+}
+
+/// In place Walsh-Hadamard transform: `v[z] <- sum_a v[a] * (-1) ** popcount(a & z)`.
+static void walsh_hadamard_transform(std::vector<std::complex<double>> &v) {
+    for (size_t h = 1; h < v.size(); h <<= 1) {
+        for (size_t i = 0; i < v.size(); i += h << 1) {
+            for (size_t j = i; j < i + h; j++) {
+                auto a = v[j];
+                auto b = v[j + h];
+                v[j] = a + b;
+                v[j + h] = a - b;
+            }
+        }
+    }
+}
+
+static void decompose_kraus_operator(
+    const std::complex<double> *kraus,
+    uint32_t dim,
+    const std::vector<StatusPairPlan> &plans,
+    std::vector<DecomposedTransition> &out) {
+    std::vector<std::complex<double>> shifted;
+    std::vector<double> probabilities;
+    std::vector<double> x_probabilities;
+    for (const auto &plan : plans) {
+        uint32_t sub_dim = 1u << plan.num_r;
+        for (const auto &[rows, cols] : plan.projections) {
+            probabilities.assign(plan.pauli_indices.size(), 0.0);
+            if (plan.num_r == 0) {
+                probabilities[0] = plan.prefactor * std::norm(kraus[rows[0] * dim + cols[0]]);
+            } else {
+                // tr(M P) for a Pauli P with masks (x, z) is, up to a phase, the sign-weighted sum
+                // of the diagonal shifted by x: sum_a M[a][a ^ x] * (-1) ** popcount(a & z).
+                shifted.resize(sub_dim);
+                x_probabilities.resize(sub_dim * sub_dim);
+                for (uint32_t x = 0; x < sub_dim; x++) {
+                    for (uint32_t a = 0; a < sub_dim; a++) {
+                        shifted[a] = kraus[rows[a] * dim + cols[a ^ x]];
+                    }
+                    walsh_hadamard_transform(shifted);
+                    for (uint32_t z = 0; z < sub_dim; z++) {
+                        double overlap = std::norm(shifted[z] / (double)sub_dim);
+                        x_probabilities[x * sub_dim + z] = plan.prefactor * overlap;
+                    }
+                }
+                for (size_t i = 0; i < probabilities.size(); i++) {
+                    probabilities[i] = x_probabilities[plan.x_masks[i] * sub_dim + plan.z_masks[i]];
+                }
+            }
+            double total = 0;
+            for (auto p : probabilities) {
+                total += p;
+            }
+            if (total < 1e-9) {
+                continue;
+            }
+            for (size_t i = 0; i < probabilities.size(); i++) {
+                if (probabilities[i] < 1e-9) {
+                    continue;
+                }
+                out.push_back({plan.initial_status, plan.final_status, plan.pauli_indices[i], probabilities[i]});
+            }
+        }
+    }
+}
+
+leaky::LeakyPauliChannel leaky::decompose_kraus_operators(
+    const std::complex<double> *kraus_operators,
+    size_t num_kraus_operators,
+    uint8_t num_qubits,
+    uint8_t num_level,
+    size_t num_threads) {
+    if (num_qubits != 1 && num_qubits != 2) {
+        throw std::invalid_argument("Only 1 or 2 qubits operators are supported.");
+    }
+    if (num_level < 2 || num_level > 17) {
+        throw std::invalid_argument("The number of levels must be between 2 and 17.");
+    }
+    uint32_t dim = num_qubits == 1 ? num_level : num_level * num_level;
+
+    std::vector<std::vector<uint32_t>> all_status;
+    for (uint32_t s0 = 0; s0 < (uint32_t)num_level - 1; s0++) {
+        if (num_qubits == 1) {
+            all_status.push_back({s0});
+            continue;
+        }
+        for (uint32_t s1 = 0; s1 < (uint32_t)num_level - 1; s1++) {
+            all_status.push_back({s0, s1});
+        }
+    }
+    std::vector<StatusPairPlan> plans;
+    for (const auto &initial : all_status) {
+        for (const auto &final : all_status) {
+            plans.push_back(plan_status_pair(initial, final, num_level));
+        }
+    }
+
+    if (num_threads == 0) {
+        num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    num_threads = std::max<size_t>(std::min(num_threads, num_kraus_operators), 1);
+    std::vector<std::vector<DecomposedTransition>> decomposed(num_kraus_operators);
+    std::vector<std::exception_ptr> errors(num_threads);
+    auto worker = [&](size_t thread_idx) {
+        try {
+            for (size_t k = thread_idx; k < num_kraus_operators; k += num_threads) {
+                decompose_kraus_operator(kraus_operators + k * dim * dim, dim, plans, decomposed[k]);
+            }
+        } catch (...) {
+            errors[thread_idx] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Added in the order of the Kraus operators, so the channel does not depend on `num_threads`.
+    LeakyPauliChannel channel(num_qubits == 1);
+    for (const auto &transitions : decomposed) {
+        for (const auto &t : transitions) {
+            channel.add_transition(t.initial_status, t.final_status, t.pauli_idx, t.probability);
+        }
+    }
+    return channel;
+}
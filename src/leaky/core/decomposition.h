@@ -0,0 +1,34 @@
+#ifndef LEAKY_DECOMPOSITION_H
+#define LEAKY_DECOMPOSITION_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+#include "leaky/core/channel.h"
+
+namespace leaky {
+
+/**
+ * @brief Decompose Kraus operators into a leaky Pauli channel with Generalized Pauli Twirling.
+ *
+ * This is the C++ counterpart of `leaky.utils.decompose_kraus_operators_to_leaky_pauli_channel`,
+ * adding the same transitions in the same order. The Pauli overlaps of each projected Kraus
+ * operator are computed with a Walsh-Hadamard transform of its Pauli-X-shifted diagonals rather
+ * than by forming Pauli matrices.
+ *
+ * @param kraus_operators `num_kraus_operators` row-major square matrices of dimension
+ *     `num_level ** num_qubits`, stored one after the other.
+ * @param num_threads The number of threads to decompose the operators with, 0 for all
+ *     hardware threads. The result does not depend on it.
+ */
+LeakyPauliChannel decompose_kraus_operators(
+    const std::complex<double> *kraus_operators,
+    size_t num_kraus_operators,
+    uint8_t num_qubits,
+    uint8_t num_level,
+    size_t num_threads = 1);
+
+}  // namespace leaky
+
+#endif  // LEAKY_DECOMPOSITION_H
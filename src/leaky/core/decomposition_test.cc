@@ -0,0 +1,86 @@
+#include "leaky/core/decomposition.h"
+
+#include <array>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/channel.h"
+
+using namespace leaky;
+
+typedef std::complex<double> cd;
+
+static const std::array<std::array<cd, 4>, 4> PAULIS = {{
+    {1, 0, 0, 1},
+    {0, 1, 1, 0},
+    {0, cd(0, -1), cd(0, 1), 0},
+    {1, 0, 0, -1},
+}};
+
+TEST(decomposition, single_qubit_pauli_channel) {
+    std::array<double, 4> probs{0.7, 0.1, 0.15, 0.05};
+    std::vector<cd> kraus;
+    for (size_t p = 0; p < 4; p++) {
+        for (auto v : PAULIS[p]) {
+            kraus.push_back(std::sqrt(probs[p]) * v);
+        }
+    }
+    auto channel = decompose_kraus_operators(kraus.data(), 4, 1, 2);
+    ASSERT_TRUE(channel.is_single_qubit_channel);
+    for (uint8_t p = 0; p < 4; p++) {
+        ASSERT_NEAR(channel.get_prob_from_to(0, 0, p), probs[p], 1e-12);
+    }
+    channel.safety_check();
+}
+
+TEST(decomposition, two_qubit_pauli) {
+    // X on the first qubit and Z on the second.
+    std::vector<cd> kraus(16);
+    for (size_t a = 0; a < 4; a++) {
+        for (size_t b = 0; b < 4; b++) {
+            kraus[a * 4 + b] = PAULIS[1][(a >> 1) * 2 + (b >> 1)] * PAULIS[3][(a & 1) * 2 + (b & 1)];
+        }
+    }
+    auto channel = decompose_kraus_operators(kraus.data(), 1, 2, 2);
+    ASSERT_FALSE(channel.is_single_qubit_channel);
+    ASSERT_EQ(channel.num_transitions(), 1);
+    ASSERT_NEAR(channel.get_prob_from_to(0x00, 0x00, (1 << 2) | 3), 1, 1e-12);
+}
+
+TEST(decomposition, leakage_rotation) {
+    // Rotate |1> into |2> by an angle theta.
+    double theta = 0.3;
+    double c = std::cos(theta);
+    double s = std::sin(theta);
+    std::vector<cd> kraus{1, 0, 0, 0, c, -s, 0, s, c};
+    auto channel = decompose_kraus_operators(kraus.data(), 1, 1, 3);
+    ASSERT_NEAR(channel.get_prob_from_to(0, 0, 0), (1 + c) * (1 + c) / 4, 1e-12);
+    ASSERT_NEAR(channel.get_prob_from_to(0, 0, 3), (1 - c) * (1 - c) / 4, 1e-12);
+    ASSERT_NEAR(channel.get_prob_from_to(0, 1, 0), s * s / 2, 1e-12);
+    ASSERT_NEAR(channel.get_prob_from_to(1, 0, 0), s * s, 1e-12);
+    ASSERT_NEAR(channel.get_prob_from_to(1, 1, 0), c * c, 1e-12);
+}
+
+TEST(decomposition, independent_of_num_threads) {
+    std::mt19937_64 rng(0);
+    std::normal_distribution<double> normal;
+    std::vector<cd> kraus(5 * 81);
+    for (auto &v : kraus) {
+        v = cd(normal(rng), normal(rng)) * 0.05;
+    }
+    auto expected = decompose_kraus_operators(kraus.data(), 5, 2, 3, 1);
+    ASSERT_GT(expected.num_transitions(), 0);
+    auto multi_threaded = decompose_kraus_operators(kraus.data(), 5, 2, 3, 4);
+    ASSERT_EQ(multi_threaded.str(), expected.str());
+    ASSERT_EQ(multi_threaded.cumulative_probs, expected.cumulative_probs);
+}
+
+TEST(decomposition, invalid_arguments) {
+    std::vector<cd> kraus(64);
+    ASSERT_THROW(decompose_kraus_operators(kraus.data(), 1, 3, 2), std::invalid_argument);
+    ASSERT_THROW(decompose_kraus_operators(kraus.data(), 1, 1, 1), std::invalid_argument);
+}
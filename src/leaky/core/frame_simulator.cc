@@ -0,0 +1,287 @@
+#include "leaky/core/frame_simulator.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/rand_gen.h"
+#include "leaky/core/readout_strategy.h"
+#include "stim.h"
+
+// Frame bits flipped by the Paulis in the order [I, X, Y, Z].
+static constexpr bool PAULI_HAS_X[4] = {false, true, true, false};
+static constexpr bool PAULI_HAS_Z[4] = {false, false, true, true};
+
+leaky::LeakyFrameSimulator::LeakyFrameSimulator(
+    const stim::CircuitStats &circuit_stats, size_t batch_size, uint64_t seed, bool sparse_leakage)
+    : num_qubits(circuit_stats.num_qubits),
+      batch_size(batch_size),
+      sparse_leakage(sparse_leakage),
+      leakage_status(sparse_leakage ? 0 : circuit_stats.num_qubits * batch_size, 0),
+      sparse_leakage_status(),
+      leaked_mask(circuit_stats.num_qubits, batch_size),
+      leakage_masks_record(0),
+      shot_weights(batch_size, 1.0),
+      frame_simulator(
+          circuit_stats,
+          stim::FrameSimulatorMode::STORE_MEASUREMENTS_TO_MEMORY,
+          batch_size,
+          std::mt19937_64(leaky::splitmix64(seed))),
+      rng(seed),
+      scratch(batch_size) {
+    frame_simulator.reset_all();
+}
+
+void leaky::LeakyFrameSimulator::set_seed(uint64_t seed) {
+    rng.seed(seed);
+    frame_simulator.rng.seed(leaky::splitmix64(seed));
+}
+
+bool leaky::LeakyFrameSimulator::is_leaked_in_any_shot(stim::GateTarget target) const {
+    return target.is_qubit_target() && leaked_mask[target.qubit_value()].not_zero();
+}
+
+/// Call `callback(shot)` on every shot whose bit is set in `bits`, in increasing order.
+template <typename CALLBACK>
+static void for_each_set_bit(const stim::simd_bits_range_ref<stim::MAX_BITWORD_WIDTH> bits, CALLBACK callback) {
+    for (size_t w = 0; w < bits.num_u64_padded(); w++) {
+        for (uint64_t word = bits.u64[w]; word != 0; word &= word - 1) {
+            callback(w * 64 + std::countr_zero(word));
+        }
+    }
+}
+
+uint8_t leaky::LeakyFrameSimulator::get_leakage_status(uint32_t qubit, size_t shot) const {
+    if (!sparse_leakage) {
+        return leakage_status[qubit * batch_size + shot];
+    }
+    if (!leaked_mask[qubit][shot]) {
+        return 0;
+    }
+    return sparse_leakage_status.find(qubit * batch_size + shot)->second;
+}
+
+void leaky::LeakyFrameSimulator::set_leakage_status(uint32_t qubit, size_t shot, uint8_t status) {
+    if (!sparse_leakage) {
+        leakage_status[qubit * batch_size + shot] = status;
+    } else if (status != 0) {
+        sparse_leakage_status[qubit * batch_size + shot] = status;
+    } else if (leaked_mask[qubit][shot]) {
+        sparse_leakage_status.erase(qubit * batch_size + shot);
+    }
+    leaked_mask[qubit][shot] = status != 0;
+}
+
+void leaky::LeakyFrameSimulator::reset_leakage_status(uint32_t qubit) {
+    if (!sparse_leakage) {
+        std::fill_n(leakage_status.begin() + qubit * batch_size, batch_size, 0);
+    } else {
+        for_each_set_bit(leaked_mask[qubit], [&](size_t shot) {
+            sparse_leakage_status.erase(qubit * batch_size + shot);
+        });
+    }
+    leaked_mask[qubit].clear();
+}
+
+void leaky::LeakyFrameSimulator::randomize_leaked_frame(uint32_t qubit) {
+    auto mask = leaked_mask[qubit];
+    for (size_t k = 0; k < scratch.num_u64_padded(); k++) {
+        scratch.u64[k] = rng();
+    }
+    scratch &= mask;
+    frame_simulator.x_table[qubit] ^= scratch;
+    for (size_t k = 0; k < scratch.num_u64_padded(); k++) {
+        scratch.u64[k] = rng();
+    }
+    scratch &= mask;
+    frame_simulator.z_table[qubit] ^= scratch;
+}
+
+void leaky::LeakyFrameSimulator::handle_transition(
+    uint8_t cur_status, uint8_t next_status, uint32_t qubit, size_t shot, uint8_t pauli_idx) {
+    switch (leaky::get_transition_type(cur_status, next_status)) {
+        case leaky::TransitionType::R:
+            frame_simulator.x_table[qubit][shot] ^= PAULI_HAS_X[pauli_idx];
+            frame_simulator.z_table[qubit][shot] ^= PAULI_HAS_Z[pauli_idx];
+            return;
+        case leaky::TransitionType::L:
+            return;
+        case leaky::TransitionType::U:
+            frame_simulator.x_table[qubit][shot] ^= (bool)(rng() >> 63);
+            return;
+        case leaky::TransitionType::D: {
+            auto r = rng();
+            frame_simulator.x_table[qubit][shot] ^= (bool)(r >> 63);
+            frame_simulator.z_table[qubit][shot] ^= (bool)((r >> 62) & 1);
+            return;
+        }
+    }
+}
+
+void leaky::LeakyFrameSimulator::apply_1q_leaky_pauli_channel(
+    stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel &channel) {
+    for (const auto &target : targets) {
+        auto qubit = target.qubit_value();
+        for (size_t shot = 0; shot < batch_size; shot++) {
+            uint8_t cur_status = get_leakage_status(qubit, shot);
+            leaky::transition sample;
+            if (!channel.sample_into(cur_status, rng, sample)) {
+                continue;
+            }
+            auto [next_status, pauli_channel_idx] = sample;
+            if (cur_status == 0) {
+                shot_weights[shot] *=
+                    next_status == 0 ? channel.retention_likelihood_ratio : channel.leakage_likelihood_ratio;
+            }
+            set_leakage_status(qubit, shot, next_status);
+            handle_transition(cur_status, next_status, qubit, shot, pauli_channel_idx);
+        }
+    }
+}
+
+void leaky::LeakyFrameSimulator::apply_2q_leaky_pauli_channel(
+    stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel &channel) {
+    for (size_t k = 0; k < targets.size(); k += 2) {
+        auto q1 = targets[k].qubit_value();
+        auto q2 = targets[k + 1].qubit_value();
+        for (size_t shot = 0; shot < batch_size; shot++) {
+            auto cs1 = get_leakage_status(q1, shot);
+            auto cs2 = get_leakage_status(q2, shot);
+            uint8_t cur_status = (cs1 << 4) | cs2;
+            leaky::transition sample;
+            if (!channel.sample_into(cur_status, rng, sample)) {
+                continue;
+            }
+            auto [next_status, pauli_channel_idx] = sample;
+            if (cur_status == 0) {
+                shot_weights[shot] *=
+                    next_status == 0 ? channel.retention_likelihood_ratio : channel.leakage_likelihood_ratio;
+            }
+            uint8_t ns1 = next_status >> 4;
+            uint8_t ns2 = next_status & 0x0F;
+            set_leakage_status(q1, shot, ns1);
+            set_leakage_status(q2, shot, ns2);
+            handle_transition(cs1, ns1, q1, shot, pauli_channel_idx >> 2);
+            handle_transition(cs2, ns2, q2, shot, pauli_channel_idx & 0x03);
+        }
+    }
+}
+
+void leaky::LeakyFrameSimulator::do_gate(const stim::CircuitInstruction &inst) {
+    auto gate_type = inst.gate_type;
+    auto targets = inst.targets;
+    auto flags = stim::GATE_DATA[gate_type].flags;
+    // Skip annotations.
+    if (flags & stim::GATE_HAS_NO_EFFECT_ON_QUBITS) {
+        return;
+    }
+    // Encounter measurements: add leakage masks to the record
+    if (flags & stim::GATE_PRODUCES_RESULTS) {
+        for (auto q : targets) {
+            auto qubit = q.qubit_value();
+            if (!sparse_leakage) {
+                auto begin = leakage_status.begin() + qubit * batch_size;
+                leakage_masks_record.insert(leakage_masks_record.end(), begin, begin + batch_size);
+                continue;
+            }
+            size_t offset = leakage_masks_record.size();
+            leakage_masks_record.resize(offset + batch_size, 0);
+            for_each_set_bit(leaked_mask[qubit], [&](size_t shot) {
+                leakage_masks_record[offset + shot] = sparse_leakage_status.find(qubit * batch_size + shot)->second;
+            });
+        }
+    }
+    // Encounter resets: reset the leakage status of the qubits
+    if (flags & stim::GATE_IS_RESET) {
+        for (auto q : targets) {
+            reset_leakage_status(q.qubit_value());
+        }
+    }
+    if ((flags & stim::GATE_PRODUCES_RESULTS) || (flags & stim::GATE_IS_RESET) || (flags & stim::GATE_IS_NOISY) ||
+        (flags & stim::GATE_IS_SINGLE_QUBIT_GATE)) {
+        frame_simulator.do_gate(inst);
+        return;
+    }
+
+    bool any_leaked = std::any_of(targets.begin(), targets.end(), [this](const stim::GateTarget &t) {
+        return is_leaked_in_any_shot(t);
+    });
+    if (!any_leaked) {
+        frame_simulator.do_gate(inst);
+        return;
+    }
+    // Leaked qubits are maximally mixed: re-randomize their frames in the shots where they are
+    // leaked before letting them interact with their partners. A qubit may appear in several
+    // pairs of the same instruction, so the pairs are applied one by one.
+    for (size_t i = 0; i < targets.size(); i += 2) {
+        auto split_targets = targets.sub(i, i + 2);
+        for (const auto &t : split_targets) {
+            if (is_leaked_in_any_shot(t)) {
+                randomize_leaked_frame(t.qubit_value());
+            }
+        }
+        frame_simulator.do_gate({gate_type, inst.args, split_targets});
+    }
+}
+
+void leaky::LeakyFrameSimulator::do_compiled_circuit(const CompiledCircuit &compiled_circuit) {
+    compiled_circuit.for_each_operation(
+        [this, &compiled_circuit](const stim::CircuitInstruction &op, stim::SpanRef<const BoundChannelRef> channels) {
+            do_gate(op);
+            for (const auto &[target_begin, target_end, channel_index] : channels) {
+                auto targets = op.targets.sub(target_begin, target_end);
+                const auto &channel = compiled_circuit.channels[channel_index];
+                if (targets.size() == 1) {
+                    apply_1q_leaky_pauli_channel(targets, channel);
+                } else {
+                    apply_2q_leaky_pauli_channel(targets, channel);
+                }
+            }
+        });
+}
+
+void leaky::LeakyFrameSimulator::clear() {
+    std::fill(leakage_status.begin(), leakage_status.end(), 0);
+    sparse_leakage_status.clear();
+    leaked_mask.clear();
+    leakage_masks_record.clear();
+    std::fill(shot_weights.begin(), shot_weights.end(), 1.0);
+    frame_simulator.reset_all();
+}
+
+void leaky::LeakyFrameSimulator::append_measurement_records_into(
+    uint8_t *record_begin_ptr,
+    const stim::simd_bits<stim::MAX_BITWORD_WIDTH> &reference_sample,
+    size_t num_shots,
+    ReadoutStrategy readout_strategy) {
+    if (num_shots > batch_size) {
+        throw std::invalid_argument("The number of shots exceeds the batch size of the simulator.");
+    }
+    auto num_measurements = leakage_masks_record.size() / batch_size;
+    for (size_t m = 0; m < num_measurements; m++) {
+        bool reference_bit = reference_sample[m];
+        auto flips = frame_simulator.m_record.storage[m];
+        auto masks = leakage_masks_record.data() + m * batch_size;
+        for (size_t shot = 0; shot < num_shots; shot++) {
+            uint8_t mask = masks[shot];
+            uint8_t bit = reference_bit ^ flips[shot];
+            uint8_t value;
+            if (mask == 0) {
+                value = bit;
+            } else if (readout_strategy == ReadoutStrategy::RawLabel) {
+                value = mask + 1;
+            } else if (readout_strategy == ReadoutStrategy::RandomLeakageProjection) {
+                value = (uint8_t)(rng() >> 63);
+            } else if (readout_strategy == ReadoutStrategy::DeterministicLeakageProjection) {
+                value = 1;
+            } else {
+                throw std::invalid_argument("Invalid readout strategy.");
+            }
+            record_begin_ptr[shot * num_measurements + m] = value;
+        }
+    }
+}
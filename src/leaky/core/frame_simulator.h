@@ -0,0 +1,92 @@
+#ifndef LEAKY_FRAME_SIMULATOR_H
+#define LEAKY_FRAME_SIMULATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/rand_gen.h"
+#include "leaky/core/readout_strategy.h"
+#include "stim.h"
+
+namespace leaky {
+
+/**
+ * @brief A leakage-aware Pauli frame simulator sampling `batch_size` shots at once.
+ *
+ * The computational state of every shot is tracked as a Pauli frame relative to a noiseless
+ * reference sample with `stim::FrameSimulator`, while the leakage status of every qubit in
+ * every shot is kept in a byte plane. Leaky channel transitions act as masked frame updates
+ * mirroring `Simulator::handle_transition`:
+ *   R: the attached Pauli is applied to the frame of the shot.
+ *   U: the frame is X-randomized, just as the tableau simulator does `X_ERROR(0.5)`.
+ *   D: the qubit is reset to a random computational state, which in frame terms is a fully
+ *      randomized frame.
+ *   L: only the leakage status changes.
+ *
+ * The tableau simulator skips gates acting on leaked qubits, which has no Pauli frame
+ * equivalent. Here a leaked qubit is treated as maximally mixed instead: its frame is
+ * re-randomized before each multi-qubit gate it takes part in, so its partners pick up the
+ * random Pauli kickback of interacting with a maximally mixed qubit.
+ *
+ * With `sparse_leakage`, only the nonzero leakage statuses are stored, in a hash map next to the
+ * `leaked_mask` bit plane that answers the membership checks. Leakage then costs one bit per
+ * qubit and shot instead of a byte, plus an entry per currently leaked qubit of a shot, which
+ * is what makes circuits of many thousands of qubits fit. The samples are the same either way.
+ */
+struct LeakyFrameSimulator {
+    uint32_t num_qubits;
+    size_t batch_size;
+    /// Whether the leakage statuses are kept in `sparse_leakage_status` rather than `leakage_status`.
+    bool sparse_leakage;
+    /// Leakage status of qubit `q` in shot `s`, stored at `q * batch_size + s`. Empty with `sparse_leakage`.
+    std::vector<uint8_t> leakage_status;
+    /// The nonzero leakage statuses, keyed by `q * batch_size + s`, with `sparse_leakage`.
+    std::unordered_map<size_t, uint8_t> sparse_leakage_status;
+    /// Bit plane of the nonzero leakage statuses, used to mask the frame updates.
+    stim::simd_bit_table<stim::MAX_BITWORD_WIDTH> leaked_mask;
+    /// Leakage status of the `m`-th measured qubit in shot `s`, stored at `m * batch_size + s`.
+    std::vector<uint8_t> leakage_masks_record;
+    /// The weight of every shot, like `Simulator::shot_weight`.
+    std::vector<double> shot_weights;
+    stim::FrameSimulator<stim::MAX_BITWORD_WIDTH> frame_simulator;
+    Xoshiro256pp rng;
+
+    LeakyFrameSimulator(
+        const stim::CircuitStats &circuit_stats, size_t batch_size, uint64_t seed, bool sparse_leakage = false);
+
+    void set_seed(uint64_t seed);
+    [[nodiscard]] uint8_t get_leakage_status(uint32_t qubit, size_t shot) const;
+    void apply_1q_leaky_pauli_channel(stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel &channel);
+    void apply_2q_leaky_pauli_channel(stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel &channel);
+    void do_gate(const stim::CircuitInstruction &inst);
+    void do_compiled_circuit(const CompiledCircuit &compiled_circuit);
+    void clear();
+    /**
+     * @brief Write the measurement records of the first `num_shots` shots into `record_begin_ptr`.
+     *
+     * @param record_begin_ptr The output, `num_shots` rows of `num_measurements` bytes.
+     * @param reference_sample The noiseless reference sample the frames are relative to.
+     */
+    void append_measurement_records_into(
+        uint8_t *record_begin_ptr,
+        const stim::simd_bits<stim::MAX_BITWORD_WIDTH> &reference_sample,
+        size_t num_shots,
+        ReadoutStrategy readout_strategy = ReadoutStrategy::RawLabel);
+
+   private:
+    stim::simd_bits<stim::MAX_BITWORD_WIDTH> scratch;
+
+    bool is_leaked_in_any_shot(stim::GateTarget target) const;
+    void set_leakage_status(uint32_t qubit, size_t shot, uint8_t status);
+    void reset_leakage_status(uint32_t qubit);
+    void randomize_leaked_frame(uint32_t qubit);
+    void handle_transition(uint8_t cur_status, uint8_t next_status, uint32_t qubit, size_t shot, uint8_t pauli_idx);
+};
+
+}  // namespace leaky
+
+#endif  // LEAKY_FRAME_SIMULATOR_H
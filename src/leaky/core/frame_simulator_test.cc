@@ -0,0 +1,207 @@
+#include "leaky/core/frame_simulator.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+static std::vector<stim::GateTarget> qubit_targets(const std::vector<uint32_t>& targets) {
+    std::vector<stim::GateTarget> result;
+    for (uint32_t t : targets) {
+        result.push_back(stim::GateTarget::qubit(t));
+    }
+    return result;
+}
+
+static std::vector<uint8_t> run(
+    LeakyFrameSimulator& sim,
+    const stim::Circuit& circuit,
+    const std::vector<std::pair<size_t, const LeakyPauliChannel*>>& channels_after,
+    ReadoutStrategy readout_strategy = ReadoutStrategy::RawLabel) {
+    auto reference_sample = stim::TableauSimulator<stim::MAX_BITWORD_WIDTH>::reference_sample_circuit(circuit);
+    sim.clear();
+    for (size_t k = 0; k < circuit.operations.size(); k++) {
+        const auto& op = circuit.operations[k];
+        sim.do_gate(op);
+        for (const auto& [idx, channel] : channels_after) {
+            if (idx != k) {
+                continue;
+            }
+            if (channel->is_single_qubit_channel) {
+                sim.apply_1q_leaky_pauli_channel(op.targets, *channel);
+            } else {
+                sim.apply_2q_leaky_pauli_channel(op.targets, *channel);
+            }
+        }
+    }
+    std::vector<uint8_t> results(sim.batch_size * circuit.count_measurements());
+    sim.append_measurement_records_into(results.data(), reference_sample, sim.batch_size, readout_strategy);
+    return results;
+}
+
+TEST(frame_simulator, construct) {
+    auto circuit = stim::Circuit("H 0\nCX 0 1\nM 0 1");
+    LeakyFrameSimulator sim(circuit.compute_stats(), 256, 0);
+    ASSERT_EQ(sim.num_qubits, 2);
+    ASSERT_EQ(sim.batch_size, 256);
+    ASSERT_EQ(sim.leakage_status.size(), 512);
+    ASSERT_EQ(sim.leakage_masks_record.size(), 0);
+}
+
+TEST(frame_simulator, noiseless_bell_pairs) {
+    auto circuit = stim::Circuit("R 0 1\nH 0\nCX 0 1\nM 0 1");
+    LeakyFrameSimulator sim(circuit.compute_stats(), 256, 0);
+    auto results = run(sim, circuit, {});
+    size_t ones = 0;
+    for (size_t s = 0; s < 256; s++) {
+        ASSERT_EQ(results[2 * s], results[2 * s + 1]);
+        ones += results[2 * s];
+    }
+    ASSERT_TRUE(80 < ones && ones < 176);
+}
+
+TEST(frame_simulator, pauli_transition) {
+    auto circuit = stim::Circuit("X 0\nM 0");
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 1, 1);
+    LeakyFrameSimulator sim(circuit.compute_stats(), 256, 0);
+    auto results = run(sim, circuit, {{0, &channel}});
+    for (auto r : results) {
+        ASSERT_EQ(r, 0);
+    }
+}
+
+TEST(frame_simulator, readout_strategy) {
+    auto circuit = stim::Circuit("X 0\nM 0");
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 2, 0, 1);
+    LeakyFrameSimulator sim(circuit.compute_stats(), 256, 0);
+    for (auto r : run(sim, circuit, {{0, &channel}})) {
+        ASSERT_EQ(r, 3);
+    }
+    for (auto r : run(sim, circuit, {{0, &channel}}, ReadoutStrategy::DeterministicLeakageProjection)) {
+        ASSERT_EQ(r, 1);
+    }
+    for (auto r : run(sim, circuit, {{0, &channel}}, ReadoutStrategy::RandomLeakageProjection)) {
+        ASSERT_TRUE(r == 0 || r == 1);
+    }
+}
+
+TEST(frame_simulator, leaked_qubit_trans_down) {
+    auto circuit = stim::Circuit("X 0\nX 0\nM 0");
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    channel.add_transition(1, 0, 0, 1);
+    LeakyFrameSimulator sim(circuit.compute_stats(), 1024, 0);
+    auto results = run(sim, circuit, {{0, &channel}, {1, &channel}});
+    size_t ones = 0;
+    for (auto r : results) {
+        ASSERT_TRUE(r == 0 || r == 1);
+        ones += r;
+    }
+    ASSERT_TRUE(400 < ones && ones < 624);
+}
+
+TEST(frame_simulator, reset_clears_leakage) {
+    auto circuit = stim::Circuit("X 0 1\nM 0 1\nR 0\nM 0 1");
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x11, 0, 1);
+    auto cx = qubit_targets({0, 1});
+    LeakyFrameSimulator sim(circuit.compute_stats(), 256, 0);
+    auto reference_sample = stim::TableauSimulator<stim::MAX_BITWORD_WIDTH>::reference_sample_circuit(circuit);
+    sim.clear();
+    sim.do_gate(circuit.operations[0]);
+    sim.apply_2q_leaky_pauli_channel(cx, channel);
+    for (size_t k = 1; k < circuit.operations.size(); k++) {
+        sim.do_gate(circuit.operations[k]);
+    }
+    std::vector<uint8_t> results(256 * 4);
+    sim.append_measurement_records_into(results.data(), reference_sample, 256);
+    for (size_t s = 0; s < 256; s++) {
+        ASSERT_EQ(results[4 * s], 2);
+        ASSERT_EQ(results[4 * s + 1], 2);
+        ASSERT_EQ(results[4 * s + 2], 0);
+        ASSERT_EQ(results[4 * s + 3], 2);
+    }
+}
+
+TEST(frame_simulator, leaked_partner_randomizes_target) {
+    // A CX controlled by a leaked qubit acts on its target as a random X.
+    auto circuit = stim::Circuit("R 0 1\nCX 0 1\nM 1");
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    LeakyFrameSimulator sim(circuit.compute_stats(), 1024, 0);
+    auto reference_sample = stim::TableauSimulator<stim::MAX_BITWORD_WIDTH>::reference_sample_circuit(circuit);
+    sim.clear();
+    sim.do_gate(circuit.operations[0]);
+    auto q0 = qubit_targets({0});
+    sim.apply_1q_leaky_pauli_channel(q0, channel);
+    sim.do_gate(circuit.operations[1]);
+    sim.do_gate(circuit.operations[2]);
+    std::vector<uint8_t> results(1024);
+    sim.append_measurement_records_into(results.data(), reference_sample, 1024);
+    size_t ones = 0;
+    for (auto r : results) {
+        ones += r;
+    }
+    ASSERT_TRUE(400 < ones && ones < 624);
+}
+
+TEST(frame_simulator, compiled_channels_act_between_shared_target_qubits) {
+    // The channel of `CX 0 1` leaks qubit 1 before `CX 1 2` acts on it, which flips qubit 2 at random.
+    auto circuit = stim::Circuit("R 0 1 2\nX 1\nCX 0 1 1 2\nM 1 2");
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x01, 0, 1);
+    BoundChannelMap bound_leaky_channels;
+    bind_leaky_channel(bound_leaky_channels, {stim::GateType::CX, {}, qubit_targets({0, 1})}, channel);
+    auto compiled = compile_circuit(circuit, bound_leaky_channels);
+    LeakyFrameSimulator sim(circuit.compute_stats(), 1024, 0);
+    auto reference_sample = stim::TableauSimulator<stim::MAX_BITWORD_WIDTH>::reference_sample_circuit(circuit);
+    sim.clear();
+    sim.do_compiled_circuit(compiled);
+    std::vector<uint8_t> results(1024 * 2);
+    sim.append_measurement_records_into(results.data(), reference_sample, 1024);
+    size_t ones = 0;
+    for (size_t s = 0; s < 1024; s++) {
+        ASSERT_EQ(results[2 * s], 2);
+        ones += results[2 * s + 1];
+    }
+    ASSERT_TRUE(400 < ones && ones < 624);
+}
+
+TEST(frame_simulator, sparse_leakage_matches_dense) {
+    auto circuit = stim::Circuit("H 0 1 2\nCX 0 1\nM 0 1 2\nR 2\nCX 1 2\nM 0 1 2");
+    LeakyPauliChannel leak(true);
+    leak.add_transition(0, 0, 0, 0.7);
+    leak.add_transition(0, 1, 0, 0.2);
+    leak.add_transition(1, 0, 0, 0.5);
+    leak.add_transition(1, 2, 0, 0.5);
+    leak.add_transition(0, 0, 3, 0.1);
+    LeakyPauliChannel leak_2q(false);
+    leak_2q.add_transition(0x00, 0x00, 5, 0.9);
+    leak_2q.add_transition(0x00, 0x01, 0, 0.1);
+    LeakyFrameSimulator dense(circuit.compute_stats(), 256, 5);
+    LeakyFrameSimulator sparse(circuit.compute_stats(), 256, 5, true);
+    ASSERT_TRUE(sparse.leakage_status.empty());
+    std::vector<std::pair<size_t, const LeakyPauliChannel*>> channels{{0, &leak}, {1, &leak_2q}, {4, &leak_2q}};
+    auto expected = run(dense, circuit, channels);
+    auto results = run(sparse, circuit, channels);
+    ASSERT_EQ(results, expected);
+    ASSERT_EQ(sparse.leakage_masks_record, dense.leakage_masks_record);
+    size_t num_leaked = 0;
+    for (size_t q = 0; q < 3; q++) {
+        for (size_t s = 0; s < 256; s++) {
+            ASSERT_EQ(sparse.get_leakage_status(q, s), dense.get_leakage_status(q, s));
+            num_leaked += dense.get_leakage_status(q, s) != 0;
+        }
+    }
+    ASSERT_GT(num_leaked, 0);
+    ASSERT_EQ(sparse.sparse_leakage_status.size(), num_leaked);
+}
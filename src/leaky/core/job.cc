@@ -0,0 +1,174 @@
+#include "leaky/core/job.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "leaky/core/channel_library.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "stim.h"
+
+static const char JOB_MAGIC[8] = {'L', 'E', 'A', 'K', 'Y', 'J', 'O', 'B'};
+static const uint32_t JOB_VERSION = 1;
+
+static void put_uint(std::string &out, uint64_t value, size_t num_bytes) {
+    for (size_t k = 0; k < num_bytes; k++) {
+        out.push_back((char)((value >> (8 * k)) & 0xFF));
+    }
+}
+
+/// Reads little-endian values and byte strings from a job file, throwing instead of reading past its end.
+struct JobReader {
+    const uint8_t *ptr;
+    const uint8_t *end;
+
+    const uint8_t *get_bytes(size_t num_bytes) {
+        if ((size_t)(end - ptr) < num_bytes) {
+            throw std::invalid_argument("The job file is truncated.");
+        }
+        const uint8_t *bytes = ptr;
+        ptr += num_bytes;
+        return bytes;
+    }
+
+    uint64_t get_uint(size_t num_bytes) {
+        const uint8_t *bytes = get_bytes(num_bytes);
+        uint64_t value = 0;
+        for (size_t k = 0; k < num_bytes; k++) {
+            value |= (uint64_t)bytes[k] << (8 * k);
+        }
+        return value;
+    }
+};
+
+leaky::ShardRange leaky::shard_range(uint64_t shots, Engine engine, uint64_t shard_index, uint64_t num_shards) {
+    if (shard_index >= num_shards) {
+        throw std::invalid_argument("The shard index should be smaller than the number of shards.");
+    }
+    uint64_t block_shots = shots_per_block(engine);
+    uint64_t num_blocks = (shots + block_shots - 1) / block_shots;
+    uint64_t block_begin = shard_index * num_blocks / num_shards;
+    uint64_t block_end = (shard_index + 1) * num_blocks / num_shards;
+    uint64_t shot_begin = std::min(block_begin * block_shots, shots);
+    uint64_t shot_end = std::min(block_end * block_shots, shots);
+    return {block_begin, shot_begin, shot_end - shot_begin};
+}
+
+void leaky::save_job(const SamplingJob &job, const std::string &filepath) {
+    std::string out(JOB_MAGIC, sizeof(JOB_MAGIC));
+    put_uint(out, JOB_VERSION, 4);
+    put_uint(out, job.shots, 8);
+    put_uint(out, job.seed, 8);
+    put_uint(out, job.readout_strategy, 1);
+    put_uint(out, job.engine, 1);
+    auto circuit_text = job.circuit.str();
+    put_uint(out, circuit_text.size(), 8);
+    out.append(circuit_text);
+    auto library = serialize_channel_library(job.bound_leaky_channels);
+    put_uint(out, library.size(), 8);
+    out.append(library);
+
+    FILE *file = fopen(filepath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::invalid_argument("Failed to open '" + filepath + "' to write.");
+    }
+    size_t written = fwrite(out.data(), 1, out.size(), file);
+    fclose(file);
+    if (written != out.size()) {
+        throw std::runtime_error("Failed to write the job to '" + filepath + "'.");
+    }
+}
+
+leaky::SamplingJob leaky::load_job(const std::string &filepath, bool safety_check) {
+    FILE *file = fopen(filepath.c_str(), "rb");
+    if (file == nullptr) {
+        throw std::invalid_argument("Failed to open '" + filepath + "' to read.");
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+    fclose(file);
+
+    JobReader reader{bytes.data(), bytes.data() + bytes.size()};
+    if (bytes.size() < sizeof(JOB_MAGIC) || std::memcmp(reader.get_bytes(sizeof(JOB_MAGIC)), JOB_MAGIC, 8) != 0) {
+        throw std::invalid_argument("Not a leaky job file.");
+    }
+    if (reader.get_uint(4) != JOB_VERSION) {
+        throw std::invalid_argument("Unsupported job file version.");
+    }
+    uint64_t shots = reader.get_uint(8);
+    uint64_t seed = reader.get_uint(8);
+    auto readout_strategy = reader.get_uint(1);
+    auto engine = reader.get_uint(1);
+    if (readout_strategy > ReadoutStrategy::DeterministicLeakageProjection || engine > Engine::Branching) {
+        throw std::invalid_argument("The job file has an unknown readout strategy or engine.");
+    }
+    size_t circuit_size = reader.get_uint(8);
+    std::string circuit_text((const char *)reader.get_bytes(circuit_size), circuit_size);
+    size_t library_size = reader.get_uint(8);
+    const uint8_t *library = reader.get_bytes(library_size);
+    return {
+        stim::Circuit(circuit_text.c_str()),
+        parse_channel_library(library, library_size, safety_check),
+        shots,
+        seed,
+        (ReadoutStrategy)readout_strategy,
+        (Engine)engine,
+    };
+}
+
+std::vector<uint64_t> leaky::run_shard(
+    const SamplingJob &job,
+    uint64_t shard_index,
+    uint64_t num_shards,
+    FILE *out,
+    stim::SampleFormat format,
+    size_t num_threads) {
+    if (job.readout_strategy == ReadoutStrategy::RawLabel) {
+        throw std::invalid_argument(
+            "Leaked labels can not be written to a stim result format, use a leakage projection readout strategy "
+            "instead.");
+    }
+    auto range = shard_range(job.shots, job.engine, shard_index, num_shards);
+    auto compiled_circuit = compile_circuit(job.circuit, job.bound_leaky_channels);
+    auto num_measurements = compiled_circuit.num_measurements;
+    std::vector<uint64_t> counts(num_measurements, 0);
+    if (range.shots == 0) {
+        return counts;
+    }
+    if (num_threads == 0) {
+        num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    size_t chunk_shots = num_threads * BLOCKS_PER_THREAD_PER_CHUNK * shots_per_block(job.engine);
+    sample_chunks(
+        compiled_circuit,
+        range.shots,
+        job.readout_strategy,
+        job.seed,
+        chunk_shots,
+        [&](const uint8_t *records, size_t num_shots) {
+            for (size_t shot = 0; shot < num_shots; shot++) {
+                const uint8_t *row = records + shot * num_measurements;
+                for (size_t m = 0; m < num_measurements; m++) {
+                    counts[m] += row[m];
+                }
+            }
+            write_measurement_records(records, num_shots, num_measurements, out, format);
+        },
+        num_threads,
+        job.engine,
+        range.first_block);
+    return counts;
+}
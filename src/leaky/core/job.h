@@ -0,0 +1,83 @@
+#ifndef LEAKY_JOB_H
+#define LEAKY_JOB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "stim.h"
+
+namespace leaky {
+
+/**
+ * @brief A sampling job, holding all that is needed to sample any part of it on another machine.
+ *
+ * The shots of a job are split into shards along the blocks of `sample_batch`, and every block
+ * draws its random numbers from `(seed, block index)`. So the shards of a job can be sampled in
+ * any order, by any number of processes, and concatenating their results in shard order always
+ * gives the results of sampling the whole job at once.
+ */
+struct SamplingJob {
+    stim::Circuit circuit;
+    BoundChannelMap bound_leaky_channels;
+    uint64_t shots;
+    uint64_t seed;
+    ReadoutStrategy readout_strategy;
+    Engine engine;
+};
+
+/// The shots `[first_shot, first_shot + shots)` of a shard, which are those of the blocks starting at `first_block`.
+struct ShardRange {
+    uint64_t first_block;
+    uint64_t first_shot;
+    uint64_t shots;
+};
+
+/**
+ * @brief The shots of shard `shard_index` when `shots` shots are split into `num_shards` shards.
+ *
+ * The blocks are dealt out as evenly as possible, in order, so the shards are contiguous.
+ */
+ShardRange shard_range(uint64_t shots, Engine engine, uint64_t shard_index, uint64_t num_shards);
+
+/**
+ * @brief Save a job to a binary job file.
+ *
+ * The file holds the shot count, seed, readout strategy and engine of the job, the text of its
+ * circuit and its bindings as an embedded channel library, see `save_channel_library`.
+ */
+void save_job(const SamplingJob &job, const std::string &filepath);
+
+/**
+ * @brief Load a job written by `save_job`.
+ *
+ * @param safety_check Whether to run `LeakyPauliChannel::safety_check` on every loaded channel.
+ */
+SamplingJob load_job(const std::string &filepath, bool safety_check = true);
+
+/**
+ * @brief Sample shard `shard_index` of `num_shards` of a job and write it to `out` in a stim result format.
+ *
+ * Shard files are concatenable: the shard files of a job concatenated in shard order are the
+ * file `sample_to_file` writes for the whole job. The readout strategy of the job must project
+ * leaked measurements onto bits.
+ *
+ * @return For every measurement, the number of shots of the shard in which it returned 1, so that
+ *     the shards can also be aggregated by summing these counts.
+ */
+std::vector<uint64_t> run_shard(
+    const SamplingJob &job,
+    uint64_t shard_index,
+    uint64_t num_shards,
+    FILE *out,
+    stim::SampleFormat format,
+    size_t num_threads = 1);
+
+}  // namespace leaky
+
+#endif  // LEAKY_JOB_H
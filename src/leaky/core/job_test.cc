@@ -0,0 +1,116 @@
+#include "leaky/core/job.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+static std::string read_file(const std::string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    std::string content;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        content.append(buffer, n);
+    }
+    fclose(file);
+    return content;
+}
+
+static SamplingJob make_job(uint64_t shots) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.5);
+    channel.add_transition(0x00, 0x10, 0, 0.25);
+    channel.add_transition(0x00, 0x00, 5, 0.25);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+    return {
+        stim::Circuit("H 0\nCX 0 1\nM 0 1\nR 0 1\nH 0\nCX 0 1\nM 0 1"),
+        sim.bound_leaky_channels,
+        shots,
+        42,
+        ReadoutStrategy::RandomLeakageProjection,
+        Engine::Tableau,
+    };
+}
+
+TEST(job, shard_range) {
+    uint64_t shots = 10 * SHOTS_PER_BLOCK + 3;
+    uint64_t next_shot = 0;
+    for (uint64_t k = 0; k < 4; k++) {
+        auto range = shard_range(shots, Engine::Tableau, k, 4);
+        ASSERT_EQ(range.first_shot, next_shot);
+        ASSERT_EQ(range.first_shot, range.first_block * SHOTS_PER_BLOCK);
+        next_shot += range.shots;
+    }
+    ASSERT_EQ(next_shot, shots);
+    // More shards than blocks leave some shards empty.
+    ASSERT_EQ(shard_range(3, Engine::Tableau, 0, 2).shots, 0);
+    ASSERT_EQ(shard_range(3, Engine::Tableau, 1, 2).shots, 3);
+    ASSERT_THROW(shard_range(shots, Engine::Tableau, 4, 4), std::invalid_argument);
+}
+
+TEST(job, save_and_load) {
+    auto job = make_job(1000);
+    auto path = testing::TempDir() + "job_test.job";
+    save_job(job, path);
+    auto loaded = load_job(path);
+    ASSERT_EQ(loaded.circuit, job.circuit);
+    ASSERT_EQ(loaded.bound_leaky_channels.keys, job.bound_leaky_channels.keys);
+    ASSERT_EQ(loaded.shots, job.shots);
+    ASSERT_EQ(loaded.seed, job.seed);
+    ASSERT_EQ(loaded.readout_strategy, job.readout_strategy);
+    ASSERT_EQ(loaded.engine, job.engine);
+    std::remove(path.c_str());
+
+    FILE *file = fopen(path.c_str(), "wb");
+    fputs("not a job", file);
+    fclose(file);
+    ASSERT_THROW(load_job(path), std::invalid_argument);
+    std::remove(path.c_str());
+}
+
+TEST(job, concatenated_shards_match_sample_to_file) {
+    auto job = make_job(7 * SHOTS_PER_BLOCK + 11);
+    auto whole_path = testing::TempDir() + "job_test_whole.b8";
+    auto compiled = compile_circuit(job.circuit, job.bound_leaky_channels);
+    FILE *whole = fopen(whole_path.c_str(), "wb");
+    sample_to_file(compiled, job.shots, job.readout_strategy, whole, stim::SampleFormat::SAMPLE_FORMAT_B8, job.seed, 2);
+    fclose(whole);
+
+    std::string concatenated;
+    std::vector<uint64_t> counts(compiled.num_measurements, 0);
+    for (uint64_t k = 0; k < 3; k++) {
+        auto shard_path = testing::TempDir() + "job_test_shard.b8";
+        FILE *shard = fopen(shard_path.c_str(), "wb");
+        auto shard_counts = run_shard(job, k, 3, shard, stim::SampleFormat::SAMPLE_FORMAT_B8, k + 1);
+        fclose(shard);
+        concatenated += read_file(shard_path);
+        std::remove(shard_path.c_str());
+        for (size_t m = 0; m < counts.size(); m++) {
+            counts[m] += shard_counts[m];
+        }
+    }
+    auto expected = read_file(whole_path);
+    std::remove(whole_path.c_str());
+    ASSERT_EQ(concatenated, expected);
+    // Every shot is one byte of the `b8` format.
+    for (size_t m = 0; m < counts.size(); m++) {
+        uint64_t ones = 0;
+        for (char byte : expected) {
+            ones += ((uint8_t)byte >> m) & 1;
+        }
+        ASSERT_EQ(counts[m], ones);
+    }
+}
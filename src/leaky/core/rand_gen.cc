@@ -1,23 +1,63 @@
 #include "leaky/core/rand_gen.h"
 
+#include <mutex>
 #include <random>
 
+static std::mutex &global_urng_mutex() {
+    static std::mutex m;
+    return m;
+}
+
 std::mt19937_64& leaky::global_urng() {
-    static std::mt19937_64 u{};
+    static std::mt19937_64 u{std::random_device{}()};
     return u;
 }
 
 void leaky::randomize() {
     static std::random_device rd{};
+    std::lock_guard<std::mutex> lock(global_urng_mutex());
     leaky::global_urng().seed(rd());
 }
 
 void leaky::set_seed(unsigned seed) {
+    std::lock_guard<std::mutex> lock(global_urng_mutex());
     leaky::global_urng().seed(seed);
 }
 
 double leaky::rand_float(double begin, double end) {
-    static std::uniform_real_distribution<> d{};
-    using parm_t = decltype(d)::param_type;
-    return d(global_urng(), parm_t{begin, end});
+    std::uniform_real_distribution<> d{begin, end};
+    std::lock_guard<std::mutex> lock(global_urng_mutex());
+    return d(global_urng());
+}
+
+uint64_t leaky::draw_seed() {
+    std::lock_guard<std::mutex> lock(global_urng_mutex());
+    return global_urng()();
+}
+
+uint64_t leaky::splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+leaky::Xoshiro256pp::Xoshiro256pp(uint64_t seed) {
+    this->seed(seed);
+}
+
+void leaky::Xoshiro256pp::seed(uint64_t seed) {
+    for (auto &s : state) {
+        s = leaky::splitmix64(seed);
+        seed += 0x9E3779B97F4A7C15ULL;
+    }
+}
+
+void leaky::Xoshiro256pp::fill_uniform(double *out, size_t n) {
+    // Work on a local copy so the state stays in registers for the whole buffer.
+    Xoshiro256pp local = *this;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = local.uniform();
+    }
+    *this = local;
 }
\ No newline at end of file
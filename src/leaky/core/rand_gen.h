@@ -1,11 +1,23 @@
 #ifndef LEAKY_RAND_GEN_H
 #define LEAKY_RAND_GEN_H
 
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <random>
 
 namespace leaky {
+/**
+ * @brief The mt19937_64 random number generator shared by the process
+ *
+ * It is seeded from `std::random_device` on first use. The functions below lock it, so prefer them
+ * to using the engine directly from several threads.
+ */
 std::mt19937_64 &global_urng();
 
+/**
+ * @brief Seed the mt19937_64 random number generator from `std::random_device`
+ */
 void randomize();
 
 /**
@@ -23,6 +35,71 @@ void set_seed(unsigned seed);
  * @return double
  */
 double rand_float(double begin, double end);
+
+/**
+ * @brief A 64-bit seed drawn from the mt19937_64 random number generator
+ *
+ * @return uint64_t
+ */
+uint64_t draw_seed();
+
+/**
+ * @brief The SplitMix64 mixing function, used to derive well separated seeds from related integers
+ *
+ * @param x
+ * @return uint64_t
+ */
+uint64_t splitmix64(uint64_t x);
+
+/**
+ * @brief The xoshiro256++ random number generator
+ *
+ * A small and fast engine owned by each simulator. It satisfies the UniformRandomBitGenerator
+ * requirements, so it can also be used with the distributions in <random>.
+ */
+struct Xoshiro256pp {
+    using result_type = uint64_t;
+    uint64_t state[4];
+
+    explicit Xoshiro256pp(uint64_t seed = 0);
+    void seed(uint64_t seed);
+
+    static constexpr result_type min() {
+        return 0;
+    }
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    inline result_type operator()() {
+        const uint64_t result = rotl(state[0] + state[3], 23) + state[0];
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    /**
+     * @brief A random double chosen uniformly at random in [0, 1)
+     */
+    inline double uniform() {
+        return static_cast<double>((*this)() >> 11) * 0x1.0p-53;
+    }
+
+    /**
+     * @brief Fill `out[0..n)` with doubles chosen uniformly at random in [0, 1)
+     */
+    void fill_uniform(double *out, size_t n);
+
+   private:
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
 } // namespace leaky
 
 #endif // LEAKY_RAND_GEN_H
\ No newline at end of file
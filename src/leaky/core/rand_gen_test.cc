@@ -0,0 +1,55 @@
+#include "leaky/core/rand_gen.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace leaky;
+
+TEST(rand_gen, xoshiro256pp_reference_output) {
+    Xoshiro256pp rng;
+    rng.state[0] = 1;
+    rng.state[1] = 2;
+    rng.state[2] = 3;
+    rng.state[3] = 4;
+    ASSERT_EQ(rng(), 41943041ULL);
+    ASSERT_EQ(rng(), 58720359ULL);
+}
+
+TEST(rand_gen, xoshiro256pp_seed) {
+    Xoshiro256pp a(7);
+    Xoshiro256pp b(7);
+    Xoshiro256pp c(8);
+    for (size_t i = 0; i < 100; i++) {
+        auto x = a();
+        ASSERT_EQ(x, b());
+        ASSERT_NE(x, c());
+    }
+    a.seed(7);
+    b.seed(7);
+    ASSERT_EQ(a(), b());
+}
+
+TEST(rand_gen, xoshiro256pp_uniform) {
+    Xoshiro256pp rng(0);
+    double sum = 0;
+    for (size_t i = 0; i < 10000; i++) {
+        auto u = rng.uniform();
+        ASSERT_GE(u, 0.0);
+        ASSERT_LT(u, 1.0);
+        sum += u;
+    }
+    ASSERT_NEAR(sum / 10000, 0.5, 0.02);
+}
+
+TEST(rand_gen, xoshiro256pp_fill_uniform) {
+    Xoshiro256pp a(3);
+    Xoshiro256pp b(3);
+    std::vector<double> buffer(1000);
+    a.fill_uniform(buffer.data(), buffer.size());
+    for (auto u : buffer) {
+        ASSERT_EQ(u, b.uniform());
+    }
+    ASSERT_EQ(a(), b());
+}
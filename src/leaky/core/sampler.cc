@@ -0,0 +1,602 @@
+#include "leaky/core/sampler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "leaky/core/branching.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/counters.h"
+#include "leaky/core/frame_simulator.h"
+#include "leaky/core/rand_gen.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/scheduler.h"
+#include "leaky/core/simulator.h"
+#include "stim.h"
+
+uint64_t leaky::derive_block_seed(uint64_t seed, uint64_t block_index) {
+    return leaky::splitmix64(seed ^ leaky::splitmix64(block_index));
+}
+
+static void sample_block(
+    leaky::Simulator &simulator,
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t num_measurements,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    const leaky::SimulatorSnapshot &prefix_snapshot,
+    const leaky::LeakageFreeTrajectory *trajectory,
+    uint8_t *results_ptr,
+    uint8_t *leakage_masks_ptr,
+    double *weights_ptr) {
+    for (size_t i = 0; i < shots; i++) {
+        LEAKY_COUNT(simulator.counters.num_shots++);
+        if (trajectory != nullptr) {
+            trajectory->sample_shot(simulator, compiled_circuit);
+        } else {
+            simulator.restore(prefix_snapshot);
+            simulator.do_compiled_circuit(compiled_circuit, compiled_circuit.num_prefix_operations);
+        }
+        simulator.append_measurement_record_into(results_ptr + i * num_measurements, readout_strategy);
+        if (leakage_masks_ptr != nullptr) {
+            std::copy(
+                simulator.leakage_masks_record.begin(),
+                simulator.leakage_masks_record.end(),
+                leakage_masks_ptr + i * num_measurements);
+        }
+        if (weights_ptr != nullptr) {
+            weights_ptr[i] = simulator.shot_weight;
+        }
+    }
+}
+
+static void sample_frame_block(
+    leaky::LeakyFrameSimulator &simulator,
+    const leaky::CompiledCircuit &compiled_circuit,
+    const stim::simd_bits<stim::MAX_BITWORD_WIDTH> &reference_sample,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint8_t *results_ptr,
+    uint8_t *leakage_masks_ptr,
+    double *weights_ptr) {
+    simulator.clear();
+    simulator.do_compiled_circuit(compiled_circuit);
+    simulator.append_measurement_records_into(results_ptr, reference_sample, shots, readout_strategy);
+    if (leakage_masks_ptr != nullptr) {
+        // From measurement-major to shot-major rows.
+        size_t num_measurements = compiled_circuit.num_measurements;
+        for (size_t m = 0; m < num_measurements; m++) {
+            const uint8_t *masks = simulator.leakage_masks_record.data() + m * simulator.batch_size;
+            for (size_t shot = 0; shot < shots; shot++) {
+                leakage_masks_ptr[shot * num_measurements + m] = masks[shot];
+            }
+        }
+    }
+    if (weights_ptr != nullptr) {
+        std::copy_n(simulator.shot_weights.begin(), shots, weights_ptr);
+    }
+}
+
+leaky::BlockSampler::BlockSampler(
+    std::vector<const CompiledCircuit *> circuits,
+    ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    Engine engine,
+    bool with_leakage_masks,
+    std::optional<bool> sparse_leakage)
+    : circuits(std::move(circuits)),
+      readout_strategy(readout_strategy),
+      seed(seed),
+      engine(engine),
+      with_leakage_masks(with_leakage_masks),
+      sparse_leakage(sparse_leakage),
+      reference_sample(0),
+      circuit_stats(),
+      trajectories(),
+      workers(),
+      pool(num_threads) {
+    const auto &compiled_circuit = *this->circuits[0];
+    if (engine == Engine::Frame) {
+        // O(num_qubits ** 2) bits and work per collapsing measurement, like a tableau shot, but
+        // once per job.
+        reference_sample =
+            stim::TableauSimulator<stim::MAX_BITWORD_WIDTH>::reference_sample_circuit(compiled_circuit.circuit);
+        circuit_stats = compiled_circuit.circuit.compute_stats();
+    }
+    if (engine == Engine::Branching) {
+        for (const auto *circuit : this->circuits) {
+            Simulator trajectory_simulator(compiled_circuit.num_qubits, seed);
+            trajectories.emplace_back(trajectory_simulator, *circuit);
+        }
+    }
+    workers.resize(pool.num_workers);
+}
+
+leaky::BlockSampler::BlockSampler(
+    const CompiledCircuit &compiled_circuit,
+    ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    Engine engine,
+    bool with_leakage_masks,
+    std::optional<bool> sparse_leakage)
+    : BlockSampler(
+          std::vector<const CompiledCircuit *>{&compiled_circuit},
+          readout_strategy,
+          seed,
+          num_threads,
+          engine,
+          with_leakage_masks,
+          sparse_leakage) {
+}
+
+void leaky::BlockSampler::run(
+    size_t num_items,
+    const std::function<BlockWork(size_t item)> &item_at,
+    uint8_t *results_ptr,
+    const BlockConsumer &consume,
+    SimulatorCounters *counters,
+    double *weights_ptr,
+    bool in_order) {
+    const auto &first_circuit = *circuits[0];
+    auto num_measurements = first_circuit.num_measurements;
+    size_t block_shots = shots_per_block(engine);
+    // Each worker owns its simulation state, together with its random engines, so reseeding them
+    // per block never disturbs the other workers. The state only covers the qubits of the circuit.
+    pool.run(
+        num_items,
+        [&](size_t worker, size_t item) {
+            auto work = item_at(item);
+            auto &state = workers[worker];
+            if (results_ptr == nullptr && state.records.empty()) {
+                state.records.resize(block_shots * num_measurements);
+            }
+            if (with_leakage_masks && state.leakage_masks.empty()) {
+                state.leakage_masks.resize(block_shots * num_measurements);
+            }
+            uint8_t *records_ptr =
+                results_ptr == nullptr ? state.records.data() : results_ptr + work.shot_begin * num_measurements;
+            uint8_t *masks_ptr = with_leakage_masks ? state.leakage_masks.data() : nullptr;
+            double *block_weights_ptr = weights_ptr == nullptr ? nullptr : weights_ptr + work.shot_begin;
+            uint64_t block_seed = derive_block_seed(seed, work.block);
+            if (engine == Engine::Frame) {
+                if (!state.frame_simulator.has_value()) {
+                    bool sparse = sparse_leakage.value_or(first_circuit.num_qubits >= SPARSE_LEAKAGE_MIN_QUBITS);
+                    state.frame_simulator.emplace(circuit_stats, block_shots, seed, sparse);
+                }
+                state.frame_simulator->set_seed(block_seed);
+                sample_frame_block(
+                    state.frame_simulator.value(),
+                    *circuits[work.circuit],
+                    reference_sample,
+                    work.shots,
+                    readout_strategy,
+                    records_ptr,
+                    masks_ptr,
+                    block_weights_ptr);
+            } else {
+                if (!state.simulator.has_value()) {
+                    // Every shot starts from the state after the deterministic prefix of the circuit,
+                    // which the variants of a circuit share.
+                    state.simulator.emplace(first_circuit.num_qubits, seed);
+                    state.simulator->clear();
+                    state.simulator->do_compiled_circuit(first_circuit, 0, first_circuit.num_prefix_operations);
+                    state.prefix_snapshot = state.simulator->snapshot();
+                }
+                state.simulator->set_seed(block_seed);
+                sample_block(
+                    state.simulator.value(),
+                    *circuits[work.circuit],
+                    num_measurements,
+                    work.shots,
+                    readout_strategy,
+                    state.prefix_snapshot.value(),
+                    trajectories.empty() ? nullptr : &trajectories[work.circuit],
+                    records_ptr,
+                    masks_ptr,
+                    block_weights_ptr);
+            }
+            if (consume) {
+                consume(work, records_ptr, masks_ptr);
+            }
+        },
+        in_order);
+    // The workers are idle between runs, so their counters can be read from here.
+    for (auto &state : workers) {
+        if (state.simulator.has_value()) {
+            if (counters != nullptr) {
+                counters->merge(state.simulator->counters);
+            }
+            state.simulator->counters.clear();
+        }
+    }
+}
+
+void leaky::BlockSampler::sample(
+    uint64_t first_block,
+    size_t shots,
+    uint8_t *results_ptr,
+    const BlockConsumer &consume,
+    SimulatorCounters *counters,
+    double *weights_ptr,
+    bool in_order) {
+    size_t block_shots = shots_per_block(engine);
+    size_t num_blocks = (shots + block_shots - 1) / block_shots;
+    run(
+        num_blocks,
+        [&](size_t k) {
+            size_t shot_begin = k * block_shots;
+            return BlockWork{0, first_block + k, shot_begin, std::min(block_shots, shots - shot_begin)};
+        },
+        results_ptr,
+        consume,
+        counters,
+        weights_ptr,
+        in_order);
+}
+
+void leaky::pack_measurement_records(
+    const uint8_t *records_ptr,
+    size_t num_shots,
+    size_t num_measurements,
+    uint8_t *bits_ptr,
+    uint8_t *leakage_flags_ptr) {
+    size_t row_bytes = (num_measurements + 7) / 8;
+    for (size_t shot = 0; shot < num_shots; shot++) {
+        const uint8_t *row = records_ptr + shot * num_measurements;
+        uint8_t *bits = bits_ptr + shot * row_bytes;
+        uint8_t *flags = leakage_flags_ptr == nullptr ? nullptr : leakage_flags_ptr + shot * row_bytes;
+        for (size_t byte = 0; byte < row_bytes; byte++) {
+            uint8_t packed_bits = 0;
+            uint8_t packed_flags = 0;
+            size_t m_end = std::min(num_measurements, byte * 8 + 8);
+            for (size_t m = byte * 8; m < m_end; m++) {
+                packed_bits |= (uint8_t)(row[m] == 1) << (m & 7);
+                packed_flags |= (uint8_t)(row[m] > 1) << (m & 7);
+            }
+            bits[byte] = packed_bits;
+            if (flags != nullptr) {
+                flags[byte] = packed_flags;
+            }
+        }
+    }
+}
+
+void leaky::write_measurement_records(
+    const uint8_t *records_ptr, size_t num_shots, size_t num_measurements, FILE *out, stim::SampleFormat format) {
+    // The stim writers start a new shot after every `write_end`.
+    auto writer = stim::MeasureRecordWriter::make(out, format);
+    for (size_t shot = 0; shot < num_shots; shot++) {
+        const uint8_t *row = records_ptr + shot * num_measurements;
+        for (size_t m = 0; m < num_measurements; m++) {
+            if (row[m] > 1) {
+                throw std::invalid_argument(
+                    "Leaked labels can not be written to a stim result format, use a leakage projection readout "
+                    "strategy instead.");
+            }
+            writer->write_bit(row[m]);
+        }
+        writer->write_end();
+    }
+}
+
+void leaky::sample_batch(
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint8_t *results_ptr,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    bool bit_packed,
+    uint8_t *leakage_flags_ptr,
+    uint64_t first_block,
+    leaky::SimulatorCounters *counters,
+    double *weights_ptr,
+    std::optional<bool> sparse_leakage) {
+    leaky::BlockSampler sampler(compiled_circuit, readout_strategy, seed, num_threads, engine, false, sparse_leakage);
+    if (!bit_packed) {
+        sampler.sample(first_block, shots, results_ptr, nullptr, counters, weights_ptr);
+        return;
+    }
+    auto num_measurements = compiled_circuit.num_measurements;
+    size_t row_bytes = (num_measurements + 7) / 8;
+    sampler.sample(
+        first_block,
+        shots,
+        nullptr,
+        [&](const leaky::BlockWork &work, const uint8_t *records_ptr, const uint8_t *) {
+            leaky::pack_measurement_records(
+                records_ptr,
+                work.shots,
+                num_measurements,
+                results_ptr + work.shot_begin * row_bytes,
+                leakage_flags_ptr == nullptr ? nullptr : leakage_flags_ptr + work.shot_begin * row_bytes);
+        },
+        counters,
+        weights_ptr);
+}
+
+void leaky::sample_detectors(
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint8_t *detections_ptr,
+    uint8_t *observables_ptr,
+    uint8_t *leakage_flags_ptr,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    leaky::SimulatorCounters *counters,
+    double *weights_ptr,
+    std::optional<bool> sparse_leakage) {
+    if (readout_strategy == leaky::ReadoutStrategy::RawLabel) {
+        throw std::invalid_argument(
+            "Detection events need measurement bits, use a leakage projection readout strategy instead.");
+    }
+    auto num_measurements = compiled_circuit.num_measurements;
+    size_t detector_bytes = (compiled_circuit.num_detectors + 7) / 8;
+    size_t observable_bytes = (compiled_circuit.num_observables + 7) / 8;
+    const auto &c = compiled_circuit;
+    leaky::BlockSampler sampler(
+        compiled_circuit, readout_strategy, seed, num_threads, engine, leakage_flags_ptr != nullptr, sparse_leakage);
+    sampler.sample(
+        0,
+        shots,
+        nullptr,
+        [&](const leaky::BlockWork &work, const uint8_t *records_ptr, const uint8_t *leakage_masks_ptr) {
+            size_t shot_begin = work.shot_begin;
+            for (size_t shot = 0; shot < work.shots; shot++) {
+                const uint8_t *record = records_ptr + shot * num_measurements;
+                uint8_t *detections = detections_ptr + (shot_begin + shot) * detector_bytes;
+                std::fill_n(detections, detector_bytes, 0);
+                for (size_t d = 0; d < c.num_detectors; d++) {
+                    uint8_t parity = 0;
+                    for (size_t k = c.detector_offsets[d]; k < c.detector_offsets[d + 1]; k++) {
+                        parity ^= record[c.detector_measurements[k]];
+                    }
+                    detections[d >> 3] |= (parity & 1) << (d & 7);
+                }
+                uint8_t *observables = observables_ptr + (shot_begin + shot) * observable_bytes;
+                std::fill_n(observables, observable_bytes, 0);
+                for (size_t o = 0; o < c.num_observables; o++) {
+                    uint8_t parity = 0;
+                    for (size_t k = c.observable_offsets[o]; k < c.observable_offsets[o + 1]; k++) {
+                        parity ^= record[c.observable_measurements[k]];
+                    }
+                    observables[o >> 3] |= (parity & 1) << (o & 7);
+                }
+                if (leakage_flags_ptr == nullptr) {
+                    continue;
+                }
+                const uint8_t *masks = leakage_masks_ptr + shot * num_measurements;
+                uint8_t *flags = leakage_flags_ptr + (shot_begin + shot) * detector_bytes;
+                std::fill_n(flags, detector_bytes, 0);
+                for (size_t d = 0; d < c.num_detectors; d++) {
+                    bool leaked = false;
+                    for (size_t k = c.detector_offsets[d]; k < c.detector_offsets[d + 1]; k++) {
+                        leaked |= masks[c.detector_measurements[k]] != 0;
+                    }
+                    flags[d >> 3] |= (uint8_t)leaked << (d & 7);
+                }
+            }
+        },
+        counters,
+        weights_ptr);
+}
+
+leaky::SampleStatistics leaky::sample_statistics(
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    uint64_t max_failures,
+    leaky::SimulatorCounters *counters,
+    std::optional<bool> sparse_leakage) {
+    const auto &c = compiled_circuit;
+    if (readout_strategy == leaky::ReadoutStrategy::RawLabel && c.num_observables > 0) {
+        throw std::invalid_argument(
+            "Observable flips need measurement bits, use a leakage projection readout strategy instead.");
+    }
+    auto num_measurements = c.num_measurements;
+    auto empty_statistics = [&]() {
+        return SampleStatistics{
+            0, std::vector<uint64_t>(num_measurements, 0), std::vector<uint64_t>(c.num_observables, 0), 0};
+    };
+    auto statistics = empty_statistics();
+    // Blocks are claimed in order and counted in order, so that early stopping lands on the same
+    // block whatever the number of threads. A block done before the ones preceding it waits in
+    // `pending`, and once the failures are reached no later block is claimed or counted.
+    std::mutex mutex;
+    std::map<uint64_t, SampleStatistics> pending;
+    uint64_t next_block = 0;
+    bool stopped = false;
+    leaky::BlockSampler sampler(compiled_circuit, readout_strategy, seed, num_threads, engine, true, sparse_leakage);
+    sampler.sample(
+        0,
+        shots,
+        nullptr,
+        [&](const leaky::BlockWork &work, const uint8_t *records_ptr, const uint8_t *leakage_masks_ptr) {
+            auto block = empty_statistics();
+            block.shots = work.shots;
+            for (size_t shot = 0; shot < work.shots; shot++) {
+                const uint8_t *record = records_ptr + shot * num_measurements;
+                const uint8_t *masks = leakage_masks_ptr + shot * num_measurements;
+                for (size_t m = 0; m < num_measurements; m++) {
+                    block.leaked_counts[m] += masks[m] != 0;
+                }
+                bool failed = false;
+                for (size_t o = 0; o < c.num_observables; o++) {
+                    uint8_t parity = 0;
+                    for (size_t k = c.observable_offsets[o]; k < c.observable_offsets[o + 1]; k++) {
+                        parity ^= record[c.observable_measurements[k]];
+                    }
+                    block.observable_flip_counts[o] += parity & 1;
+                    failed |= parity & 1;
+                }
+                block.num_failures += failed;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopped) {
+                return;
+            }
+            pending.emplace(work.block, std::move(block));
+            for (auto it = pending.begin(); it != pending.end() && it->first == next_block; it = pending.erase(it)) {
+                const auto &counted = it->second;
+                statistics.shots += counted.shots;
+                for (size_t m = 0; m < num_measurements; m++) {
+                    statistics.leaked_counts[m] += counted.leaked_counts[m];
+                }
+                for (size_t o = 0; o < c.num_observables; o++) {
+                    statistics.observable_flip_counts[o] += counted.observable_flip_counts[o];
+                }
+                statistics.num_failures += counted.num_failures;
+                if (max_failures != 0 && statistics.num_failures >= max_failures) {
+                    stopped = true;
+                    sampler.pool.stop_after(next_block);
+                    pending.clear();
+                    return;
+                }
+                next_block++;
+            }
+        },
+        counters,
+        nullptr,
+        true);
+    return statistics;
+}
+
+void leaky::sample_sweep(
+    const leaky::CompiledCircuit &compiled_circuit,
+    const std::vector<leaky::SweepVariant> &variants,
+    leaky::ReadoutStrategy readout_strategy,
+    uint8_t *results_ptr,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    leaky::SimulatorCounters *counters,
+    double *weights_ptr,
+    std::optional<bool> sparse_leakage) {
+    size_t shots_per_block = leaky::shots_per_block(engine);
+    // The work items are the blocks of all the variants, in order.
+    std::vector<leaky::CompiledCircuit> variant_circuits;
+    std::vector<leaky::BlockWork> items;
+    size_t results_shot = 0;
+    for (size_t v = 0; v < variants.size(); v++) {
+        variant_circuits.push_back(leaky::with_bound_channels(compiled_circuit, variants[v].bound_leaky_channels));
+        for (size_t shot = 0; shot < variants[v].shots; shot += shots_per_block) {
+            size_t block_shots = std::min(shots_per_block, variants[v].shots - shot);
+            items.push_back({v, shot / shots_per_block, results_shot + shot, block_shots});
+        }
+        results_shot += variants[v].shots;
+    }
+    if (items.empty()) {
+        return;
+    }
+    // The variants share the structure of the circuit, hence its reference sample and prefix.
+    std::vector<const leaky::CompiledCircuit *> circuits;
+    for (const auto &variant_circuit : variant_circuits) {
+        circuits.push_back(&variant_circuit);
+    }
+    leaky::BlockSampler sampler(
+        std::move(circuits), readout_strategy, seed, num_threads, engine, false, sparse_leakage);
+    sampler.run(
+        items.size(),
+        [&](size_t k) {
+            return items[k];
+        },
+        results_ptr,
+        nullptr,
+        counters,
+        weights_ptr);
+}
+
+size_t leaky::shots_per_block(leaky::Engine engine) {
+    return engine == leaky::Engine::Frame ? FRAME_SHOTS_PER_BLOCK : SHOTS_PER_BLOCK;
+}
+
+void leaky::sample_chunks(
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t chunk_shots,
+    const std::function<void(const uint8_t *records, size_t num_shots)> &consume,
+    size_t num_threads,
+    leaky::Engine engine,
+    uint64_t first_block,
+    std::optional<bool> sparse_leakage) {
+    size_t block_shots = leaky::shots_per_block(engine);
+    size_t blocks_per_chunk = std::max<size_t>((chunk_shots + block_shots - 1) / block_shots, 1);
+    chunk_shots = blocks_per_chunk * block_shots;
+    auto num_measurements = compiled_circuit.num_measurements;
+    size_t buffer_size = std::min(chunk_shots, shots) * num_measurements;
+    std::vector<uint8_t> buffers[2] = {std::vector<uint8_t>(buffer_size), std::vector<uint8_t>(buffer_size)};
+    // While chunk `k` is sampled into one buffer, chunk `k - 1` is consumed from the other one on
+    // a background thread.
+    std::future<void> pending;
+    // The workers and their setup are shared by the chunks.
+    leaky::BlockSampler sampler(compiled_circuit, readout_strategy, seed, num_threads, engine, false, sparse_leakage);
+    size_t k = 0;
+    for (size_t shot_begin = 0; shot_begin < shots; shot_begin += chunk_shots, k++) {
+        size_t n = std::min(chunk_shots, shots - shot_begin);
+        uint8_t *records = buffers[k % 2].data();
+        sampler.sample(first_block + k * blocks_per_chunk, n, records);
+        if (pending.valid()) {
+            pending.get();
+        }
+        pending = std::async(std::launch::async, [&consume, records, n]() {
+            consume(records, n);
+        });
+    }
+    if (pending.valid()) {
+        pending.get();
+    }
+}
+
+void leaky::sample_to_file(
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    FILE *out,
+    stim::SampleFormat format,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    std::optional<bool> sparse_leakage) {
+    if (readout_strategy == leaky::ReadoutStrategy::RawLabel) {
+        throw std::invalid_argument(
+            "Leaked labels can not be written to a stim result format, use a leakage projection readout strategy "
+            "instead.");
+    }
+    if (num_threads == 0) {
+        num_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    size_t chunk_shots = num_threads * BLOCKS_PER_THREAD_PER_CHUNK * leaky::shots_per_block(engine);
+    auto num_measurements = compiled_circuit.num_measurements;
+    leaky::sample_chunks(
+        compiled_circuit,
+        shots,
+        readout_strategy,
+        seed,
+        chunk_shots,
+        [out, num_measurements, format](const uint8_t *records, size_t num_shots) {
+            leaky::write_measurement_records(records, num_shots, num_measurements, out, format);
+        },
+        num_threads,
+        engine,
+        0,
+        sparse_leakage);
+}
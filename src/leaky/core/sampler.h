@@ -0,0 +1,365 @@
+#ifndef LEAKY_SAMPLER_H
+#define LEAKY_SAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "leaky/core/binding.h"
+#include "leaky/core/branching.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/counters.h"
+#include "leaky/core/frame_simulator.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/scheduler.h"
+#include "leaky/core/simulator.h"
+#include "stim.h"
+
+namespace leaky {
+
+/// Shots are cut into blocks of this size and block `k` is always simulated from the random
+/// stream derived from `(seed, k)`, so the samples do not depend on the number of threads.
+constexpr size_t SHOTS_PER_BLOCK = 256;
+/// The block size of the frame engine, which simulates a whole block at once.
+constexpr size_t FRAME_SHOTS_PER_BLOCK = 1024;
+/// Unless told otherwise, the frame engine keeps the leakage statuses of circuits of at least this
+/// many qubits sparse, see `LeakyFrameSimulator`.
+constexpr uint32_t SPARSE_LEAKAGE_MIN_QUBITS = 1024;
+/// `sample_to_file` samples and writes `num_threads * BLOCKS_PER_THREAD_PER_CHUNK` blocks per chunk.
+constexpr size_t BLOCKS_PER_THREAD_PER_CHUNK = 4;
+
+enum Engine : uint8_t {
+    /// One `Simulator` tableau simulation per shot.
+    Tableau,
+    /// A `LeakyFrameSimulator` sampling a whole block of shots per pass.
+    Frame,
+    /// The tableau simulations of `Simulator`, with the leakage- and error-free trajectory shared by
+    /// the shots, see `LeakageFreeTrajectory`. Same distribution as `Tableau`, but not the same samples.
+    Branching,
+};
+
+/**
+ * @brief The number of shots per block of an engine.
+ */
+size_t shots_per_block(Engine engine);
+
+/**
+ * @brief Derive the seed of the random stream used for the `block_index`-th block of shots.
+ */
+uint64_t derive_block_seed(uint64_t seed, uint64_t block_index);
+
+/// A work item of a `BlockSampler`: `shots` shots of `circuits[circuit]`, drawn from the random
+/// stream of block `block` and written at shot `shot_begin` of the results.
+struct BlockWork {
+    size_t circuit;
+    uint64_t block;
+    size_t shot_begin;
+    size_t shots;
+};
+
+/// Called on a worker thread with the records and, if requested, the leakage masks of a work item.
+typedef std::function<void(const BlockWork &work, const uint8_t *records_ptr, const uint8_t *leakage_masks_ptr)>
+    BlockConsumer;
+
+/// The simulation state of a worker of a `BlockSampler`, built by the worker for its first item.
+struct BlockWorkerState {
+    std::optional<Simulator> simulator;
+    /// The state after the deterministic prefix of the circuit, which every tableau shot starts from.
+    std::optional<SimulatorSnapshot> prefix_snapshot;
+    std::optional<LeakyFrameSimulator> frame_simulator;
+    /// The records and leakage masks of an item, when they are not written in place.
+    std::vector<uint8_t> records;
+    std::vector<uint8_t> leakage_masks;
+};
+
+/**
+ * @brief The state shared by the calls sampling one job: its worker threads and their simulators.
+ *
+ * The setup of a job is done once, when the sampler is built or by each worker for its first
+ * item: the reference sample of the frame engine, the leakage-free trajectories of the branching
+ * engine, the simulators of the workers and their prefix snapshots. Then every call to `run` or
+ * `sample` only samples, so a job sampled chunk by chunk costs the same as in one call.
+ *
+ * All the circuits must be variants of the first one differing only by their channels, see
+ * `with_bound_channels`, and must outlive the sampler.
+ */
+struct BlockSampler {
+    std::vector<const CompiledCircuit *> circuits;
+    ReadoutStrategy readout_strategy;
+    uint64_t seed;
+    Engine engine;
+    bool with_leakage_masks;
+    /// Whether the frame engine keeps the leakage statuses sparse, by default if the circuit has at
+    /// least `SPARSE_LEAKAGE_MIN_QUBITS` qubits. The samples are the same either way.
+    std::optional<bool> sparse_leakage;
+    /// The frames of the frame engine are relative to this noiseless sample of the first circuit.
+    stim::simd_bits<stim::MAX_BITWORD_WIDTH> reference_sample;
+    stim::CircuitStats circuit_stats;
+    /// With the branching engine, the trajectory of every circuit, shared read-only by the workers.
+    std::vector<LeakageFreeTrajectory> trajectories;
+    std::vector<BlockWorkerState> workers;
+    /// Last, so that its threads are joined before the state they use is destroyed.
+    WorkerPool pool;
+
+    /// Sample with `num_threads` worker threads, all the hardware threads if 0.
+    BlockSampler(
+        std::vector<const CompiledCircuit *> circuits,
+        ReadoutStrategy readout_strategy,
+        uint64_t seed,
+        size_t num_threads = 1,
+        Engine engine = Engine::Tableau,
+        bool with_leakage_masks = false,
+        std::optional<bool> sparse_leakage = std::nullopt);
+    BlockSampler(
+        const CompiledCircuit &compiled_circuit,
+        ReadoutStrategy readout_strategy,
+        uint64_t seed,
+        size_t num_threads = 1,
+        Engine engine = Engine::Tableau,
+        bool with_leakage_masks = false,
+        std::optional<bool> sparse_leakage = std::nullopt);
+
+    /**
+     * @brief Sample the work items `item_at(0), ..., item_at(num_items - 1)`.
+     *
+     * The records of each item are written in place in `results_ptr` if it is not null, and
+     * handed to `consume` from a per-worker buffer otherwise. Items are run like the items of
+     * `WorkerPool::run`, so `consume` may call `pool.stop_after` when `in_order`.
+     *
+     * @param counters If not null, the counters of the tableau workers over the run are added to it.
+     * @param weights_ptr If not null, receives the weights of the shots, like the records.
+     */
+    void run(
+        size_t num_items,
+        const std::function<BlockWork(size_t item)> &item_at,
+        uint8_t *results_ptr,
+        const BlockConsumer &consume = nullptr,
+        SimulatorCounters *counters = nullptr,
+        double *weights_ptr = nullptr,
+        bool in_order = false);
+    /// Sample the `shots` shots of the first circuit starting at block `first_block`, the shot
+    /// offsets of the items being relative to its first shot, see `run`.
+    void sample(
+        uint64_t first_block,
+        size_t shots,
+        uint8_t *results_ptr,
+        const BlockConsumer &consume = nullptr,
+        SimulatorCounters *counters = nullptr,
+        double *weights_ptr = nullptr,
+        bool in_order = false);
+};
+
+/**
+ * @brief Sample `shots` shots of a compiled circuit, whose channels are those it was compiled against.
+ *
+ * Shots are distributed block by block over `num_threads` worker threads (all hardware threads
+ * if 0), each owning its own simulation state and writing the rows of its blocks in place in
+ * `results_ptr`, which must hold `shots * compiled_circuit.num_measurements` bytes. Workers that
+ * run out of blocks steal from the others, see `BlockScheduler`, so shots made slow by leakage do
+ * not leave threads idle.
+ *
+ * Every shot starts with all qubits in |0> and none leaked. The worker states are sized by
+ * `compiled_circuit.num_qubits`, the qubits the circuit actually uses. The tableau and branching
+ * engines need O(num_qubits ** 2) bits per worker and O(num_qubits ** 2) work per collapsing
+ * measurement of every shot, so circuits beyond a few thousand qubits should use `Engine::Frame`.
+ * Its workers only need O(num_qubits) bits per shot of a block, but the noiseless reference
+ * sample its frames are relative to comes from a stim tableau simulation, with the same
+ * O(num_qubits ** 2) costs, once per call rather than per shot.
+ *
+ * @param bit_packed Write every row as `ceil(num_measurements / 8)` bytes of little-endian bits
+ *     instead, see `pack_measurement_records`.
+ * @param leakage_flags_ptr With `bit_packed`, an optional second plane receiving the leakage flags.
+ * @param first_block The index of the first block, so that a job can be sampled in several calls
+ *     with the same results as in one, as long as every call but the last samples whole blocks.
+ * @param counters If not null, the counters of the tableau engine workers are added to it, see
+ *     `SimulatorCounters`.
+ * @param weights_ptr If not null, receives the `shots` weights of the shots, which differ from 1
+ *     when the circuit was compiled with biased channels, see `with_leakage_bias`. Weighting the
+ *     shots by them gives unbiased estimates of the true distribution.
+ * @param sparse_leakage Whether the frame engine keeps the leakage statuses sparse, see
+ *     `BlockSampler::sparse_leakage`.
+ */
+void sample_batch(
+    const CompiledCircuit &compiled_circuit,
+    size_t shots,
+    ReadoutStrategy readout_strategy,
+    uint8_t *results_ptr,
+    uint64_t seed,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    bool bit_packed = false,
+    uint8_t *leakage_flags_ptr = nullptr,
+    uint64_t first_block = 0,
+    SimulatorCounters *counters = nullptr,
+    double *weights_ptr = nullptr,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/**
+ * @brief Sample the detection events and observable flips of a compiled circuit.
+ *
+ * The `DETECTOR` and `OBSERVABLE_INCLUDE` annotations are evaluated on the sampled records of
+ * each block, which must be projected onto bits by the readout strategy. Every shot writes a
+ * row of `ceil(num_detectors / 8)` bytes to `detections_ptr` and of `ceil(num_observables / 8)`
+ * bytes to `observables_ptr`, bit-packed like `pack_measurement_records`.
+ *
+ * @param leakage_flags_ptr If not null, receives rows shaped like the detection events, flagging
+ *     the detectors that include a measurement of a leaked qubit.
+ * @param counters Like for `sample_batch`.
+ * @param weights_ptr Like for `sample_batch`.
+ * @param sparse_leakage Like for `sample_batch`.
+ */
+void sample_detectors(
+    const CompiledCircuit &compiled_circuit,
+    size_t shots,
+    ReadoutStrategy readout_strategy,
+    uint8_t *detections_ptr,
+    uint8_t *observables_ptr,
+    uint8_t *leakage_flags_ptr,
+    uint64_t seed,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    SimulatorCounters *counters = nullptr,
+    double *weights_ptr = nullptr,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/// Counts aggregated over sampled shots, see `sample_statistics`.
+struct SampleStatistics {
+    uint64_t shots;
+    /// `leaked_counts[m]` shots measured a leaked qubit at measurement `m`.
+    std::vector<uint64_t> leaked_counts;
+    /// `observable_flip_counts[k]` shots flipped observable `k`.
+    std::vector<uint64_t> observable_flip_counts;
+    /// The shots that flipped at least one observable.
+    uint64_t num_failures;
+};
+
+/**
+ * @brief Sample shots like `sample_batch`, keeping only their counts.
+ *
+ * The records of every block are reduced as soon as they are sampled, so the memory used is
+ * O(num_measurements) per block in flight rather than O(shots * num_measurements). All the blocks
+ * are sampled by one `BlockSampler` in a single run. The readout strategy must project leaked
+ * measurements onto bits if the circuit has observables.
+ *
+ * @param max_failures If not 0, stop at the first block by the end of which `max_failures` shots
+ *     have failed. The blocks are claimed and counted in order, so the result does not depend on
+ *     `num_threads`, and no block after it is claimed once it is counted.
+ * @param counters Like for `sample_batch`.
+ * @param sparse_leakage Like for `sample_batch`.
+ */
+SampleStatistics sample_statistics(
+    const CompiledCircuit &compiled_circuit,
+    size_t shots,
+    ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    uint64_t max_failures = 0,
+    SimulatorCounters *counters = nullptr,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/// A variant of a sweep: the channels rebinding instructions of the compiled circuit, and the number of shots.
+struct SweepVariant {
+    BoundChannelMap bound_leaky_channels;
+    size_t shots;
+};
+
+/**
+ * @brief Sample several channel variants of one compiled circuit over a shared pool of workers.
+ *
+ * The circuit is compiled once, and the variants only swap its channels, see
+ * `with_bound_channels`. The blocks of all the variants are dealt to the workers together, so
+ * small variants do not leave threads idle. Every variant is sampled from the same block seeds,
+ * that is with common random numbers, which keeps the differences between variants low-noise.
+ *
+ * @param results_ptr The records of all the variants, one after another, each in the layout of
+ *     `sample_batch`. The records of a variant are those of `sample_batch` of its circuit with
+ *     the same seed.
+ * @param counters Like for `sample_batch`.
+ * @param weights_ptr If not null, receives the weights of the shots of all the variants, in the
+ *     order of their records, see `sample_batch`.
+ * @param sparse_leakage Like for `sample_batch`.
+ */
+void sample_sweep(
+    const CompiledCircuit &compiled_circuit,
+    const std::vector<SweepVariant> &variants,
+    ReadoutStrategy readout_strategy,
+    uint8_t *results_ptr,
+    uint64_t seed,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    SimulatorCounters *counters = nullptr,
+    double *weights_ptr = nullptr,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/**
+ * @brief Sample shots like `sample_batch` in chunks of bounded memory handed to `consume`.
+ *
+ * `chunk_shots` is rounded up to whole blocks, so the concatenated chunks are the same as the
+ * results of `sample_batch` with the same seed. The chunks share one `BlockSampler`, so the setup
+ * of the job and the worker threads are not repeated per chunk. The chunks are sampled into two
+ * reusable buffers: `consume` runs on a background thread on one chunk while the next one is
+ * sampled, and must be done with its `records` when it returns. Exceptions thrown by `consume`
+ * are rethrown to the caller.
+ *
+ * @param first_block Like for `sample_batch`, so that the chunks of a part of a job can be sampled.
+ * @param sparse_leakage Like for `sample_batch`.
+ */
+void sample_chunks(
+    const CompiledCircuit &compiled_circuit,
+    size_t shots,
+    ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t chunk_shots,
+    const std::function<void(const uint8_t *records, size_t num_shots)> &consume,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    uint64_t first_block = 0,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/**
+ * @brief Sample shots like `sample_batch` and write them to `out` in a stim result format.
+ *
+ * Shots are sampled with `sample_chunks`, so the memory used does not grow with `shots` and
+ * sampling does not wait on the writes. The readout strategy must project leaked measurements
+ * onto bits.
+ *
+ * @param sparse_leakage Like for `sample_batch`.
+ */
+void sample_to_file(
+    const CompiledCircuit &compiled_circuit,
+    size_t shots,
+    ReadoutStrategy readout_strategy,
+    FILE *out,
+    stim::SampleFormat format,
+    uint64_t seed,
+    size_t num_threads = 1,
+    Engine engine = Engine::Tableau,
+    std::optional<bool> sparse_leakage = std::nullopt);
+
+/**
+ * @brief Pack rows of per-measurement bytes into rows of `ceil(num_measurements / 8)` bytes.
+ *
+ * Measurement `m` of a shot goes to bit `m % 8` of byte `m / 8` of its row, in the layout of
+ * stim's `b8` format and numpy's `packbits(..., bitorder="little")`. `bits_ptr` receives the
+ * measurements equal to 1, and `leakage_flags_ptr`, if not null, the leaked (> 1) ones.
+ */
+void pack_measurement_records(
+    const uint8_t *records_ptr,
+    size_t num_shots,
+    size_t num_measurements,
+    uint8_t *bits_ptr,
+    uint8_t *leakage_flags_ptr = nullptr);
+
+/**
+ * @brief Write rows of 0/1 measurement bytes to `out` in a stim result format.
+ */
+void write_measurement_records(
+    const uint8_t *records_ptr, size_t num_shots, size_t num_measurements, FILE *out, stim::SampleFormat format);
+
+}  // namespace leaky
+
+#endif  // LEAKY_SAMPLER_H
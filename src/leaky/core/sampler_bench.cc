@@ -0,0 +1,78 @@
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/sampler.h"
+#include "leaky/core/simulator.h"
+#include "stim.h"
+
+using namespace leaky;
+
+static void BM_sample_batch_surface_code(benchmark::State &state) {
+    auto distance = (uint32_t)state.range(0);
+    auto engine = (Engine)state.range(1);
+    size_t shots = engine == Engine::Frame ? 16 * FRAME_SHOTS_PER_BLOCK : 4 * SHOTS_PER_BLOCK;
+    auto params = stim::CircuitGenParameters(distance, distance, "rotated_memory_z");
+    auto circuit = stim::generate_surface_code_circuit(params).circuit;
+    Simulator simulator(circuit.count_qubits(), 0);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.998);
+    channel.add_transition(0x00, 0x10, 0, 0.001);
+    channel.add_transition(0x00, 0x01, 0, 0.001);
+    auto flattened = circuit.flattened();
+    for (const auto &op : flattened.operations) {
+        if (op.gate_type == stim::GateType::CX) {
+            simulator.bind_leaky_channel(op, channel);
+        }
+    }
+    auto compiled = compile_circuit(circuit, simulator.bound_leaky_channels);
+    std::vector<uint8_t> results(shots * compiled.num_measurements);
+    uint64_t seed = 0;
+    for (auto _ : state) {
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, results.data(), seed++, 1, engine);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * shots);
+}
+BENCHMARK(BM_sample_batch_surface_code)
+    ->ArgNames({"d", "engine"})
+    ->ArgsProduct({{3, 5, 11}, {Engine::Tableau, Engine::Frame, Engine::Branching}})
+    ->Unit(benchmark::kMillisecond);
+
+/// The branching engine shares the whole of a flattened repetition code memory, whose noiseless
+/// measurements are all deterministic, so only the shots that leak or pick up an error branch off.
+static void BM_sample_batch_repetition_code(benchmark::State &state) {
+    auto distance = (uint32_t)state.range(0);
+    auto engine = (Engine)state.range(1);
+    size_t shots = 4 * SHOTS_PER_BLOCK;
+    auto params = stim::CircuitGenParameters(distance, distance, "memory");
+    params.after_clifford_depolarization = 1e-4;
+    params.before_round_data_depolarization = 1e-4;
+    auto circuit = stim::generate_rep_code_circuit(params).circuit.flattened();
+    Simulator simulator(circuit.count_qubits(), 0);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.9998);
+    channel.add_transition(0x00, 0x10, 0, 0.0001);
+    channel.add_transition(0x00, 0x01, 0, 0.0001);
+    for (const auto &op : circuit.operations) {
+        if (op.gate_type == stim::GateType::CX) {
+            simulator.bind_leaky_channel(op, channel);
+        }
+    }
+    auto compiled = compile_circuit(circuit, simulator.bound_leaky_channels);
+    std::vector<uint8_t> results(shots * compiled.num_measurements);
+    uint64_t seed = 0;
+    for (auto _ : state) {
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, results.data(), seed++, 1, engine);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(state.iterations() * shots);
+}
+BENCHMARK(BM_sample_batch_repetition_code)
+    ->ArgNames({"d", "engine"})
+    ->ArgsProduct({{5, 15, 25}, {Engine::Tableau, Engine::Branching}})
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,536 @@
+#include "leaky/core/sampler.h"
+
+#include <optional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/simulator.h"
+#include "stim/circuit/circuit.h"
+
+using namespace leaky;
+
+static std::vector<uint8_t> sample(
+    const Simulator& sim,
+    const stim::Circuit& circuit,
+    size_t shots,
+    uint64_t seed,
+    size_t num_threads,
+    Engine engine = Engine::Tableau) {
+    auto compiled = compile_circuit(circuit, sim.bound_leaky_channels);
+    std::vector<uint8_t> results(shots * compiled.num_measurements);
+    sample_batch(compiled, shots, ReadoutStrategy::RawLabel, results.data(), seed, num_threads, engine);
+    return results;
+}
+
+TEST(sampler, derive_block_seed) {
+    ASSERT_EQ(derive_block_seed(5, 0), derive_block_seed(5, 0));
+    ASSERT_NE(derive_block_seed(5, 0), derive_block_seed(5, 1));
+    ASSERT_NE(derive_block_seed(5, 0), derive_block_seed(6, 0));
+}
+
+TEST(sampler, sample_batch_leaky) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        auto results = sample(sim, stim::Circuit("X 0 1\nM 0 1"), 1000, 0, 3, engine);
+        ASSERT_EQ(results.size(), 2000);
+        for (size_t i = 0; i < 1000; i++) {
+            ASSERT_EQ(results[2 * i], 2);
+            ASSERT_EQ(results[2 * i + 1], 1);
+        }
+    }
+}
+
+TEST(sampler, sample_batch_independent_of_num_threads) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.5);
+    channel.add_transition(0x00, 0x10, 0, 0.25);
+    channel.add_transition(0x00, 0x00, 5, 0.25);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+    auto circuit = stim::Circuit("H 0\nCX 0 1\nM 0 1\nR 0 1\nH 0\nCX 0 1\nM 0 1");
+    size_t shots = 3 * SHOTS_PER_BLOCK + 17;
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        auto expected = sample(sim, circuit, shots, 12345, 1, engine);
+        for (size_t num_threads : {2, 3, 8}) {
+            ASSERT_EQ(sample(sim, circuit, shots, 12345, num_threads, engine), expected);
+        }
+        ASSERT_NE(sample(sim, circuit, shots, 54321, 1, engine), expected);
+    }
+}
+
+TEST(sampler, frame_engine_matches_tableau_engine_without_gates_on_leaked_qubits) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.7);
+    channel.add_transition(0x00, 0x00, 1, 0.1);
+    channel.add_transition(0x00, 0x01, 0, 0.2);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+    auto circuit = stim::Circuit("H 0\nCX 0 1\nM 0 1");
+    size_t shots = 20000;
+    auto tableau = sample(sim, circuit, shots, 1, 2, Engine::Tableau);
+    auto frame = sample(sim, circuit, shots, 1, 2, Engine::Frame);
+    auto count = [&](const std::vector<uint8_t>& results, uint8_t m0, uint8_t m1) {
+        size_t n = 0;
+        for (size_t i = 0; i < shots; i++) {
+            n += results[2 * i] == m0 && results[2 * i + 1] == m1;
+        }
+        return (double)n / shots;
+    };
+    // Bell pair, with an IX error 10% of the time and the target leaked 20% of the time.
+    for (const auto& results : {tableau, frame}) {
+        ASSERT_NEAR(count(results, 0, 0), 0.35, 0.02);
+        ASSERT_NEAR(count(results, 1, 1), 0.35, 0.02);
+        ASSERT_NEAR(count(results, 0, 1), 0.05, 0.01);
+        ASSERT_NEAR(count(results, 1, 0), 0.05, 0.01);
+        ASSERT_NEAR(count(results, 0, 2) + count(results, 1, 2), 0.2, 0.02);
+    }
+}
+
+TEST(sampler, engines_differ_on_gates_with_leaked_qubits) {
+    // The tableau engine skips a gate acting on a leaked qubit, while the frame engine gives its
+    // partners the random Pauli kickback of a maximally mixed qubit, see `LeakyFrameSimulator`.
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto circuit = stim::Circuit("X 0\nCX 0 1\nM 0 1");
+    size_t shots = 4000;
+    auto tableau = sample(sim, circuit, shots, 1, 2, Engine::Tableau);
+    auto frame = sample(sim, circuit, shots, 1, 2, Engine::Frame);
+    size_t frame_ones = 0;
+    for (size_t i = 0; i < shots; i++) {
+        ASSERT_EQ(tableau[2 * i], 2);
+        ASSERT_EQ(tableau[2 * i + 1], 0);
+        ASSERT_EQ(frame[2 * i], 2);
+        frame_ones += frame[2 * i + 1];
+    }
+    ASSERT_NEAR((double)frame_ones / shots, 0.5, 0.03);
+}
+
+TEST(sampler, sparse_leakage_option) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.5);
+    channel.add_transition(0x00, 0x10, 0, 0.25);
+    channel.add_transition(0x00, 0x00, 5, 0.25);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    sim.bind_leaky_channel({stim::GateType::CX, {}, targets}, channel);
+    auto circuit = stim::Circuit("H 0\nCX 0 1\nM 0 1\nR 0 1\nH 0\nCX 0 1\nM 0 1");
+    auto compiled = compile_circuit(circuit, sim.bound_leaky_channels);
+    size_t shots = FRAME_SHOTS_PER_BLOCK + 17;
+    auto run = [&](std::optional<bool> sparse_leakage) {
+        std::vector<uint8_t> results(shots * compiled.num_measurements);
+        sample_batch(
+            compiled,
+            shots,
+            ReadoutStrategy::RawLabel,
+            results.data(),
+            7,
+            2,
+            Engine::Frame,
+            false,
+            nullptr,
+            0,
+            nullptr,
+            nullptr,
+            sparse_leakage);
+        return results;
+    };
+    // The circuit is small, so the statuses are dense unless asked otherwise, with the same samples.
+    auto expected = run(std::nullopt);
+    ASSERT_EQ(run(true), expected);
+    ASSERT_EQ(run(false), expected);
+
+    BlockSampler sampler(compiled, ReadoutStrategy::RawLabel, 7, 1, Engine::Frame, false, true);
+    std::vector<uint8_t> results(shots * compiled.num_measurements);
+    sampler.sample(0, shots, results.data());
+    ASSERT_EQ(results, expected);
+    ASSERT_TRUE(sampler.workers[0].frame_simulator->sparse_leakage);
+}
+
+TEST(sampler, pack_measurement_records) {
+    std::vector<uint8_t> records{1, 0, 2, 1, 0, 0, 0, 0, 1, 3, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0};
+    std::vector<uint8_t> bits(4);
+    std::vector<uint8_t> flags(4);
+    pack_measurement_records(records.data(), 2, 10, bits.data(), flags.data());
+    ASSERT_EQ(bits, (std::vector<uint8_t>{0b00001001, 0b01, 0b00000000, 0b01}));
+    ASSERT_EQ(flags, (std::vector<uint8_t>{0b00000100, 0b10, 0b00000000, 0b00}));
+}
+
+TEST(sampler, sample_batch_bit_packed) {
+    Simulator sim(10);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(9)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 9\nM 0 1 2 3 4 5 6 7 8 9"), sim.bound_leaky_channels);
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        size_t shots = SHOTS_PER_BLOCK + 3;
+        std::vector<uint8_t> bits(shots * 2);
+        std::vector<uint8_t> flags(shots * 2);
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, bits.data(), 7, 2, engine, true, flags.data());
+        for (size_t s = 0; s < shots; s++) {
+            ASSERT_EQ(bits[2 * s], 1);
+            ASSERT_EQ(bits[2 * s + 1], 0);
+            ASSERT_EQ(flags[2 * s], 0);
+            ASSERT_EQ(flags[2 * s + 1], 0b10);
+        }
+    }
+}
+
+TEST(sampler, sample_batch_first_block) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 1, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("H 0\nCX 0 1\nM 0 1"), sim.bound_leaky_channels);
+    size_t shots = 3 * SHOTS_PER_BLOCK + 5;
+    std::vector<uint8_t> whole(shots * 2);
+    sample_batch(compiled, shots, ReadoutStrategy::RawLabel, whole.data(), 9, 2);
+    std::vector<uint8_t> chunked(shots * 2);
+    size_t head = 2 * SHOTS_PER_BLOCK;
+    sample_batch(compiled, head, ReadoutStrategy::RawLabel, chunked.data(), 9);
+    sample_batch(
+        compiled,
+        shots - head,
+        ReadoutStrategy::RawLabel,
+        chunked.data() + head * 2,
+        9,
+        1,
+        Engine::Tableau,
+        false,
+        nullptr,
+        2);
+    ASSERT_EQ(whole, chunked);
+}
+
+TEST(sampler, block_sampler_reused_across_calls) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 1, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("H 0\nCX 0 1\nM 0 1"), sim.bound_leaky_channels);
+    for (auto engine : {Engine::Tableau, Engine::Frame, Engine::Branching}) {
+        size_t block_shots = shots_per_block(engine);
+        size_t shots = 5 * block_shots + 3;
+        std::vector<uint8_t> expected(shots * 2);
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, expected.data(), 4, 3, engine);
+        // One sampler, hence one setup and one set of threads, for calls of 1, 2 and 2 blocks.
+        BlockSampler sampler(compiled, ReadoutStrategy::RawLabel, 4, 3, engine);
+        std::vector<uint8_t> results(shots * 2);
+        sampler.sample(0, block_shots, results.data());
+        sampler.sample(1, 2 * block_shots, results.data() + block_shots * 2);
+        sampler.sample(3, shots - 3 * block_shots, results.data() + 3 * block_shots * 2);
+        ASSERT_EQ(results, expected);
+    }
+}
+
+TEST(sampler, sample_chunks_match_sample_batch) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 1, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::H, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("H 0\nCX 0 1\nM 0 1"), sim.bound_leaky_channels);
+    size_t shots = 5 * SHOTS_PER_BLOCK + 5;
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        std::vector<uint8_t> expected(shots * 2);
+        sample_batch(compiled, shots, ReadoutStrategy::RawLabel, expected.data(), 3, 2, engine);
+        std::vector<uint8_t> streamed;
+        std::vector<size_t> chunk_sizes;
+        sample_chunks(
+            compiled,
+            shots,
+            ReadoutStrategy::RawLabel,
+            3,
+            SHOTS_PER_BLOCK + 1,
+            [&](const uint8_t *records, size_t num_shots) {
+                streamed.insert(streamed.end(), records, records + num_shots * 2);
+                chunk_sizes.push_back(num_shots);
+            },
+            2,
+            engine);
+        ASSERT_EQ(streamed, expected);
+        ASSERT_EQ(chunk_sizes.front() % shots_per_block(engine), 0);
+    }
+}
+
+TEST(sampler, sample_detectors) {
+    // Detector 0 compares two copies of a random bit, detector 1 watches the leaky qubit 2.
+    Simulator sim(3);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(2)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(
+        stim::Circuit("H 0\nCX 0 1\nX 2\nM 0 1 2\nDETECTOR rec[-2] rec[-3]\nDETECTOR rec[-1]\n"
+                      "OBSERVABLE_INCLUDE(0) rec[-3]"),
+        sim.bound_leaky_channels);
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        size_t shots = 1000;
+        std::vector<uint8_t> detections(shots);
+        std::vector<uint8_t> observables(shots);
+        std::vector<uint8_t> flags(shots);
+        sample_detectors(
+            compiled,
+            shots,
+            ReadoutStrategy::DeterministicLeakageProjection,
+            detections.data(),
+            observables.data(),
+            flags.data(),
+            11,
+            2,
+            engine);
+        size_t flips = 0;
+        for (size_t s = 0; s < shots; s++) {
+            // The leaked qubit always reads 1.
+            ASSERT_EQ(detections[s], 0b10);
+            ASSERT_EQ(flags[s], 0b10);
+            flips += observables[s];
+        }
+        ASSERT_TRUE(400 < flips && flips < 600);
+    }
+    std::vector<uint8_t> buffer(10);
+    ASSERT_THROW(
+        sample_detectors(
+            compiled, 10, ReadoutStrategy::RawLabel, buffer.data(), buffer.data(), nullptr, 0),
+        std::invalid_argument);
+}
+
+TEST(sampler, counters) {
+    if (!COUNTERS_ENABLED) {
+        GTEST_SKIP();
+    }
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nTICK\nM 0 1"), sim.bound_leaky_channels);
+    size_t shots = 2 * SHOTS_PER_BLOCK + 3;
+    std::vector<uint8_t> results(shots * 2);
+    SimulatorCounters counters;
+    sample_batch(
+        compiled,
+        shots,
+        ReadoutStrategy::RawLabel,
+        results.data(),
+        0,
+        2,
+        Engine::Tableau,
+        false,
+        nullptr,
+        0,
+        &counters);
+    ASSERT_EQ(counters.num_shots, shots);
+    ASSERT_EQ(counters.channel_samples[compiled.channel_keys[0]], shots);
+    ASSERT_EQ(counters.transitions[TransitionType::R] + counters.transitions[TransitionType::U], shots);
+    size_t num_leaked = 0;
+    for (size_t i = 0; i < shots; i++) {
+        num_leaked += results[2 * i] == 2;
+    }
+    ASSERT_EQ(counters.leaked_qubits_per_layer, (std::vector<uint64_t>{num_leaked}));
+}
+
+TEST(sampler, leakage_bias_weights) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.99);
+    channel.add_transition(0, 1, 0, 0.01);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nM 0 1"), sim.bound_leaky_channels);
+    auto biased = with_leakage_bias(compiled, 50);
+    size_t shots = 20000;
+    std::vector<uint8_t> results(shots * 2);
+    std::vector<double> weights(shots);
+    for (auto engine : {Engine::Tableau, Engine::Frame}) {
+        sample_batch(
+            compiled,
+            shots,
+            ReadoutStrategy::RawLabel,
+            results.data(),
+            0,
+            2,
+            engine,
+            false,
+            nullptr,
+            0,
+            nullptr,
+            weights.data());
+        for (double weight : weights) {
+            ASSERT_EQ(weight, 1.0);
+        }
+        sample_batch(
+            biased,
+            shots,
+            ReadoutStrategy::RawLabel,
+            results.data(),
+            0,
+            2,
+            engine,
+            false,
+            nullptr,
+            0,
+            nullptr,
+            weights.data());
+        size_t num_leaked = 0;
+        double weighted_leaked = 0;
+        double total_weight = 0;
+        for (size_t i = 0; i < shots; i++) {
+            bool leaked = results[2 * i] == 2;
+            num_leaked += leaked;
+            weighted_leaked += leaked * weights[i];
+            total_weight += weights[i];
+            ASSERT_EQ(weights[i], leaked ? biased.channels[0].leakage_likelihood_ratio
+                                         : biased.channels[0].retention_likelihood_ratio);
+        }
+        // A third of the shots leak, and weighting them recovers the true leakage rate.
+        ASSERT_NEAR(num_leaked / (double)shots, 0.5 / 1.49, 0.02);
+        ASSERT_NEAR(weighted_leaked / shots, 0.01, 0.001);
+        ASSERT_NEAR(total_weight / shots, 1.0, 0.02);
+    }
+}
+
+TEST(sampler, sample_statistics) {
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    sim.bind_leaky_channel({stim::GateType::X, {}, targets}, channel);
+    size_t shots = 3 * SHOTS_PER_BLOCK + 5;
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nM 0 1"), sim.bound_leaky_channels);
+    auto results = sample(sim, compiled.circuit, shots, 3, 2);
+    auto statistics = sample_statistics(compiled, shots, ReadoutStrategy::RawLabel, 3, 2);
+    uint64_t num_leaked = 0;
+    for (size_t i = 0; i < shots; i++) {
+        num_leaked += results[2 * i] == 2;
+    }
+    ASSERT_EQ(statistics.shots, shots);
+    ASSERT_EQ(statistics.leaked_counts, (std::vector<uint64_t>{num_leaked, 0}));
+    ASSERT_EQ(statistics.num_failures, 0);
+
+    auto with_observable =
+        compile_circuit(stim::Circuit("H 0\nM 0\nOBSERVABLE_INCLUDE(0) rec[-1]"), sim.bound_leaky_channels);
+    ASSERT_THROW(sample_statistics(with_observable, 10, ReadoutStrategy::RawLabel, 0), std::invalid_argument);
+    shots = 100 * SHOTS_PER_BLOCK;
+    auto stopped = sample_statistics(
+        with_observable, shots, ReadoutStrategy::RandomLeakageProjection, 5, 1, Engine::Tableau, 1000);
+    // About half of the shots fail, so the sampling stops after a few whole blocks.
+    ASSERT_EQ(stopped.shots % SHOTS_PER_BLOCK, 0);
+    ASSERT_LT(stopped.shots, shots);
+    ASSERT_GE(stopped.num_failures, 1000);
+    ASSERT_EQ(stopped.num_failures, stopped.observable_flip_counts[0]);
+    for (size_t num_threads : {2, 3}) {
+        auto threaded = sample_statistics(
+            with_observable, shots, ReadoutStrategy::RandomLeakageProjection, 5, num_threads, Engine::Tableau,
+            1000);
+        ASSERT_EQ(threaded.shots, stopped.shots);
+        ASSERT_EQ(threaded.num_failures, stopped.num_failures);
+    }
+    std::vector<uint8_t> bits(stopped.shots);
+    sample_batch(with_observable, stopped.shots, ReadoutStrategy::RandomLeakageProjection, bits.data(), 5, 1);
+    uint64_t flips = 0;
+    uint64_t flips_before_last_block = 0;
+    for (size_t i = 0; i < stopped.shots; i++) {
+        flips += bits[i];
+        flips_before_last_block += i < stopped.shots - SHOTS_PER_BLOCK ? bits[i] : 0;
+    }
+    ASSERT_EQ(flips, stopped.num_failures);
+    ASSERT_LT(flips_before_last_block, 1000);
+}
+
+TEST(sampler, sample_sweep_matches_sample_batch) {
+    Simulator sim(2);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    stim::CircuitInstruction x0{stim::GateType::X, {}, targets};
+    auto leaky_x = [](double p) {
+        LeakyPauliChannel channel(true);
+        channel.add_transition(0, 0, 0, 1 - p);
+        channel.add_transition(0, 1, 0, p);
+        return channel;
+    };
+    sim.bind_leaky_channel(x0, leaky_x(0.5));
+    auto compiled = compile_circuit(stim::Circuit("H 1\nX 0 1\nM 0 1"), sim.bound_leaky_channels);
+    std::vector<SweepVariant> variants(3);
+    bind_leaky_channel(variants[0].bound_leaky_channels, x0, leaky_x(0.1));
+    variants[0].shots = 2 * SHOTS_PER_BLOCK + 7;
+    // No rebinding samples the compiled channels.
+    variants[1].shots = 5;
+    bind_leaky_channel(variants[2].bound_leaky_channels, x0, leaky_x(0.9));
+    variants[2].shots = SHOTS_PER_BLOCK;
+    size_t total_shots = variants[0].shots + variants[1].shots + variants[2].shots;
+    for (auto engine : {Engine::Tableau, Engine::Frame, Engine::Branching}) {
+        std::vector<uint8_t> expected;
+        for (const auto &variant : variants) {
+            auto variant_circuit = with_bound_channels(compiled, variant.bound_leaky_channels);
+            std::vector<uint8_t> results(variant.shots * 2);
+            sample_batch(variant_circuit, variant.shots, ReadoutStrategy::RawLabel, results.data(), 13, 2, engine);
+            expected.insert(expected.end(), results.begin(), results.end());
+        }
+        for (size_t num_threads : {1, 4}) {
+            std::vector<uint8_t> results(total_shots * 2);
+            sample_sweep(compiled, variants, ReadoutStrategy::RawLabel, results.data(), 13, num_threads, engine);
+            ASSERT_EQ(results, expected);
+        }
+    }
+}
+
+TEST(sampler, sample_sweep_weights_match_sample_batch) {
+    Simulator sim(2);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0)};
+    stim::CircuitInstruction x0{stim::GateType::X, {}, targets};
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.9);
+    channel.add_transition(0, 1, 0, 0.1);
+    sim.bind_leaky_channel(x0, channel);
+    auto compiled = compile_circuit(stim::Circuit("X 0 1\nM 0 1"), sim.bound_leaky_channels);
+    std::vector<SweepVariant> variants(2);
+    bind_leaky_channel(variants[0].bound_leaky_channels, x0, channel.with_leakage_bias(4));
+    variants[0].shots = SHOTS_PER_BLOCK + 3;
+    bind_leaky_channel(variants[1].bound_leaky_channels, x0, channel.with_leakage_bias(2));
+    variants[1].shots = 2 * SHOTS_PER_BLOCK;
+    std::vector<double> expected;
+    for (const auto &variant : variants) {
+        auto variant_circuit = with_bound_channels(compiled, variant.bound_leaky_channels);
+        std::vector<uint8_t> results(variant.shots * 2);
+        std::vector<double> weights(variant.shots);
+        sample_batch(
+            variant_circuit,
+            variant.shots,
+            ReadoutStrategy::RawLabel,
+            results.data(),
+            13,
+            2,
+            Engine::Tableau,
+            false,
+            nullptr,
+            0,
+            nullptr,
+            weights.data());
+        expected.insert(expected.end(), weights.begin(), weights.end());
+    }
+    std::vector<uint8_t> results(expected.size() * 2);
+    std::vector<double> weights(expected.size());
+    sample_sweep(
+        compiled, variants, ReadoutStrategy::RawLabel, results.data(), 13, 3, Engine::Tableau, nullptr, weights.data());
+    ASSERT_EQ(weights, expected);
+}
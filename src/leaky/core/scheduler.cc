@@ -0,0 +1,176 @@
+#include "leaky/core/scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+static uint64_t pack_range(uint64_t begin, uint64_t end) {
+    return begin << 32 | end;
+}
+
+static uint64_t range_begin(uint64_t range) {
+    return range >> 32;
+}
+
+static uint64_t range_end(uint64_t range) {
+    return range & 0xFFFFFFFF;
+}
+
+leaky::BlockScheduler::BlockScheduler(size_t num_blocks, size_t num_workers) : ranges(num_workers) {
+    if (num_blocks > 0xFFFFFFFF) {
+        throw std::invalid_argument("Too many blocks to schedule.");
+    }
+    for (size_t w = 0; w < num_workers; w++) {
+        ranges[w].store(pack_range(w * num_blocks / num_workers, (w + 1) * num_blocks / num_workers));
+    }
+}
+
+bool leaky::BlockScheduler::next_block(size_t worker, size_t &block) {
+    auto &own = ranges[worker];
+    uint64_t range = own.load();
+    while (range_begin(range) < range_end(range)) {
+        if (own.compare_exchange_weak(range, pack_range(range_begin(range) + 1, range_end(range)))) {
+            block = range_begin(range);
+            return true;
+        }
+    }
+    // Blocks only move from range to range, so a worker finding nothing to steal can stop: blocks
+    // in flight between two ranges are sampled by the worker receiving them.
+    while (true) {
+        size_t victim = worker;
+        uint64_t victim_range = 0;
+        uint64_t largest = 0;
+        for (size_t k = 1; k < ranges.size(); k++) {
+            size_t w = (worker + k) % ranges.size();
+            uint64_t r = ranges[w].load();
+            if (range_begin(r) < range_end(r) && range_end(r) - range_begin(r) > largest) {
+                victim = w;
+                victim_range = r;
+                largest = range_end(r) - range_begin(r);
+            }
+        }
+        if (largest == 0) {
+            return false;
+        }
+        uint64_t stolen = (largest + 1) / 2;
+        uint64_t stolen_begin = range_end(victim_range) - stolen;
+        if (ranges[victim].compare_exchange_strong(
+                victim_range, pack_range(range_begin(victim_range), stolen_begin))) {
+            // The first stolen block is sampled right away, the others are left to be stolen back.
+            own.store(pack_range(stolen_begin + 1, range_end(victim_range)));
+            block = stolen_begin;
+            return true;
+        }
+    }
+}
+
+leaky::WorkerPool::WorkerPool(size_t num_workers)
+    : num_workers(num_workers == 0 ? std::max<size_t>(std::thread::hardware_concurrency(), 1) : num_workers),
+      threads(),
+      run_mutex(),
+      mutex(),
+      changed(),
+      generation(0),
+      num_busy(0),
+      stopping(false),
+      work(nullptr),
+      scheduler(),
+      next_item(0),
+      end_item(0),
+      errors() {
+}
+
+leaky::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void leaky::WorkerPool::run(
+    size_t num_items, const std::function<void(size_t worker, size_t item)> &work, bool in_order) {
+    if (num_items == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> running(run_mutex);
+    std::unique_lock<std::mutex> lock(mutex);
+    // New threads wait for the lock, then join this run.
+    while (threads.size() < std::min(num_workers, num_items)) {
+        threads.emplace_back(&WorkerPool::work_loop, this, threads.size());
+    }
+    this->work = &work;
+    if (in_order) {
+        scheduler.reset();
+    } else {
+        scheduler.emplace(num_items, threads.size());
+    }
+    next_item.store(0);
+    end_item.store(num_items);
+    errors.assign(threads.size(), nullptr);
+    num_busy = threads.size();
+    generation++;
+    changed.notify_all();
+    changed.wait(lock, [this]() { return num_busy == 0; });
+    this->work = nullptr;
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void leaky::WorkerPool::stop_after(size_t item) {
+    size_t end = end_item.load();
+    while (item + 1 < end && !end_item.compare_exchange_weak(end, item + 1)) {
+    }
+}
+
+bool leaky::WorkerPool::claim(size_t worker, size_t &item) {
+    if (scheduler.has_value()) {
+        while (scheduler->next_block(worker, item)) {
+            if (item < end_item.load()) {
+                return true;
+            }
+        }
+        return false;
+    }
+    item = next_item.fetch_add(1);
+    return item < end_item.load();
+}
+
+void leaky::WorkerPool::work_loop(size_t worker) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        lock.unlock();
+        try {
+            size_t item;
+            while (claim(worker, item)) {
+                (*work)(worker, item);
+            }
+        } catch (...) {
+            errors[worker] = std::current_exception();
+            end_item.store(0);
+        }
+        lock.lock();
+        if (--num_busy == 0) {
+            changed.notify_all();
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef LEAKY_SCHEDULER_H
+#define LEAKY_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace leaky {
+
+/**
+ * @brief Deals the blocks `[0, num_blocks)` of a job to worker threads with work stealing.
+ *
+ * Every worker starts with a contiguous range of blocks, taken from the front. A worker whose
+ * range runs out steals the back half of the largest range left, so workers held up by costly
+ * shots, e.g. with many leaked qubits, do not leave the others idle. Which worker samples a block
+ * never changes its results, as long as the block draws its random numbers from its own index.
+ */
+struct BlockScheduler {
+    /// The range `[begin, end)` of every worker, packed as `begin << 32 | end`.
+    std::vector<std::atomic<uint64_t>> ranges;
+
+    BlockScheduler(size_t num_blocks, size_t num_workers);
+
+    /**
+     * @brief Take the next block for `worker`.
+     *
+     * @return Whether a block was left, in which case it is written to `block`.
+     */
+    bool next_block(size_t worker, size_t &block);
+};
+
+/**
+ * @brief Worker threads kept across the runs of a job, so that sampling it in several calls, e.g.
+ * chunk by chunk, starts them once.
+ *
+ * Threads are started on demand, up to `num_workers` and never more than the items of a run, and
+ * wait between runs. Calls to `run` are serialized.
+ */
+struct WorkerPool {
+    size_t num_workers;
+    std::vector<std::thread> threads;
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable changed;
+    /// Incremented by every run, so waiting workers know there is a new one.
+    uint64_t generation;
+    /// The workers that did not finish the current run yet.
+    size_t num_busy;
+    bool stopping;
+    /// The current run: `work(worker, item)` is called for the items below `end_item`, taken
+    /// from `scheduler`, or in increasing order from `next_item` if it is empty.
+    const std::function<void(size_t worker, size_t item)> *work;
+    std::optional<BlockScheduler> scheduler;
+    std::atomic<size_t> next_item;
+    std::atomic<size_t> end_item;
+    std::vector<std::exception_ptr> errors;
+
+    /// Use all the hardware threads if `num_workers` is 0.
+    explicit WorkerPool(size_t num_workers);
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+    ~WorkerPool();
+
+    /**
+     * @brief Call `work(worker, item)` for every item of `[0, num_items)` and wait for them.
+     *
+     * `worker` is the index of the calling thread, below `num_workers`, so that `work` can keep
+     * per-worker state from run to run. Items are dealt with work stealing, see `BlockScheduler`,
+     * or claimed one at a time in increasing order if `in_order`. The first exception thrown by
+     * `work` stops the run and is rethrown.
+     */
+    void run(size_t num_items, const std::function<void(size_t worker, size_t item)> &work, bool in_order = false);
+    /// Stop the current run once the items up to `item`, included, are claimed.
+    void stop_after(size_t item);
+
+   private:
+    bool claim(size_t worker, size_t &item);
+    void work_loop(size_t worker);
+};
+
+}  // namespace leaky
+
+#endif  // LEAKY_SCHEDULER_H
@@ -0,0 +1,118 @@
+#include "leaky/core/scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace leaky;
+
+TEST(scheduler, single_worker_takes_blocks_in_order) {
+    BlockScheduler scheduler(5, 1);
+    std::vector<size_t> blocks;
+    size_t block;
+    while (scheduler.next_block(0, block)) {
+        blocks.push_back(block);
+    }
+    ASSERT_EQ(blocks, (std::vector<size_t>{0, 1, 2, 3, 4}));
+}
+
+TEST(scheduler, idle_workers_steal) {
+    BlockScheduler scheduler(8, 2);
+    size_t block;
+    // Worker 1 steals the back half of the 4 blocks left to worker 0.
+    for (size_t expected : {4, 5, 6, 7, 2, 3}) {
+        ASSERT_TRUE(scheduler.next_block(1, block));
+        ASSERT_EQ(block, expected);
+    }
+    for (size_t expected : {0, 1}) {
+        ASSERT_TRUE(scheduler.next_block(0, block));
+        ASSERT_EQ(block, expected);
+    }
+    ASSERT_FALSE(scheduler.next_block(0, block));
+    ASSERT_FALSE(scheduler.next_block(1, block));
+}
+
+TEST(scheduler, every_block_taken_once) {
+    size_t num_blocks = 10000;
+    size_t num_workers = 4;
+    BlockScheduler scheduler(num_blocks, num_workers);
+    std::vector<std::atomic<int>> taken(num_blocks);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < num_workers; w++) {
+        threads.emplace_back([&, w]() {
+            size_t block;
+            while (scheduler.next_block(w, block)) {
+                taken[block]++;
+                // Worker 0 is slow, so the others steal from it.
+                if (w == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    ASSERT_TRUE(std::all_of(taken.begin(), taken.end(), [](const std::atomic<int> &t) { return t == 1; }));
+}
+
+TEST(scheduler, worker_pool_runs_every_item_once) {
+    WorkerPool pool(4);
+    std::vector<std::atomic<int>> taken(1000);
+    std::atomic<bool> valid_workers = true;
+    // The threads are started by the first run and reused by the next ones.
+    for (size_t run = 0; run < 3; run++) {
+        pool.run(taken.size(), [&](size_t worker, size_t item) {
+            valid_workers = valid_workers && worker < 4;
+            taken[item]++;
+        });
+        ASSERT_EQ(pool.threads.size(), 4);
+    }
+    ASSERT_TRUE(valid_workers);
+    ASSERT_TRUE(std::all_of(taken.begin(), taken.end(), [](const std::atomic<int> &t) { return t == 3; }));
+    // Never more threads than items.
+    WorkerPool small(8);
+    small.run(2, [](size_t, size_t) {});
+    ASSERT_EQ(small.threads.size(), 2);
+}
+
+TEST(scheduler, worker_pool_stops_in_order) {
+    WorkerPool pool(3);
+    std::vector<std::atomic<int>> taken(10000);
+    pool.run(
+        taken.size(),
+        [&](size_t, size_t item) {
+            taken[item]++;
+            if (item == 100) {
+                pool.stop_after(100);
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        },
+        true);
+    // The items are claimed in order, so all those up to the stop are run, and few after it.
+    ASSERT_TRUE(std::all_of(taken.begin(), taken.begin() + 101, [](const std::atomic<int> &t) { return t == 1; }));
+    ASSERT_LT(std::count(taken.begin(), taken.end(), 1), 1000);
+}
+
+TEST(scheduler, worker_pool_rethrows) {
+    WorkerPool pool(2);
+    ASSERT_THROW(
+        pool.run(
+            100,
+            [](size_t, size_t item) {
+                if (item == 42) {
+                    throw std::invalid_argument("item 42");
+                }
+            }),
+        std::invalid_argument);
+    // The pool is still usable after an error.
+    std::atomic<size_t> count = 0;
+    pool.run(100, [&](size_t, size_t) { count++; });
+    ASSERT_EQ(count, 100);
+}
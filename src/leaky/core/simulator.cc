@@ -1,75 +1,105 @@
 #include "leaky/core/simulator.h"
 
+#include <algorithm>
 #include <cstddef>
-#include <functional>
+#include <cstring>
 #include <iostream>
 #include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "leaky/core/binding.h"
 #include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/counters.h"
 #include "leaky/core/rand_gen.h"
 #include "leaky/core/readout_strategy.h"
 #include "stim.h"
 
 using stim::GateType;
 
-leaky::Simulator::Simulator(uint32_t num_qubits)
+leaky::Simulator::Simulator(uint32_t num_qubits) : Simulator(num_qubits, leaky::draw_seed()) {
+}
+
+leaky::Simulator::Simulator(uint32_t num_qubits, uint64_t seed)
     : num_qubits(num_qubits),
       leakage_status(num_qubits, 0),
+      num_leaked_qubits(0),
       leakage_masks_record(0),
-      tableau_simulator(std::mt19937_64(leaky::global_urng()), num_qubits),
-      bound_leaky_channels({}) {
+      tableau_simulator(std::mt19937_64(leaky::splitmix64(seed)), num_qubits),
+      bound_leaky_channels({}),
+      rng(seed),
+      shot_weight(1.0),
+      counters() {
+}
+
+void leaky::Simulator::set_seed(uint64_t seed) {
+    rng.seed(seed);
+    tableau_simulator.rng.seed(leaky::splitmix64(seed));
 }
 
 void leaky::Simulator::handle_transition(
-    uint8_t cur_status, uint8_t next_status, stim::SpanRef<const stim::GateTarget> target, const char* pauli) {
-    switch (leaky::get_transition_type(cur_status, next_status)) {
+    uint8_t cur_status, uint8_t next_status, stim::SpanRef<const stim::GateTarget> target, uint8_t pauli_idx) {
+    auto qubit = target[0].qubit_value();
+    auto transition_type = leaky::get_transition_type(cur_status, next_status);
+    LEAKY_COUNT(counters.transitions[transition_type]++);
+    switch (transition_type) {
         case leaky::TransitionType::R:
-            tableau_simulator.do_gate({stim::GATE_DATA.at(pauli, 1).id, {}, target});
+            // The Paulis in the order [I, X, Y, Z], prepended like `stim::TableauSimulator::do_X` does.
+            if (pauli_idx == 1) {
+                tableau_simulator.inv_state.prepend_X(qubit);
+            } else if (pauli_idx == 2) {
+                tableau_simulator.inv_state.prepend_Y(qubit);
+            } else if (pauli_idx == 3) {
+                tableau_simulator.inv_state.prepend_Z(qubit);
+            }
             return;
         case leaky::TransitionType::L:
             return;
         case leaky::TransitionType::U:
-            tableau_simulator.do_X_ERROR({GateType::X_ERROR, std::vector<double>{0.5}, target});
-            // tableau_simulator.do_RZ({GateType::R, {}, target});
+            // X_ERROR(0.5)
+            if (rng() >> 63) {
+                tableau_simulator.inv_state.prepend_X(qubit);
+            }
             return;
         case leaky::TransitionType::D:
             tableau_simulator.do_RZ({GateType::R, {}, target});
-            tableau_simulator.do_X_ERROR({GateType::X_ERROR, std::vector<double>{0.5}, target});
+            if (rng() >> 63) {
+                tableau_simulator.inv_state.prepend_X(qubit);
+            }
             return;
     }
 }
 
 void leaky::Simulator::bind_leaky_channel(
     const stim::CircuitInstruction& ideal_inst, const LeakyPauliChannel& channel) {
-    size_t inst_id = std::hash<std::string>{}(ideal_inst.str());
-    if (!(stim::GATE_DATA[ideal_inst.gate_type].flags & stim::GATE_IS_UNITARY)) {
-        throw std::invalid_argument("Only unitary gates can be binded with a leaky channel.");
-    }
-    bound_leaky_channels.insert({inst_id, channel});
+    leaky::bind_leaky_channel(bound_leaky_channels, ideal_inst, channel);
 }
 
 void leaky::Simulator::apply_1q_leaky_pauli_channel(
     stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel& channel) {
+    LEAKY_COUNT(ScopedTimer timer(counters.channel_seconds));
     for (size_t i = 0; i < targets.size(); i++) {
         auto qubit = targets[i].data;
         auto target = targets.sub(i, i + 1);
         uint8_t cur_status = leakage_status[qubit];
-        auto sample = channel.sample(cur_status);
-        if (!sample.has_value()) {
-            return;
+        leaky::transition sample;
+        if (!channel.sample_into(cur_status, rng, sample)) {
+            continue;
         }
-        auto [next_status, pauli_channel_idx] = sample.value();
-        leakage_status[qubit] = next_status;
-        auto pauli_str = leaky::pauli_idx_to_string(pauli_channel_idx, true);
-        handle_transition(cur_status, next_status, target, pauli_str.c_str());
+        auto [next_status, pauli_channel_idx] = sample;
+        if (cur_status == 0) {
+            shot_weight *= next_status == 0 ? channel.retention_likelihood_ratio : channel.leakage_likelihood_ratio;
+        }
+        set_leakage_status(qubit, next_status);
+        handle_transition(cur_status, next_status, target, pauli_channel_idx);
     }
 }
 
 void leaky::Simulator::apply_2q_leaky_pauli_channel(
     stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel& channel) {
+    LEAKY_COUNT(ScopedTimer timer(counters.channel_seconds));
     for (size_t k = 0; k < targets.size(); k += 2) {
         auto t1 = targets.sub(k, k + 1);
         auto t2 = targets.sub(k + 1, k + 2);
@@ -78,28 +108,33 @@ void leaky::Simulator::apply_2q_leaky_pauli_channel(
         auto cs1 = leakage_status[q1];
         auto cs2 = leakage_status[q2];
         uint8_t cur_status = (cs1 << 4) | cs2;
-        auto sample = channel.sample(cur_status);
-        if (!sample.has_value()) {
-            return;
+        leaky::transition sample;
+        if (!channel.sample_into(cur_status, rng, sample)) {
+            continue;
+        }
+        auto [next_status, pauli_channel_idx] = sample;
+        if (cur_status == 0) {
+            shot_weight *= next_status == 0 ? channel.retention_likelihood_ratio : channel.leakage_likelihood_ratio;
         }
-        auto [next_status, pauli_channel_idx] = sample.value();
         uint8_t ns1 = next_status >> 4;
         uint8_t ns2 = next_status & 0x0F;
-        leakage_status[q1] = ns1;
-        leakage_status[q2] = ns2;
-        auto pauli_str = leaky::pauli_idx_to_string(pauli_channel_idx, false);
-        handle_transition(cs1, ns1, t1, pauli_str.c_str());
-        handle_transition(cs2, ns2, t2, &pauli_str.c_str()[1]);
+        set_leakage_status(q1, ns1);
+        set_leakage_status(q2, ns2);
+        handle_transition(cs1, ns1, t1, pauli_channel_idx >> 2);
+        handle_transition(cs2, ns2, t2, pauli_channel_idx & 0x03);
     }
 }
 
 void leaky::Simulator::do_gate(const stim::CircuitInstruction& inst, bool look_up_bound_channels) {
+    // The channels applied by this instruction are timed on their own.
+    LEAKY_COUNT(ScopedTimer timer(counters.tableau_seconds, &counters.channel_seconds));
     // Handle measurements and resets.
     auto gate_type = inst.gate_type;
     auto targets = inst.targets;
     auto flags = stim::GATE_DATA[gate_type].flags;
     // Skip annotations.
     if (flags & stim::GATE_HAS_NO_EFFECT_ON_QUBITS) {
+        LEAKY_COUNT(if (gate_type == GateType::TICK) { counters.record_layer(num_leaked_qubits); });
         return;
     }
     // Encounter measurements: add leakage masks to the record
@@ -111,7 +146,7 @@ void leaky::Simulator::do_gate(const stim::CircuitInstruction& inst, bool look_u
     // Encounter resets: reset the leakage status of the qubits
     if (flags & stim::GATE_IS_RESET) {
         for (auto q : targets) {
-            leakage_status[q.qubit_value()] = 0;
+            set_leakage_status(q.qubit_value(), 0);
         }
     }
     if ((flags & stim::GATE_PRODUCES_RESULTS) || (flags & stim::GATE_IS_RESET)) {
@@ -126,6 +161,17 @@ void leaky::Simulator::do_gate(const stim::CircuitInstruction& inst, bool look_u
 
     bool is_single_qubit_gate = flags & stim::GATE_IS_SINGLE_QUBIT_GATE;
     size_t step = is_single_qubit_gate ? 1 : 2;
+    bool look_up = look_up_bound_channels && !bound_leaky_channels.empty();
+    // Without leaked qubits, stim handles all the target groups at once, unless the channel of a group has
+    // to act before a later group on the same qubit.
+    if (num_leaked_qubits == 0 && !(look_up && leaky::has_shared_target_qubits(targets))) {
+        tableau_simulator.do_gate(inst);
+        for (size_t i = 0; look_up && i < targets.size(); i += step) {
+            apply_bound_channel({gate_type, inst.args, targets.sub(i, i + step)});
+        }
+        return;
+    }
+
     for (size_t i = 0; i < targets.size(); i += step) {
         auto split_targets = targets.sub(i, i + step);
         stim::CircuitInstruction split_inst = {gate_type, inst.args, split_targets};
@@ -137,52 +183,134 @@ void leaky::Simulator::do_gate(const stim::CircuitInstruction& inst, bool look_u
         if (all_target_is_in_r) {
             tableau_simulator.do_gate(split_inst);
         }
-        if (!look_up_bound_channels || bound_leaky_channels.empty()) {
-            continue;
-        }
-        // Look up the bound leaky channel for the ideal gate.
-        const auto inst_id = std::hash<std::string>{}(split_inst.str());
-        auto it = bound_leaky_channels.find(inst_id);
-        if (it == bound_leaky_channels.end()) {
-            continue;
-        }
-        const auto& channel = it->second;
-        if (is_single_qubit_gate) {
-            apply_1q_leaky_pauli_channel(split_targets, channel);
-        } else {
-            apply_2q_leaky_pauli_channel(split_targets, channel);
+        if (look_up) {
+            apply_bound_channel(split_inst);
         }
     }
 }
 
-void leaky::Simulator::do_circuit(const stim::Circuit& circuit) {
-    if (circuit.count_qubits() > num_qubits) {
-        throw std::invalid_argument(
-            "The number of qubits in the circuit exceeds the maximum capacity of the simulator.");
+void leaky::Simulator::apply_bound_channel(const stim::CircuitInstruction& split_inst) {
+    // Look up the bound leaky channel for the ideal gate.
+    auto key = leaky::make_binding_key(split_inst.gate_type, split_inst.targets, split_inst.args);
+    auto index = bound_leaky_channels.find(key);
+    if (index == BoundChannelMap::NOT_FOUND) {
+        return;
     }
+    LEAKY_COUNT(counters.channel_samples[key]++);
+    const auto& channel = bound_leaky_channels.channels[index];
+    if (split_inst.targets.size() == 1) {
+        apply_1q_leaky_pauli_channel(split_inst.targets, channel);
+    } else {
+        apply_2q_leaky_pauli_channel(split_inst.targets, channel);
+    }
+}
+
+static void do_circuit_body(leaky::Simulator& simulator, const stim::Circuit& circuit) {
     for (const auto& op : circuit.operations) {
         if (op.gate_type == GateType::REPEAT) {
             uint64_t repeats = op.repeat_block_rep_count();
             const auto& block = op.repeat_block_body(circuit);
             for (uint64_t k = 0; k < repeats; k++) {
-                do_circuit(block);
+                do_circuit_body(simulator, block);
             }
         } else {
-            do_gate(op);
+            simulator.do_gate(op);
         }
     }
 }
 
+void leaky::Simulator::do_circuit(const stim::Circuit& circuit) {
+    if (circuit.count_qubits() > num_qubits) {
+        throw std::invalid_argument(
+            "The number of qubits in the circuit exceeds the maximum capacity of the simulator.");
+    }
+    do_circuit_body(*this, circuit);
+}
+
+void leaky::Simulator::do_compiled_circuit(
+    const CompiledCircuit& compiled_circuit, size_t first_operation, size_t end_operation) {
+    compiled_circuit.for_each_operation(
+        [this, &compiled_circuit](const stim::CircuitInstruction& op, stim::SpanRef<const BoundChannelRef> channels) {
+            do_gate(op, false);
+            for (const auto& [target_begin, target_end, channel_index] : channels) {
+                auto targets = op.targets.sub(target_begin, target_end);
+                const auto& channel = compiled_circuit.channels[channel_index];
+                LEAKY_COUNT(counters.channel_samples[compiled_circuit.channel_keys[channel_index]]++);
+                if (targets.size() == 1) {
+                    apply_1q_leaky_pauli_channel(targets, channel);
+                } else {
+                    apply_2q_leaky_pauli_channel(targets, channel);
+                }
+            }
+        },
+        first_operation,
+        end_operation);
+}
+
+template <size_t W>
+static void copy_bits(const stim::simd_bits<W>& src, stim::simd_bits<W>& dst) {
+    std::memcpy(dst.u64, src.u64, src.num_u64_padded() * sizeof(uint64_t));
+}
+
 void leaky::Simulator::clear(bool clear_bound_channels) {
-    leakage_status = std::vector<uint8_t>(num_qubits, 0);
+    std::fill(leakage_status.begin(), leakage_status.end(), 0);
+    num_leaked_qubits = 0;
     leakage_masks_record.clear();
-    tableau_simulator.inv_state = stim::Tableau<stim::MAX_BITWORD_WIDTH>::identity(num_qubits);
+    shot_weight = 1.0;
+    counters.current_layer = 0;
+    auto& inv_state = tableau_simulator.inv_state;
+    if (inv_state.num_qubits == num_qubits) {
+        for (auto* half : {&inv_state.xs, &inv_state.zs}) {
+            half->xt.clear();
+            half->zt.clear();
+            half->signs.clear();
+        }
+        for (size_t q = 0; q < num_qubits; q++) {
+            inv_state.xs.xt[q][q] = true;
+            inv_state.zs.zt[q][q] = true;
+        }
+    } else {
+        inv_state = stim::Tableau<stim::MAX_BITWORD_WIDTH>::identity(num_qubits);
+    }
     tableau_simulator.measurement_record.storage.clear();
     if (clear_bound_channels) {
         bound_leaky_channels.clear();
     }
 }
 
+leaky::SimulatorSnapshot leaky::Simulator::snapshot() const {
+    return {
+        leakage_status,
+        num_leaked_qubits,
+        leakage_masks_record,
+        tableau_simulator.inv_state,
+        tableau_simulator.measurement_record.storage,
+        counters.current_layer,
+        shot_weight,
+    };
+}
+
+void leaky::Simulator::restore(const SimulatorSnapshot& snapshot) {
+    std::copy(snapshot.leakage_status.begin(), snapshot.leakage_status.end(), leakage_status.begin());
+    num_leaked_qubits = snapshot.num_leaked_qubits;
+    counters.current_layer = snapshot.counters_layer;
+    shot_weight = snapshot.shot_weight;
+    leakage_masks_record.assign(snapshot.leakage_masks_record.begin(), snapshot.leakage_masks_record.end());
+    auto& inv_state = tableau_simulator.inv_state;
+    if (inv_state.num_qubits == snapshot.inv_state.num_qubits) {
+        copy_bits(snapshot.inv_state.xs.xt.data, inv_state.xs.xt.data);
+        copy_bits(snapshot.inv_state.xs.zt.data, inv_state.xs.zt.data);
+        copy_bits(snapshot.inv_state.xs.signs, inv_state.xs.signs);
+        copy_bits(snapshot.inv_state.zs.xt.data, inv_state.zs.xt.data);
+        copy_bits(snapshot.inv_state.zs.zt.data, inv_state.zs.zt.data);
+        copy_bits(snapshot.inv_state.zs.signs, inv_state.zs.signs);
+    } else {
+        inv_state = snapshot.inv_state;
+    }
+    auto& record = tableau_simulator.measurement_record.storage;
+    record.assign(snapshot.measurement_record.begin(), snapshot.measurement_record.end());
+}
+
 std::vector<uint8_t> leaky::Simulator::current_measurement_record(ReadoutStrategy readout_strategy) {
     auto results = std::vector<uint8_t>(leakage_masks_record.size());
     append_measurement_record_into(results.data(), readout_strategy);
@@ -190,23 +318,36 @@ std::vector<uint8_t> leaky::Simulator::current_measurement_record(ReadoutStrateg
 }
 
 void leaky::Simulator::append_measurement_record_into(uint8_t* record_begin_ptr, ReadoutStrategy readout_strategy) {
-    auto tableau_record = tableau_simulator.measurement_record.storage;
-    auto num_measurements = leakage_masks_record.size();
+    LEAKY_COUNT(ScopedTimer timer(counters.readout_seconds));
+    const auto& tableau_record = tableau_simulator.measurement_record.storage;
+    const uint8_t* masks = leakage_masks_record.data();
+    size_t num_measurements = leakage_masks_record.size();
+    std::copy(tableau_record.begin(), tableau_record.begin() + num_measurements, record_begin_ptr);
+    // The merges below are branch-free selects over byte arrays, which the compiler vectorizes.
     if (readout_strategy == ReadoutStrategy::RawLabel) {
-        for (auto i = 0; i < num_measurements; i++) {
-            uint8_t mask = leakage_masks_record[i];
-            *(record_begin_ptr + i) = mask == 0 ? (uint8_t)tableau_record[i] : mask + 1;
+        for (size_t i = 0; i < num_measurements; i++) {
+            uint8_t mask = masks[i];
+            record_begin_ptr[i] = mask == 0 ? record_begin_ptr[i] : (uint8_t)(mask + 1);
         }
     } else if (readout_strategy == ReadoutStrategy::RandomLeakageProjection) {
-        for (auto i = 0; i < num_measurements; i++) {
-            uint8_t mask = leakage_masks_record[i];
-            *(record_begin_ptr + i) =
-                mask == 0 ? (uint8_t)tableau_record[i] : (leaky::rand_float(0.0, 1.0) < 0.5 ? 0 : 1);
+        // Leaked measurements are rare, so the coin flips are drawn 64 at a time and spent one bit each.
+        uint64_t coins = 0;
+        size_t num_coins = 0;
+        for (size_t i = 0; i < num_measurements; i++) {
+            if (masks[i] == 0) {
+                continue;
+            }
+            if (num_coins == 0) {
+                coins = rng();
+                num_coins = 64;
+            }
+            record_begin_ptr[i] = (uint8_t)(coins & 1);
+            coins >>= 1;
+            num_coins--;
         }
     } else if (readout_strategy == ReadoutStrategy::DeterministicLeakageProjection) {
-        for (auto i = 0; i < num_measurements; i++) {
-            uint8_t mask = leakage_masks_record[i];
-            *(record_begin_ptr + i) = mask == 0 ? (uint8_t)tableau_record[i] : 1;
+        for (size_t i = 0; i < num_measurements; i++) {
+            record_begin_ptr[i] = masks[i] == 0 ? record_begin_ptr[i] : 1;
         }
     } else {
         throw std::invalid_argument("Invalid readout strategy.");
@@ -2,37 +2,88 @@
 #define LEAKY_SIMULATOR_H
 
 #include <cstdint>
-#include <unordered_map>
 #include <vector>
 
+#include "leaky/core/binding.h"
 #include "leaky/core/channel.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/counters.h"
+#include "leaky/core/rand_gen.h"
 #include "leaky/core/readout_strategy.h"
 #include "stim.h"
 
 namespace leaky {
 
+/// The state of a `Simulator` between two instructions, see `Simulator::snapshot`.
+struct SimulatorSnapshot {
+    std::vector<uint8_t> leakage_status;
+    uint32_t num_leaked_qubits;
+    std::vector<uint8_t> leakage_masks_record;
+    stim::Tableau<stim::MAX_BITWORD_WIDTH> inv_state;
+    std::vector<bool> measurement_record;
+    /// `SimulatorCounters::current_layer`, so the layers of restored shots keep their indices.
+    uint32_t counters_layer;
+    double shot_weight;
+};
+
 struct Simulator {
     uint32_t num_qubits;
     std::vector<uint8_t> leakage_status;
+    /// The number of nonzero entries of `leakage_status`. While it is zero, unitary instructions are
+    /// forwarded to stim whole instead of target group by group, unless a channel bound to one of
+    /// their groups acts on a qubit of a later group, see `has_shared_target_qubits`.
+    uint32_t num_leaked_qubits;
     std::vector<uint8_t> leakage_masks_record;
     stim::TableauSimulator<stim::MAX_BITWORD_WIDTH> tableau_simulator;
-    std::unordered_map<size_t, LeakyPauliChannel> bound_leaky_channels;
+    BoundChannelMap bound_leaky_channels;
+    /// Drives the leaky channels and the leakage projections. The tableau simulator keeps its own
+    /// mt19937_64 engine, seeded from the same seed.
+    Xoshiro256pp rng;
+    /// The product of the likelihood ratios of the transitions sampled since the last `clear`, which
+    /// weights the shot back to the true distribution when the channels are biased, see
+    /// `with_leakage_bias`. It stays 1 with unbiased channels.
+    double shot_weight;
+    /// Only recorded in builds with `LEAKY_ENABLE_COUNTERS`, see `SimulatorCounters`.
+    SimulatorCounters counters;
 
+    /// Seeded from `draw_seed()`.
     explicit Simulator(uint32_t num_qubits);
+    Simulator(uint32_t num_qubits, uint64_t seed);
+
+    void set_seed(uint64_t seed);
 
+    /// Bind a channel to every single- or two-qubit target group of a unitary instruction.
     void bind_leaky_channel(const stim::CircuitInstruction& ideal_inst, const LeakyPauliChannel& channel);
     void apply_1q_leaky_pauli_channel(stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel& channel);
     void apply_2q_leaky_pauli_channel(stim::SpanRef<const stim::GateTarget> targets, const LeakyPauliChannel& channel);
+    /// Without `look_up_bound_channels`, the caller applies the channels after the instruction, so an
+    /// instruction whose channels act between its target groups is passed in pieces, like
+    /// `CompiledCircuit::for_each_operation` does.
     void do_gate(const stim::CircuitInstruction& inst, bool look_up_bound_channels = true);
     void do_circuit(const stim::Circuit& circuit);
+    /// Run the operations `[first_operation, end_operation)` of a circuit compiled against
+    /// `bound_leaky_channels`, without looking up any binding.
+    void do_compiled_circuit(
+        const CompiledCircuit& compiled_circuit, size_t first_operation = 0, size_t end_operation = SIZE_MAX);
+    /// Reset the simulation state in place, reusing the existing buffers.
     void clear(bool clear_bound_channels = false);
+    /// Save the simulation state, to start shots from it with `restore`.
+    [[nodiscard]] SimulatorSnapshot snapshot() const;
+    /// Copy a snapshot of a simulator of the same size back into the existing buffers.
+    void restore(const SimulatorSnapshot& snapshot);
     std::vector<uint8_t> current_measurement_record(ReadoutStrategy readout_strategy = ReadoutStrategy::RawLabel);
     void append_measurement_record_into(
         uint8_t* record_begin_ptr, ReadoutStrategy readout_strategy = ReadoutStrategy::RawLabel);
 
    private:
+    inline void set_leakage_status(uint32_t qubit, uint8_t status) {
+        num_leaked_qubits += (status != 0) - (leakage_status[qubit] != 0);
+        leakage_status[qubit] = status;
+    }
+    /// Apply the channel bound to a single target group, if any.
+    void apply_bound_channel(const stim::CircuitInstruction& split_inst);
     void handle_transition(
-        uint8_t cur_status, uint8_t next_status, stim::SpanRef<const stim::GateTarget> target, const char* pauli);
+        uint8_t cur_status, uint8_t next_status, stim::SpanRef<const stim::GateTarget> target, uint8_t pauli_idx);
 };
 
 }  // namespace leaky
@@ -1,80 +1,534 @@
 #include "leaky/core/simulator.pybind.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
-#include <iterator>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <optional>
 #include <pybind11/cast.h>
 #include <pybind11/detail/common.h>
 #include <pybind11/pytypes.h>
 #include <pybind11/stl.h>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "leaky/core/binding.h"
+#include "leaky/core/channel_library.h"
+#include "leaky/core/chunk_producer.h"
+#include "leaky/core/compiled_circuit.h"
+#include "leaky/core/counters.h"
 #include "leaky/core/instruction.pybind.h"
+#include "leaky/core/job.h"
 #include "leaky/core/rand_gen.h"
+#include "leaky/core/sampler.h"
 #include "leaky/core/simulator.h"
 #include "stim.h"
 
-struct ChannelResolvedCircuit {
-    std::vector<stim::CircuitInstruction> instructions;
-    std::vector<std::pair<stim::SpanRef<const stim::GateTarget>, const leaky::LeakyPauliChannel &>> channels;
-    std::vector<std::pair<bool, size_t>> order;
-};
-
-ChannelResolvedCircuit resolve_bound_channels_in_circuit(
-    const leaky::Simulator &simulator, const stim::Circuit &flatten_circuit) {
-    ChannelResolvedCircuit resolved_circuit;
-    resolved_circuit.instructions = flatten_circuit.operations;
-    size_t instruction_idx = 0;
-    size_t channel_idx = 0;
-    for (const auto &op : flatten_circuit.operations) {
-        resolved_circuit.order.push_back({true, instruction_idx++});
-        auto gate_type = op.gate_type;
-        auto targets = op.targets;
-        auto flags = stim::GATE_DATA[gate_type].flags;
-        bool is_single_qubit_gate = flags & stim::GATE_IS_SINGLE_QUBIT_GATE;
-        size_t step = is_single_qubit_gate ? 1 : 2;
-        for (size_t i = 0; i < targets.size(); i += step) {
-            auto split_targets = targets.sub(i, i + step);
-            stim::CircuitInstruction split_inst = {gate_type, op.args, split_targets};
-            const auto inst_id = std::hash<std::string>{}(split_inst.str());
-            auto it = simulator.bound_leaky_channels.find(inst_id);
-            if (it == simulator.bound_leaky_channels.end()) {
-                continue;
-            }
-            resolved_circuit.channels.push_back({split_targets, it->second});
-            resolved_circuit.order.push_back({false, channel_idx++});
-        }
-    }
-    return resolved_circuit;
-}
-
 py::class_<leaky::Simulator> leaky_pybind::pybind_simulator(py::module &m) {
     return {m, "Simulator"};
 }
 
 leaky::Simulator create_simulator(uint32_t num_qubits, const pybind11::object &seed) {
     if (!seed.is_none()) {
-        leaky::set_seed(seed.cast<unsigned>());
-    } else {
-        leaky::randomize();
+        return leaky::Simulator(num_qubits, seed.cast<uint64_t>());
     }
     return leaky::Simulator(num_qubits);
 }
 
+/// Convert a `stim.Circuit`, or anything whose `str` is a circuit, to its C++ representation.
+///
+/// The circuit always goes through its text: the `stim` wheel is a separate extension module with
+/// its own pybind11 internals, so its `stim.Circuit` is not registered with ours and can not be cast
+/// to `stim::Circuit`. Parsing is linear in the circuit, and `compile_sampler` does it only once.
+stim::Circuit circuit_from_object(const py::object &circuit) {
+    auto circuit_str = pybind11::cast<std::string>(pybind11::str(circuit));
+    return stim::Circuit(circuit_str.c_str());
+}
+
+/// Compile a circuit with the channels bound in a simulator, biased in place if `leakage_bias` is given.
+leaky::CompiledCircuit compile_for_simulator(
+    const leaky::Simulator &simulator, const py::object &circuit, std::optional<double> leakage_bias = std::nullopt) {
+    auto compiled_circuit = leaky::compile_circuit(circuit_from_object(circuit), simulator.bound_leaky_channels);
+    if (compiled_circuit.num_qubits > simulator.num_qubits) {
+        throw std::invalid_argument(
+            "The number of qubits in the circuit exceeds the maximum capacity of the simulator.");
+    }
+    if (leakage_bias.has_value()) {
+        return leaky::with_leakage_bias(std::move(compiled_circuit), leakage_bias.value());
+    }
+    return compiled_circuit;
+}
+
+/// Sample a compiled circuit as is. `with_weights` also returns the per-shot weights, which differ
+/// from 1 only when its channels are biased.
+py::object sample_batch_to_numpy(
+    leaky::SimulatorCounters &total_counters,
+    const leaky::CompiledCircuit &compiled_circuit,
+    py::ssize_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    std::optional<bool> sparse_leakage,
+    bool bit_packed,
+    bool with_weights) {
+    auto num_measurements = compiled_circuit.num_measurements;
+    auto row_bytes = (py::ssize_t)(bit_packed ? (num_measurements + 7) / 8 : num_measurements);
+    // Every byte of the results is written by the sampler, so they are left uninitialized.
+    py::array_t<uint8_t> results({shots, row_bytes});
+    uint8_t *results_ptr = results.mutable_data();
+    bool with_leakage_flags = bit_packed && readout_strategy == leaky::ReadoutStrategy::RawLabel;
+    py::array_t<uint8_t> leakage_flags({with_leakage_flags ? shots : 0, row_bytes});
+    uint8_t *leakage_flags_ptr = with_leakage_flags ? leakage_flags.mutable_data() : nullptr;
+    py::array_t<double> weights(with_weights ? shots : 0);
+    double *weights_ptr = with_weights ? weights.mutable_data() : nullptr;
+    // Counted locally and merged once the GIL is held again, as other Python threads may use the totals.
+    leaky::SimulatorCounters counters;
+    {
+        py::gil_scoped_release release;
+        leaky::sample_batch(
+            compiled_circuit,
+            shots,
+            readout_strategy,
+            results_ptr,
+            seed,
+            num_threads,
+            engine,
+            bit_packed,
+            leakage_flags_ptr,
+            0,
+            &counters,
+            weights_ptr,
+            sparse_leakage);
+    }
+    total_counters.merge(counters);
+    if (with_leakage_flags && with_weights) {
+        return py::make_tuple(results, leakage_flags, weights);
+    }
+    if (with_leakage_flags) {
+        return py::make_tuple(results, leakage_flags);
+    }
+    if (with_weights) {
+        return py::make_tuple(results, weights);
+    }
+    return std::move(results);
+}
+
+py::object sample_detectors_to_numpy(
+    leaky::SimulatorCounters &total_counters,
+    const leaky::CompiledCircuit &compiled_circuit,
+    py::ssize_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    std::optional<bool> sparse_leakage,
+    bool leakage_flags,
+    bool with_weights) {
+    auto detector_bytes = (py::ssize_t)(compiled_circuit.num_detectors + 7) / 8;
+    auto observable_bytes = (py::ssize_t)(compiled_circuit.num_observables + 7) / 8;
+    py::array_t<uint8_t> detections({shots, detector_bytes});
+    py::array_t<uint8_t> observables({shots, observable_bytes});
+    py::array_t<uint8_t> flags({leakage_flags ? shots : 0, detector_bytes});
+    uint8_t *detections_ptr = detections.mutable_data();
+    uint8_t *observables_ptr = observables.mutable_data();
+    uint8_t *flags_ptr = leakage_flags ? flags.mutable_data() : nullptr;
+    py::array_t<double> weights(with_weights ? shots : 0);
+    double *weights_ptr = with_weights ? weights.mutable_data() : nullptr;
+    // Merged with the GIL held, like in `sample_batch_to_numpy`.
+    leaky::SimulatorCounters counters;
+    {
+        py::gil_scoped_release release;
+        leaky::sample_detectors(
+            compiled_circuit,
+            shots,
+            readout_strategy,
+            detections_ptr,
+            observables_ptr,
+            flags_ptr,
+            seed,
+            num_threads,
+            engine,
+            &counters,
+            weights_ptr,
+            sparse_leakage);
+    }
+    total_counters.merge(counters);
+    if (leakage_flags && with_weights) {
+        return py::make_tuple(detections, observables, flags, weights);
+    }
+    if (leakage_flags) {
+        return py::make_tuple(detections, observables, flags);
+    }
+    if (with_weights) {
+        return py::make_tuple(detections, observables, weights);
+    }
+    return py::make_tuple(detections, observables);
+}
+
+/// The bindings and shots of each variant of a sweep, as `(bindings, shots)` pairs.
+typedef std::vector<
+    std::pair<std::vector<std::pair<leaky_pybind::LeakyInstruction, leaky::LeakyPauliChannel>>, size_t>>
+    SweepVariantList;
+
+py::array_t<uint8_t> sample_sweep_to_numpy(
+    leaky::SimulatorCounters &total_counters,
+    const leaky::CompiledCircuit &compiled_circuit,
+    const SweepVariantList &variant_list,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    std::optional<bool> sparse_leakage) {
+    std::vector<leaky::SweepVariant> variants;
+    size_t total_shots = 0;
+    for (const auto &[bindings, shots] : variant_list) {
+        leaky::SweepVariant variant{{}, shots};
+        for (const auto &[ideal_inst, channel] : bindings) {
+            leaky::bind_leaky_channel(variant.bound_leaky_channels, ideal_inst, channel);
+        }
+        variants.push_back(std::move(variant));
+        total_shots += shots;
+    }
+    py::array_t<uint8_t> results({(py::ssize_t)total_shots, (py::ssize_t)compiled_circuit.num_measurements});
+    uint8_t *results_ptr = results.mutable_data();
+    // Merged with the GIL held, like in `sample_batch_to_numpy`.
+    leaky::SimulatorCounters counters;
+    {
+        py::gil_scoped_release release;
+        leaky::sample_sweep(
+            compiled_circuit,
+            variants,
+            readout_strategy,
+            results_ptr,
+            seed,
+            num_threads,
+            engine,
+            &counters,
+            nullptr,
+            sparse_leakage);
+    }
+    total_counters.merge(counters);
+    return results;
+}
+
+py::dict sample_statistics_to_dict(
+    leaky::SimulatorCounters &total_counters,
+    const leaky::CompiledCircuit &compiled_circuit,
+    size_t shots,
+    leaky::ReadoutStrategy readout_strategy,
+    uint64_t seed,
+    size_t num_threads,
+    leaky::Engine engine,
+    std::optional<bool> sparse_leakage,
+    std::optional<uint64_t> max_failures) {
+    leaky::SampleStatistics statistics;
+    // Merged with the GIL held, like in `sample_batch_to_numpy`.
+    leaky::SimulatorCounters counters;
+    {
+        py::gil_scoped_release release;
+        statistics = leaky::sample_statistics(
+            compiled_circuit,
+            shots,
+            readout_strategy,
+            seed,
+            num_threads,
+            engine,
+            max_failures.value_or(0),
+            &counters,
+            sparse_leakage);
+    }
+    total_counters.merge(counters);
+    py::dict result;
+    result["shots"] = statistics.shots;
+    result["num_failures"] = statistics.num_failures;
+    result["leaked_counts"] = py::array_t<uint64_t>(
+        (py::ssize_t)statistics.leaked_counts.size(), statistics.leaked_counts.data());
+    result["observable_flip_counts"] = py::array_t<uint64_t>(
+        (py::ssize_t)statistics.observable_flip_counts.size(), statistics.observable_flip_counts.data());
+    return result;
+}
+
+py::dict counters_to_dict(const leaky::SimulatorCounters &counters) {
+    py::dict channel_samples;
+    for (const auto &[key, count] : counters.channel_samples) {
+        channel_samples[py::str(key.str())] = count;
+    }
+    py::dict transitions;
+    const char *transition_names[4] = {"R", "U", "D", "L"};
+    for (size_t k = 0; k < 4; k++) {
+        transitions[transition_names[k]] = counters.transitions[k];
+    }
+    py::dict result;
+    result["enabled"] = leaky::COUNTERS_ENABLED;
+    result["num_shots"] = counters.num_shots;
+    result["channel_samples"] = channel_samples;
+    result["transitions"] = transitions;
+    result["leaked_qubits_per_layer"] = counters.leaked_qubits_per_layer;
+    result["tableau_seconds"] = counters.tableau_seconds;
+    result["channel_seconds"] = counters.channel_seconds;
+    result["readout_seconds"] = counters.readout_seconds;
+    return result;
+}
+
+stim::SampleFormat sample_format_from_name(const std::string &format) {
+    if (format == "01") {
+        return stim::SampleFormat::SAMPLE_FORMAT_01;
+    } else if (format == "b8") {
+        return stim::SampleFormat::SAMPLE_FORMAT_B8;
+    } else if (format == "r8") {
+        return stim::SampleFormat::SAMPLE_FORMAT_R8;
+    }
+    throw std::invalid_argument("Unsupported sample format '" + format + "', expected one of '01', 'b8' or 'r8'.");
+}
+
+/// Iterates over the chunks of a sampling job, see `Simulator.sample_chunks`.
+struct SampleChunkIterator {
+    /// Behind a pointer, so that the sampler's reference to it survives moving the iterator.
+    std::unique_ptr<leaky::CompiledCircuit> compiled_circuit;
+    size_t shots;
+    size_t chunk_shots;
+    leaky::Engine engine;
+    size_t next_shot = 0;
+    /// Samples the chunks on demand, keeping its workers and their setup from chunk to chunk.
+    std::unique_ptr<leaky::BlockSampler> sampler = nullptr;
+    /// Samples the chunks ahead on a background thread when prefetching, see `leaky::ChunkProducer`.
+    std::unique_ptr<leaky::ChunkProducer> producer = nullptr;
+
+    py::array_t<uint8_t> next() {
+        if (next_shot >= shots) {
+            throw py::stop_iteration();
+        }
+        size_t n = std::min(chunk_shots, shots - next_shot);
+        auto num_measurements = (py::ssize_t)compiled_circuit->num_measurements;
+        py::array_t<uint8_t> chunk({(py::ssize_t)n, num_measurements});
+        uint8_t *chunk_ptr = chunk.mutable_data();
+        if (producer != nullptr) {
+            py::gil_scoped_release release;
+            producer->next(chunk_ptr);
+        } else {
+            py::gil_scoped_release release;
+            sampler->sample(next_shot / leaky::shots_per_block(engine), n, chunk_ptr);
+        }
+        next_shot += n;
+        return chunk;
+    }
+};
+
+/// A circuit compiled once for repeated sampling, see `Simulator.compile_sampler`.
+struct CompiledSampler {
+    /// Draws the seed of each sampling call, from its own stream seeded from the compiling simulator's.
+    leaky::Xoshiro256pp rng;
+    /// The counters of the samples drawn by this sampler.
+    leaky::SimulatorCounters counters;
+    leaky::CompiledCircuit compiled_circuit;
+    /// The copies of `compiled_circuit` with biased channels, by leakage bias, made on first use.
+    std::map<double, leaky::CompiledCircuit> biased_circuits;
+
+    CompiledSampler(leaky::Simulator &source, const py::object &circuit)
+        : rng(source.rng()), compiled_circuit(compile_for_simulator(source, circuit)) {
+    }
+
+    /// The circuit to sample, with its channels biased by `leakage_bias` if given.
+    ///
+    /// Called with the GIL held. The returned reference stays valid while sampling with the GIL
+    /// released, as inserting into a `std::map` does not move its other entries.
+    const leaky::CompiledCircuit &circuit_with_bias(std::optional<double> leakage_bias) {
+        if (!leakage_bias.has_value()) {
+            return compiled_circuit;
+        }
+        // Checked before the lookup, as a NaN key would break the ordering of the map.
+        if (!(leakage_bias.value() > 0) || !std::isfinite(leakage_bias.value())) {
+            throw std::invalid_argument("The leakage bias should be a positive finite number.");
+        }
+        auto it = biased_circuits.find(leakage_bias.value());
+        if (it == biased_circuits.end()) {
+            auto biased = leaky::with_leakage_bias(compiled_circuit, leakage_bias.value());
+            it = biased_circuits.emplace(leakage_bias.value(), std::move(biased)).first;
+        }
+        return it->second;
+    }
+    CompiledSampler(const CompiledSampler &) = delete;
+    CompiledSampler &operator=(const CompiledSampler &) = delete;
+};
+
 void leaky_pybind::pybind_simulator_methods(py::module &m, py::class_<leaky::Simulator> &s) {
     py::enum_<leaky::ReadoutStrategy>(m, "ReadoutStrategy", py::arithmetic())
         .value("RawLabel", leaky::ReadoutStrategy::RawLabel)
         .value("RandomLeakageProjection", leaky::ReadoutStrategy::RandomLeakageProjection)
         .value("DeterministicLeakageProjection", leaky::ReadoutStrategy::DeterministicLeakageProjection)
         .export_values();
+    py::enum_<leaky::Engine>(m, "Engine", py::arithmetic())
+        .value("Tableau", leaky::Engine::Tableau)
+        .value("Frame", leaky::Engine::Frame)
+        .value("Branching", leaky::Engine::Branching)
+        .export_values();
+
+    m.def(
+        "run_shard",
+        [](const std::string &job_filepath,
+           uint64_t shard_index,
+           uint64_t num_shards,
+           const std::string &filepath,
+           const std::string &format,
+           size_t num_threads) {
+            auto job = leaky::load_job(job_filepath);
+            auto sample_format = sample_format_from_name(format);
+            FILE *out = fopen(filepath.c_str(), "wb");
+            if (out == nullptr) {
+                throw std::invalid_argument("Failed to open '" + filepath + "' to write.");
+            }
+            std::vector<uint64_t> counts;
+            try {
+                py::gil_scoped_release release;
+                counts = leaky::run_shard(job, shard_index, num_shards, out, sample_format, num_threads);
+            } catch (...) {
+                fclose(out);
+                throw;
+            }
+            fclose(out);
+            return py::array_t<uint64_t>(counts.size(), counts.data());
+        },
+        py::arg("job_filepath"),
+        py::arg("shard_index"),
+        py::arg("num_shards"),
+        py::arg("filepath"),
+        pybind11::kw_only(),
+        py::arg("format") = "b8",
+        py::arg("num_threads") = 1);
+
+    py::class_<SampleChunkIterator>(m, "SampleChunkIterator")
+        .def("__iter__", [](SampleChunkIterator &self) -> SampleChunkIterator & { return self; })
+        .def("__next__", &SampleChunkIterator::next);
+
+    py::class_<CompiledSampler>(m, "CompiledSampler")
+        .def(
+            "sample",
+            [](CompiledSampler &self,
+               py::ssize_t shots,
+               leaky::ReadoutStrategy readout_strategy,
+               size_t num_threads,
+               leaky::Engine engine,
+               std::optional<bool> sparse_leakage,
+               bool bit_packed,
+               std::optional<double> leakage_bias) {
+                return sample_batch_to_numpy(
+                    self.counters,
+                    self.circuit_with_bias(leakage_bias),
+                    shots,
+                    readout_strategy,
+                    self.rng(),
+                    num_threads,
+                    engine,
+                    sparse_leakage,
+                    bit_packed,
+                    leakage_bias.has_value());
+            },
+            py::arg("shots"),
+            py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+            pybind11::kw_only(),
+            py::arg("num_threads") = 1,
+            py::arg("engine") = leaky::Engine::Tableau,
+            py::arg("sparse_leakage") = py::none(),
+            py::arg("bit_packed") = false,
+            py::arg("leakage_bias") = py::none())
+        .def(
+            "sample_detectors",
+            [](CompiledSampler &self,
+               py::ssize_t shots,
+               leaky::ReadoutStrategy readout_strategy,
+               size_t num_threads,
+               leaky::Engine engine,
+               std::optional<bool> sparse_leakage,
+               bool leakage_flags,
+               std::optional<double> leakage_bias) {
+                return sample_detectors_to_numpy(
+                    self.counters,
+                    self.circuit_with_bias(leakage_bias),
+                    shots,
+                    readout_strategy,
+                    self.rng(),
+                    num_threads,
+                    engine,
+                    sparse_leakage,
+                    leakage_flags,
+                    leakage_bias.has_value());
+            },
+            py::arg("shots"),
+            py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+            pybind11::kw_only(),
+            py::arg("num_threads") = 1,
+            py::arg("engine") = leaky::Engine::Tableau,
+            py::arg("sparse_leakage") = py::none(),
+            py::arg("leakage_flags") = false,
+            py::arg("leakage_bias") = py::none())
+        .def(
+            "sample_statistics",
+            [](CompiledSampler &self,
+               size_t shots,
+               leaky::ReadoutStrategy readout_strategy,
+               size_t num_threads,
+               leaky::Engine engine,
+               std::optional<bool> sparse_leakage,
+               std::optional<uint64_t> max_failures) {
+                return sample_statistics_to_dict(
+                    self.counters,
+                    self.compiled_circuit,
+                    shots,
+                    readout_strategy,
+                    self.rng(),
+                    num_threads,
+                    engine,
+                    sparse_leakage,
+                    max_failures);
+            },
+            py::arg("shots"),
+            py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+            pybind11::kw_only(),
+            py::arg("num_threads") = 1,
+            py::arg("engine") = leaky::Engine::Tableau,
+            py::arg("sparse_leakage") = py::none(),
+            py::arg("max_failures") = py::none())
+        .def(
+            "sample_sweep",
+            [](CompiledSampler &self,
+               const SweepVariantList &variants,
+               leaky::ReadoutStrategy readout_strategy,
+               size_t num_threads,
+               leaky::Engine engine,
+               std::optional<bool> sparse_leakage) {
+                return sample_sweep_to_numpy(
+                    self.counters,
+                    self.compiled_circuit,
+                    variants,
+                    readout_strategy,
+                    self.rng(),
+                    num_threads,
+                    engine,
+                    sparse_leakage);
+            },
+            py::arg("variants"),
+            py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+            pybind11::kw_only(),
+            py::arg("num_threads") = 1,
+            py::arg("engine") = leaky::Engine::Tableau,
+            py::arg("sparse_leakage") = py::none())
+        .def_property_readonly(
+            "counters", [](const CompiledSampler &self) { return counters_to_dict(self.counters); })
+        .def_property_readonly(
+            "num_measurements", [](const CompiledSampler &self) { return self.compiled_circuit.num_measurements; })
+        .def_property_readonly(
+            "num_detectors", [](const CompiledSampler &self) { return self.compiled_circuit.num_detectors; })
+        .def_property_readonly(
+            "num_observables", [](const CompiledSampler &self) { return self.compiled_circuit.num_observables; });
 
     s.def(py::init(&create_simulator), py::arg("num_qubits"), pybind11::kw_only(), py::arg("seed") = pybind11::none());
     s.def(
         "do_circuit",
-        [](leaky::Simulator &self, const py::object &circuit) {
-            auto circuit_str = pybind11::cast<std::string>(pybind11::str(circuit));
-            stim::Circuit converted_circuit = stim::Circuit(circuit_str.c_str());
-            self.do_circuit(converted_circuit);
-        },
+        [](leaky::Simulator &self, const py::object &circuit) { self.do_circuit(circuit_from_object(circuit)); },
         py::arg("circuit"));
     s.def(
         "do",
@@ -119,58 +573,313 @@ void leaky_pybind::pybind_simulator_methods(py::module &m, py::class_<leaky::Sim
         },
         py::arg("ideal_inst"),
         py::arg("channel"));
+    s.def(
+        "save_bound_leaky_channels",
+        [](const leaky::Simulator &self, const std::string &filepath) {
+            leaky::save_channel_library(self.bound_leaky_channels, filepath);
+        },
+        py::arg("filepath"));
+    s.def(
+        "load_bound_leaky_channels",
+        [](leaky::Simulator &self, const std::string &filepath, bool safety_check) {
+            auto library = leaky::load_channel_library(filepath, safety_check);
+            for (size_t i = 0; i < library.size(); i++) {
+                self.bound_leaky_channels.insert_or_assign(library.keys[i], std::move(library.channels[i]));
+            }
+        },
+        py::arg("filepath"),
+        py::arg("safety_check") = true);
     s.def("clear", &leaky::Simulator::clear, py::arg("clear_bound_channels") = false);
     s.def(
         "current_measurement_record",
-        [](leaky::Simulator &self, leaky::ReadoutStrategy readout_strategy) {
-            auto record_ = self.current_measurement_record(readout_strategy);
-            std::vector<uint8_t> *record_vec = new std::vector<uint8_t>();
-            std::move(record_.begin(), record_.end(), std::back_inserter(*record_vec));
-            auto record_capsule = py::capsule(record_vec, [](void *record) {
-                delete reinterpret_cast<std::vector<uint8_t> *>(record);
-            });
-            py::array_t<uint8_t> record_arr =
-                py::array_t<uint8_t>(record_vec->size(), record_vec->data(), record_capsule);
-            return record_arr;
-        },
-        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel);
+        [](leaky::Simulator &self, leaky::ReadoutStrategy readout_strategy, const py::object &into) {
+            auto num_measurements = (py::ssize_t)self.leakage_masks_record.size();
+            if (into.is_none()) {
+                // Written in place by the simulator, so there is a single allocation and no copy.
+                py::array_t<uint8_t> record(num_measurements);
+                self.append_measurement_record_into(record.mutable_data(), readout_strategy);
+                return py::object(std::move(record));
+            }
+            auto record = py::array_t<uint8_t, py::array::c_style>::ensure(into);
+            if (!record || !record.is(into) || record.ndim() != 1 || record.shape(0) != num_measurements) {
+                throw std::invalid_argument(
+                    "`into` should be a C-contiguous uint8 numpy array of shape (num_measurements,).");
+            }
+            self.append_measurement_record_into(record.mutable_data(), readout_strategy);
+            return into;
+        },
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+        pybind11::kw_only(),
+        py::arg("into") = py::none());
+    s.def_property_readonly(
+        "num_measurements", [](const leaky::Simulator &self) { return self.leakage_masks_record.size(); });
+    s.def_property_readonly("leakage_status", [](const py::object &self_object) {
+        const auto &self = self_object.cast<const leaky::Simulator &>();
+        // A view of the simulator's own buffer, which keeps its size for the simulator's lifetime.
+        py::array_t<uint8_t> status(
+            (py::ssize_t)self.leakage_status.size(), self.leakage_status.data(), self_object);
+        status.attr("setflags")(py::arg("write") = false);
+        return status;
+    });
+    s.def(
+        "compile_sampler",
+        [](leaky::Simulator &self, const py::object &circuit) {
+            return std::make_unique<CompiledSampler>(self, circuit);
+        },
+        py::arg("circuit"));
     s.def(
         "sample_batch",
         [](leaky::Simulator &self,
            const py::object &circuit,
            py::ssize_t shots,
-           leaky::ReadoutStrategy readout_strategy) {
-            auto circuit_str = pybind11::cast<std::string>(pybind11::str(circuit));
-            stim::Circuit converted_circuit = stim::Circuit(circuit_str.c_str()).flattened();
-            auto resolved_circuit = resolve_bound_channels_in_circuit(self, converted_circuit);
-            auto num_measurements = converted_circuit.count_measurements();
-            // Allocate memory for the results
-            py::array_t<uint8_t> results = py::array_t<uint8_t>(shots * num_measurements);
-            results[py::make_tuple(py::ellipsis())] = 0;
-            py::buffer_info buff = results.request();
-            uint8_t *results_ptr = (uint8_t *)buff.ptr;
-
-            for (py::ssize_t i = 0; i < shots; i++) {
-                self.clear();
-                for (const auto [is_instruction, idx] : resolved_circuit.order) {
-                    if (is_instruction) {
-                        self.do_gate(resolved_circuit.instructions[idx], false);
-                    } else {
-                        const auto &[targets, channel] = resolved_circuit.channels[idx];
-                        if (targets.size() == 1) {
-                            self.apply_1q_leaky_pauli_channel(targets, channel);
-                        } else {
-                            self.apply_2q_leaky_pauli_channel(targets, channel);
-                        }
-                    }
-                }
-                self.append_measurement_record_into(results_ptr + i * num_measurements, readout_strategy);
+           leaky::ReadoutStrategy readout_strategy,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage,
+           bool bit_packed,
+           std::optional<double> leakage_bias) -> py::object {
+            auto compiled_circuit = compile_for_simulator(self, circuit, leakage_bias);
+            // The streams of the workers are derived from the simulator's own stream.
+            return sample_batch_to_numpy(
+                self.counters,
+                compiled_circuit,
+                shots,
+                readout_strategy,
+                self.rng(),
+                num_threads,
+                engine,
+                sparse_leakage,
+                bit_packed,
+                leakage_bias.has_value());
+        },
+        py::arg("circuit"),
+        py::arg("shots"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+        pybind11::kw_only(),
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none(),
+        py::arg("bit_packed") = false,
+        py::arg("leakage_bias") = py::none());
+    s.def(
+        "sample_detectors",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           py::ssize_t shots,
+           leaky::ReadoutStrategy readout_strategy,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage,
+           bool leakage_flags,
+           std::optional<double> leakage_bias) -> py::object {
+            auto compiled_circuit = compile_for_simulator(self, circuit, leakage_bias);
+            return sample_detectors_to_numpy(
+                self.counters,
+                compiled_circuit,
+                shots,
+                readout_strategy,
+                self.rng(),
+                num_threads,
+                engine,
+                sparse_leakage,
+                leakage_flags,
+                leakage_bias.has_value());
+        },
+        py::arg("circuit"),
+        py::arg("shots"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+        pybind11::kw_only(),
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none(),
+        py::arg("leakage_flags") = false,
+        py::arg("leakage_bias") = py::none());
+    s.def(
+        "sample_statistics",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           size_t shots,
+           leaky::ReadoutStrategy readout_strategy,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage,
+           std::optional<uint64_t> max_failures) {
+            auto compiled_circuit = compile_for_simulator(self, circuit);
+            return sample_statistics_to_dict(
+                self.counters,
+                compiled_circuit,
+                shots,
+                readout_strategy,
+                self.rng(),
+                num_threads,
+                engine,
+                sparse_leakage,
+                max_failures);
+        },
+        py::arg("circuit"),
+        py::arg("shots"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+        pybind11::kw_only(),
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none(),
+        py::arg("max_failures") = py::none());
+    s.def(
+        "sample_sweep",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           const SweepVariantList &variants,
+           leaky::ReadoutStrategy readout_strategy,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage) {
+            auto compiled_circuit = compile_for_simulator(self, circuit);
+            return sample_sweep_to_numpy(
+                self.counters,
+                compiled_circuit,
+                variants,
+                readout_strategy,
+                self.rng(),
+                num_threads,
+                engine,
+                sparse_leakage);
+        },
+        py::arg("circuit"),
+        py::arg("variants"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+        pybind11::kw_only(),
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none());
+    s.def(
+        "sample_chunks",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           size_t shots,
+           size_t chunk_shots,
+           leaky::ReadoutStrategy readout_strategy,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage,
+           size_t prefetch) {
+            auto compiled_circuit = compile_for_simulator(self, circuit);
+            // Whole blocks per chunk keep the chunks equal to the rows of `sample_batch`.
+            size_t block_shots = leaky::shots_per_block(engine);
+            chunk_shots = std::max<size_t>((chunk_shots + block_shots - 1) / block_shots, 1) * block_shots;
+            uint64_t seed = self.rng();
+            auto owned_circuit = std::make_unique<leaky::CompiledCircuit>(std::move(compiled_circuit));
+            SampleChunkIterator iterator{std::move(owned_circuit), shots, chunk_shots, engine};
+            if (prefetch > 0) {
+                iterator.producer = std::make_unique<leaky::ChunkProducer>(
+                    *iterator.compiled_circuit,
+                    shots,
+                    chunk_shots,
+                    readout_strategy,
+                    seed,
+                    num_threads,
+                    engine,
+                    prefetch,
+                    sparse_leakage);
+            } else {
+                iterator.sampler = std::make_unique<leaky::BlockSampler>(
+                    *iterator.compiled_circuit, readout_strategy, seed, num_threads, engine, false, sparse_leakage);
             }
-            results.resize({shots, (py::ssize_t)num_measurements});
-            return results;
+            return iterator;
         },
         py::arg("circuit"),
         py::arg("shots"),
-        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel);
-    s.def_readonly("bound_leaky_channels", &leaky::Simulator::bound_leaky_channels);
+        py::arg("chunk_shots"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RawLabel,
+        pybind11::kw_only(),
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none(),
+        py::arg("prefetch") = 0);
+    s.def(
+        "sample_to_file",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           size_t shots,
+           const std::string &filepath,
+           leaky::ReadoutStrategy readout_strategy,
+           const std::string &format,
+           size_t num_threads,
+           leaky::Engine engine,
+           std::optional<bool> sparse_leakage) {
+            auto compiled_circuit = compile_for_simulator(self, circuit);
+            auto sample_format = sample_format_from_name(format);
+            uint64_t seed = self.rng();
+            FILE *out = fopen(filepath.c_str(), "wb");
+            if (out == nullptr) {
+                throw std::invalid_argument("Failed to open '" + filepath + "' to write.");
+            }
+            try {
+                py::gil_scoped_release release;
+                leaky::sample_to_file(
+                    compiled_circuit,
+                    shots,
+                    readout_strategy,
+                    out,
+                    sample_format,
+                    seed,
+                    num_threads,
+                    engine,
+                    sparse_leakage);
+            } catch (...) {
+                fclose(out);
+                throw;
+            }
+            fclose(out);
+        },
+        py::arg("circuit"),
+        py::arg("shots"),
+        py::arg("filepath"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+        pybind11::kw_only(),
+        py::arg("format") = "01",
+        py::arg("num_threads") = 1,
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("sparse_leakage") = py::none());
+    s.def(
+        "save_job",
+        [](leaky::Simulator &self,
+           const py::object &circuit,
+           uint64_t shots,
+           const std::string &filepath,
+           leaky::ReadoutStrategy readout_strategy,
+           leaky::Engine engine,
+           const py::object &seed) {
+            auto compiled_circuit = compile_for_simulator(self, circuit);
+            // Only the bindings the circuit uses are shipped with the job.
+            leaky::BoundChannelMap bound_leaky_channels;
+            for (size_t c = 0; c < compiled_circuit.channels.size(); c++) {
+                bound_leaky_channels.insert(compiled_circuit.channel_keys[c], compiled_circuit.channels[c]);
+            }
+            leaky::SamplingJob job{
+                std::move(compiled_circuit.circuit),
+                std::move(bound_leaky_channels),
+                shots,
+                seed.is_none() ? self.rng() : seed.cast<uint64_t>(),
+                readout_strategy,
+                engine,
+            };
+            leaky::save_job(job, filepath);
+        },
+        py::arg("circuit"),
+        py::arg("shots"),
+        py::arg("filepath"),
+        py::arg("readout_strategy") = leaky::ReadoutStrategy::RandomLeakageProjection,
+        pybind11::kw_only(),
+        py::arg("engine") = leaky::Engine::Tableau,
+        py::arg("seed") = py::none());
+    s.def_property_readonly("counters", [](const leaky::Simulator &self) { return counters_to_dict(self.counters); });
+    s.def("clear_counters", [](leaky::Simulator &self) { self.counters.clear(); });
+    s.def_property_readonly("bound_leaky_channels", [](const leaky::Simulator &self) {
+        std::map<std::string, leaky::LeakyPauliChannel> channels;
+        const auto &bound = self.bound_leaky_channels;
+        for (size_t i = 0; i < bound.size(); i++) {
+            channels.emplace(bound.keys[i].str(), bound.channels[i]);
+        }
+        return channels;
+    });
 }
\ No newline at end of file
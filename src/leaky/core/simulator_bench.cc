@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "leaky/core/channel.h"
+#include "leaky/core/readout_strategy.h"
+#include "leaky/core/simulator.h"
+#include "stim.h"
+
+using namespace leaky;
+
+static stim::Circuit surface_code_circuit(uint32_t distance) {
+    auto params = stim::CircuitGenParameters(distance, distance, "rotated_memory_z");
+    return stim::generate_surface_code_circuit(params).circuit.flattened();
+}
+
+/// Bind a weakly leaky channel to every two-qubit gate of the circuit.
+static void bind_leaky_cx(Simulator &simulator, const stim::Circuit &flatten_circuit) {
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, 0, 0.998);
+    channel.add_transition(0x00, 0x10, 0, 0.001);
+    channel.add_transition(0x00, 0x01, 0, 0.001);
+    channel.add_transition(0x10, 0x00, 0, 0.1);
+    channel.add_transition(0x10, 0x10, 0, 0.9);
+    channel.add_transition(0x01, 0x00, 0, 0.1);
+    channel.add_transition(0x01, 0x01, 0, 0.9);
+    for (const auto &op : flatten_circuit.operations) {
+        if (op.gate_type == stim::GateType::CX) {
+            simulator.bind_leaky_channel(op, channel);
+        }
+    }
+}
+
+static size_t count_gate_targets(const stim::Circuit &flatten_circuit) {
+    size_t n = 0;
+    for (const auto &op : flatten_circuit.operations) {
+        if (!(stim::GATE_DATA[op.gate_type].flags & stim::GATE_HAS_NO_EFFECT_ON_QUBITS)) {
+            n += op.targets.size();
+        }
+    }
+    return n;
+}
+
+static void report_shots(benchmark::State &state, size_t gates_per_shot) {
+    state.SetItemsProcessed(state.iterations());
+    state.counters["time_per_gate"] = benchmark::Counter(
+        (double)state.iterations() * gates_per_shot, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+static void BM_do_gate(benchmark::State &state) {
+    bool with_bound_channels = state.range(0);
+    Simulator simulator(2, 0);
+    std::vector<stim::GateTarget> targets{stim::GateTarget::qubit(0), stim::GateTarget::qubit(1)};
+    stim::CircuitInstruction cx{stim::GateType::CX, {}, targets};
+    if (with_bound_channels) {
+        LeakyPauliChannel channel(false);
+        channel.add_transition(0x00, 0x00, 1, 1.0);
+        simulator.bind_leaky_channel(cx, channel);
+    }
+    for (auto _ : state) {
+        simulator.do_gate(cx);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_do_gate)->ArgName("bound")->Arg(0)->Arg(1);
+
+static void BM_do_circuit_surface_code(benchmark::State &state) {
+    auto circuit = surface_code_circuit(state.range(0));
+    bool with_bound_channels = state.range(1);
+    Simulator simulator(circuit.count_qubits(), 0);
+    if (with_bound_channels) {
+        bind_leaky_cx(simulator, circuit);
+    }
+    for (auto _ : state) {
+        simulator.clear();
+        simulator.do_circuit(circuit);
+    }
+    report_shots(state, count_gate_targets(circuit));
+}
+BENCHMARK(BM_do_circuit_surface_code)
+    ->ArgNames({"d", "bound"})
+    ->ArgsProduct({{3, 5, 7, 11}, {0, 1}})
+    ->Unit(benchmark::kMicrosecond);
+
+static void BM_clear(benchmark::State &state) {
+    auto circuit = surface_code_circuit(state.range(0));
+    Simulator simulator(circuit.count_qubits(), 0);
+    for (auto _ : state) {
+        simulator.clear();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_clear)->ArgName("d")->Arg(3)->Arg(11)->Arg(25);
+
+static void BM_append_measurement_record_into(benchmark::State &state) {
+    auto readout_strategy = (ReadoutStrategy)state.range(0);
+    auto circuit = surface_code_circuit(11);
+    Simulator simulator(circuit.count_qubits(), 0);
+    bind_leaky_cx(simulator, circuit);
+    simulator.do_circuit(circuit);
+    std::vector<uint8_t> record(simulator.leakage_masks_record.size());
+    for (auto _ : state) {
+        simulator.append_measurement_record_into(record.data(), readout_strategy);
+        benchmark::DoNotOptimize(record.data());
+    }
+    state.SetItemsProcessed(state.iterations() * record.size());
+}
+BENCHMARK(BM_append_measurement_record_into)
+    ->ArgName("readout_strategy")
+    ->Arg(ReadoutStrategy::RawLabel)
+    ->Arg(ReadoutStrategy::RandomLeakageProjection)
+    ->Arg(ReadoutStrategy::DeterministicLeakageProjection);
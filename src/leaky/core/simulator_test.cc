@@ -1,5 +1,7 @@
 #include "leaky/core/simulator.h"
 
+#include <thread>
+
 #include "gtest/gtest.h"
 
 #include "leaky/core/readout_strategy.h"
@@ -121,6 +123,19 @@ TEST(simulator, do_2q_leaky_channel) {
     ASSERT_TRUE(result[1] == 2);
 }
 
+TEST(simulator, transition_paulis_act_on_their_qubits) {
+    Simulator sim(2);
+    // XZ: X on the first qubit and Z on the second.
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x00, (1 << 2) | 3, 1);
+    sim.do_gate(OpDat("H", 1));
+    auto targets = qubit_targets({0, 1});
+    sim.apply_2q_leaky_pauli_channel(targets, channel);
+    sim.do_gate(OpDat("H", 1));
+    sim.do_gate(OpDat("M", {0, 1}));
+    ASSERT_EQ(sim.current_measurement_record(), (std::vector<uint8_t>{1, 1}));
+}
+
 TEST(simulator, leaked_qubit_trans_down) {
     auto counts = std::map<uint8_t, uint64_t>();
     Simulator sim(1);
@@ -199,4 +214,170 @@ TEST(simulator, multi_targets_ops) {
     sim.apply_1q_leaky_pauli_channel({dat.targets}, channel);
     sim.do_gate(OpDat("M", {0, 1}));
     ASSERT_TRUE(sim.current_measurement_record() == std::vector<uint8_t>({1, 1}));
-}
\ No newline at end of file
+}
+
+TEST(simulator, bound_channels_of_whole_instructions) {
+    auto disjoint = OpDat("CX", {0, 1, 2, 3});
+    auto shared = OpDat("CX", {0, 1, 0, 2});
+    ASSERT_FALSE(has_shared_target_qubits({disjoint.targets}));
+    ASSERT_TRUE(has_shared_target_qubits({shared.targets}));
+    LeakyPauliChannel channel(false);
+    channel.add_transition(0x00, 0x10, 0, 1);
+    Simulator sim(4);
+    sim.bind_leaky_channel(OpDat("CX", {0, 1}), channel);
+    sim.do_circuit(stim::Circuit("X 0 2\nCX 0 1 2 3\nM 0 1 2 3"));
+    ASSERT_EQ(sim.current_measurement_record(), std::vector<uint8_t>({2, 1, 1, 1}));
+    sim.clear();
+    // Qubit 0 leaks before `CX 0 2`, which is skipped.
+    sim.do_circuit(stim::Circuit("X 0\nCX 0 1 0 2\nM 0 1 2"));
+    ASSERT_EQ(sim.current_measurement_record(), std::vector<uint8_t>({2, 1, 0}));
+}
+
+TEST(simulator, seeded_simulators_are_independent) {
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 0, 0, 0.5);
+    channel.add_transition(0, 1, 0, 0.5);
+    auto run = [&](Simulator& sim) {
+        std::vector<uint8_t> results;
+        for (auto i = 0; i < 100; i++) {
+            auto dat = OpDat("H", 0);
+            sim.do_gate(dat);
+            sim.apply_1q_leaky_pauli_channel({dat.targets}, channel);
+            sim.do_gate(OpDat("M", 0));
+            results.push_back(sim.current_measurement_record(ReadoutStrategy::RandomLeakageProjection)[0]);
+            sim.clear();
+        }
+        return results;
+    };
+    Simulator sim1(1, 5);
+    Simulator sim2(1, 5);
+    Simulator other(1, 6);
+    auto expected = run(sim1);
+    run(other);
+    ASSERT_EQ(run(sim2), expected);
+    sim1.set_seed(5);
+    ASSERT_EQ(run(sim1), expected);
+}
+
+TEST(simulator, unseeded_on_fresh_threads) {
+    // Unseeded simulators draw their seeds from one generator, whichever thread builds them.
+    uint64_t draws[2];
+    for (auto &draw : draws) {
+        std::thread([&draw]() {
+            Simulator sim(1);
+            draw = sim.rng();
+        }).join();
+    }
+    ASSERT_NE(draws[0], draws[1]);
+    set_seed(3);
+    std::thread([&draws]() {
+        Simulator sim(1);
+        draws[0] = sim.rng();
+    }).join();
+    set_seed(3);
+    Simulator sim(1);
+    ASSERT_EQ(sim.rng(), draws[0]);
+}
+
+TEST(simulator, clear_in_place) {
+    Simulator sim(3, 0);
+    sim.do_circuit(stim::Circuit("H 0\nCX 0 1\nS 2\nM 0 1 2"));
+    sim.clear();
+    ASSERT_EQ(sim.tableau_simulator.inv_state, stim::Tableau<stim::MAX_BITWORD_WIDTH>(3));
+    ASSERT_TRUE(sim.tableau_simulator.measurement_record.storage.empty());
+    ASSERT_TRUE(sim.leakage_masks_record.empty());
+    ASSERT_EQ(sim.leakage_status, std::vector<uint8_t>(3, 0));
+}
+
+TEST(simulator, snapshot_restore) {
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    Simulator sim(2, 0);
+    auto dat = OpDat("X", 0);
+    sim.do_gate(dat);
+    sim.apply_1q_leaky_pauli_channel({dat.targets}, channel);
+    sim.do_gate(OpDat("X", 1));
+    auto snapshot = sim.snapshot();
+    sim.do_gate(OpDat("M", {0, 1}));
+    auto expected = sim.current_measurement_record();
+    ASSERT_EQ(expected, std::vector<uint8_t>({2, 1}));
+    sim.clear();
+    sim.restore(snapshot);
+    ASSERT_EQ(sim.leakage_status, std::vector<uint8_t>({1, 0}));
+    sim.do_gate(OpDat("M", {0, 1}));
+    ASSERT_EQ(sim.current_measurement_record(), expected);
+}
+
+TEST(simulator, random_leakage_projection_of_many_measurements) {
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    Simulator sim(1, 0);
+    auto dat = OpDat("X", 0);
+    sim.do_gate(dat);
+    sim.apply_1q_leaky_pauli_channel({dat.targets}, channel);
+    for (auto i = 0; i < 1000; i++) {
+        sim.do_gate(OpDat("M", 0));
+    }
+    auto record = sim.current_measurement_record(ReadoutStrategy::RandomLeakageProjection);
+    size_t ones = 0;
+    for (auto r : record) {
+        ASSERT_TRUE(r == 0 || r == 1);
+        ones += r;
+    }
+    ASSERT_TRUE(400 < ones && ones < 600);
+    ASSERT_EQ(
+        sim.current_measurement_record(ReadoutStrategy::DeterministicLeakageProjection), std::vector<uint8_t>(1000, 1));
+}
+
+TEST(simulator, num_leaked_qubits) {
+    LeakyPauliChannel leak(false);
+    leak.add_transition(0x00, 0x12, 0, 1);
+    LeakyPauliChannel seep(true);
+    seep.add_transition(1, 0, 0, 1);
+    Simulator sim(3, 0);
+    sim.do_gate(OpDat("H", {0, 1, 2}));
+    ASSERT_EQ(sim.num_leaked_qubits, 0);
+    auto cx = OpDat("CX", {0, 1});
+    sim.do_gate(cx);
+    sim.apply_2q_leaky_pauli_channel({cx.targets}, leak);
+    ASSERT_EQ(sim.num_leaked_qubits, 2);
+    auto q0 = OpDat("X", 0);
+    sim.apply_1q_leaky_pauli_channel({q0.targets}, seep);
+    ASSERT_EQ(sim.num_leaked_qubits, 1);
+    auto snapshot = sim.snapshot();
+    sim.do_gate(OpDat("R", {1, 2}));
+    ASSERT_EQ(sim.num_leaked_qubits, 0);
+    sim.restore(snapshot);
+    ASSERT_EQ(sim.num_leaked_qubits, 1);
+    sim.clear();
+    ASSERT_EQ(sim.num_leaked_qubits, 0);
+}
+
+TEST(simulator, counters) {
+    if (!COUNTERS_ENABLED) {
+        GTEST_SKIP();
+    }
+    Simulator sim(2);
+    LeakyPauliChannel channel(true);
+    channel.add_transition(0, 1, 0, 1);
+    channel.add_transition(1, 0, 0, 1);
+    sim.bind_leaky_channel(OpDat("X", 0), channel);
+    sim.do_circuit(stim::Circuit("X 0 1\nTICK\nX 0 1\nTICK\nX 0\nM 0 1"));
+    sim.current_measurement_record();
+    auto key = make_binding_key(stim::GateType::X, qubit_targets({0}), {});
+    ASSERT_EQ(sim.counters.channel_samples.size(), 1);
+    ASSERT_EQ(sim.counters.channel_samples[key], 3);
+    ASSERT_EQ(sim.counters.transitions[TransitionType::U], 2);
+    ASSERT_EQ(sim.counters.transitions[TransitionType::D], 1);
+    ASSERT_EQ(sim.counters.leaked_qubits_per_layer, (std::vector<uint64_t>{1, 0}));
+    ASSERT_GT(sim.counters.tableau_seconds, 0);
+    ASSERT_GT(sim.counters.channel_seconds, 0);
+    ASSERT_GT(sim.counters.readout_seconds, 0);
+
+    sim.clear();
+    sim.do_circuit(stim::Circuit("X 0\nTICK"));
+    ASSERT_EQ(sim.counters.leaked_qubits_per_layer, (std::vector<uint64_t>{2, 0}));
+    sim.counters.clear();
+    ASSERT_EQ(sim.counters.channel_samples.size(), 0);
+    ASSERT_EQ(sim.counters.tableau_seconds, 0);
+}
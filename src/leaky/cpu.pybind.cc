@@ -0,0 +1,15 @@
+#include "pybind11/pybind11.h"
+
+/// Whether the running CPU and OS support AVX2, which `_cpp_leaky_avx2` is compiled for.
+static bool supports_avx2() {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+// Holds no leaky type, so it can be imported before choosing which build of `_cpp_leaky` to load.
+PYBIND11_MODULE(_cpp_leaky_cpu, m) {
+    m.def("supports_avx2", &supports_avx2);
+}
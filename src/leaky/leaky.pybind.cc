@@ -3,11 +3,18 @@
 #include "leaky/core/rand_gen.pybind.h"
 #include "leaky/core/simulator.pybind.h"
 #include "pybind11/pybind11.h"
+#include "stim.h"
 
 namespace py = pybind11;
 using namespace py::literals;
 
-PYBIND11_MODULE(_cpp_leaky, m) {
+/// The SIMD width variants of the module are the same sources built for other instruction sets.
+#ifndef LEAKY_PYBIND_MODULE_NAME
+#define LEAKY_PYBIND_MODULE_NAME _cpp_leaky
+#endif
+
+PYBIND11_MODULE(LEAKY_PYBIND_MODULE_NAME, m) {
+    m.def("simd_width", []() { return stim::MAX_BITWORD_WIDTH; });
     leaky_pybind::pybind_rand_gen_methods(m);
     auto channel = leaky_pybind::pybind_channel(m);
     leaky_pybind::pybind_channel_methods(m, channel);
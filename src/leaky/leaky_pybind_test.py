@@ -1,3 +1,4 @@
+import numpy as np
 import leaky
 import stim
 import pytest
@@ -33,6 +34,30 @@ def test_simulator_noiseless_bell_states():
     assert record[2] ^ record[3] == 0
 
 
+def test_simulator_current_measurement_record_into():
+    s = leaky.Simulator(2)
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=True)
+    channel.add_transition(0, 1, 0, 1.0)
+    status = s.leakage_status
+    assert status.tolist() == [0, 0]
+    assert not status.flags.writeable
+    s.apply_1q_leaky_pauli_channel([1], channel)
+    # The view follows the simulator without being fetched again.
+    assert status.tolist() == [0, 1]
+    s.do(leaky.Instruction("X", [0]))
+    s.do(leaky.Instruction("M", [0, 1]))
+    assert s.num_measurements == 2
+    record = np.empty(2, dtype=np.uint8)
+    assert s.current_measurement_record(into=record) is record
+    assert record.tolist() == [1, 2]
+    s.current_measurement_record(leaky.ReadoutStrategy.DeterministicLeakageProjection, into=record)
+    assert record.tolist() == [1, 1]
+    with pytest.raises(ValueError):
+        s.current_measurement_record(into=np.empty(3, dtype=np.uint8))
+    with pytest.raises(ValueError):
+        s.current_measurement_record(into=np.empty(2, dtype=np.int64))
+
+
 def test_simulator_do_noiseless_bell_circuit():
     circuit = stim.Circuit(
         """R 0 1 2 3
@@ -82,6 +107,7 @@ def test_simulator_bind_leaky_channel():
     s.bind_leaky_channel(leaky.Instruction("CNOT", [2, 3]), channel_2q)
     s.do_circuit(stim.Circuit("X 0 2\nCNOT 0 1 2 3\nM 0 1 2 3"))
     assert len(s.bound_leaky_channels) == 4
+    assert set(s.bound_leaky_channels) == {"H 0", "H 2", "CX 0 1", "CX 2 3"}
     assert s.current_measurement_record().tolist() == [2, 0, 2, 0]
     s.do(leaky.Instruction("H", [0, 2]))
     s.do(leaky.Instruction("M", [0, 1, 2, 3]))
@@ -92,3 +118,312 @@ def test_simulator_bind_leaky_channel():
     assert len(s.bound_leaky_channels) == 0
     s.do_circuit(stim.Circuit("X 0 2\nCNOT 0 1 2 3\nM 0 1 2 3"))
     assert s.current_measurement_record().tolist() == [1, 1, 1, 1]
+
+
+def test_simulator_sample_batch_multi_threaded():
+    circuit = stim.Circuit("H 0\nCNOT 0 1\nM 0 1\nR 0 1\nH 0\nCNOT 0 1\nM 0 1")
+    channel_2q = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+    channel_2q.add_transition(0x00, 0x00, 0, 0.5)
+    channel_2q.add_transition(0x00, 0x10, 0, 0.5)
+    results = []
+    for num_threads in [1, 2, 4]:
+        s = leaky.Simulator(2, seed=42)
+        s.bind_leaky_channel(leaky.Instruction("CNOT", [0, 1]), channel_2q)
+        results.append(s.sample_batch(circuit, 1000, num_threads=num_threads))
+    assert results[0].shape == (1000, 4)
+    assert (results[0] == results[1]).all()
+    assert (results[0] == results[2]).all()
+
+
+def test_simulator_seeded_streams_are_independent():
+    circuit = stim.Circuit("H 0\nM 0")
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=True)
+    channel.add_transition(0, 0, 0, 0.5)
+    channel.add_transition(0, 1, 0, 0.5)
+    s1 = leaky.Simulator(1, seed=3)
+    s1.bind_leaky_channel(leaky.Instruction("H", [0]), channel)
+    s2 = leaky.Simulator(1, seed=3)
+    s2.bind_leaky_channel(leaky.Instruction("H", [0]), channel)
+    other = leaky.Simulator(1, seed=4)
+    r1 = s1.sample_batch(circuit, 100)
+    other.sample_batch(circuit, 100)
+    r2 = s2.sample_batch(circuit, 100)
+    assert (r1 == r2).all()
+
+
+def test_simulator_sample_batch_frame_engine():
+    circuit = stim.Circuit("R 0 1 2 3\nH 0 2\nCNOT 0 1 2 3\nM 0 1 2 3")
+    channel_2q = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+    channel_2q.add_transition(0x00, 0x10, 0, 1.0)
+    s = leaky.Simulator(4, seed=0)
+    s.bind_leaky_channel(leaky.Instruction("CNOT", [2, 3]), channel_2q)
+    results = s.sample_batch(circuit, 3000, engine=leaky.Engine.Frame)
+    assert results.shape == (3000, 4)
+    assert (results[:, 0] == results[:, 1]).all()
+    assert (results[:, 2] == 2).all()
+    assert set(results[:, 3].tolist()) <= {0, 1}
+
+
+def test_simulator_sample_batch_sparse_leakage():
+    circuit = stim.Circuit("R 0 1 2 3\nH 0 2\nCNOT 0 1 2 3\nM 0 1 2 3")
+    channel_2q = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+    channel_2q.add_transition(0x00, 0x00, 0, 0.5)
+    channel_2q.add_transition(0x00, 0x10, 0, 0.5)
+
+    def sample(sparse_leakage):
+        s = leaky.Simulator(4, seed=5)
+        s.bind_leaky_channel(leaky.Instruction("CNOT", [2, 3]), channel_2q)
+        return s.sample_batch(circuit, 2000, engine=leaky.Engine.Frame, sparse_leakage=sparse_leakage)
+
+    # The samples do not depend on how the leakage statuses are stored.
+    expected = sample(None)
+    assert (sample(True) == expected).all()
+    assert (sample(False) == expected).all()
+    sampler = leaky.Simulator(4, seed=5).compile_sampler(circuit)
+    assert sampler.sample(100, engine=leaky.Engine.Frame, sparse_leakage=True).shape == (100, 4)
+
+
+def test_simulator_sample_batch_bit_packed():
+    circuit = stim.Circuit("X 0 9\nM 0 1 2 3 4 5 6 7 8 9")
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=True)
+    channel.add_transition(0, 1, 0, 1.0)
+    s = leaky.Simulator(10, seed=1)
+    s.bind_leaky_channel(leaky.Instruction("X", [9]), channel)
+    raw = s.sample_batch(circuit, 100)
+    bits, flags = s.sample_batch(circuit, 100, bit_packed=True)
+    assert bits.shape == flags.shape == (100, 2)
+    np.testing.assert_array_equal(bits, np.packbits(raw == 1, axis=1, bitorder="little"))
+    np.testing.assert_array_equal(flags, np.packbits(raw > 1, axis=1, bitorder="little"))
+    projected = s.sample_batch(
+        circuit, 100, leaky.ReadoutStrategy.DeterministicLeakageProjection, bit_packed=True
+    )
+    assert projected.shape == (100, 2)
+    assert (projected[:, 1] == 0b10).all()
+
+
+def test_simulator_sample_to_file(tmp_path):
+    circuit = stim.Circuit("X 0\nM 0 1")
+    s = leaky.Simulator(2, seed=1)
+    for fmt in ["01", "b8", "r8"]:
+        path = tmp_path / f"out.{fmt}"
+        s.sample_to_file(circuit, 1000, str(path), format=fmt, num_threads=2)
+        samples = stim.read_shot_data_file(
+            path=str(path), format=fmt, num_measurements=2
+        )
+        assert samples.shape == (1000, 2)
+        assert samples[:, 0].all() and not samples[:, 1].any()
+    with pytest.raises(ValueError):
+        s.sample_to_file(circuit, 10, str(tmp_path / "raw.01"), leaky.ReadoutStrategy.RawLabel)
+
+
+def test_simulator_sample_chunks():
+    circuit = stim.Circuit("H 0\nCNOT 0 1\nM 0 1")
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=True)
+    channel.add_transition(0, 0, 0, 0.5)
+    channel.add_transition(0, 1, 0, 0.5)
+    s1 = leaky.Simulator(2, seed=5)
+    s2 = leaky.Simulator(2, seed=5)
+    for s in [s1, s2]:
+        s.bind_leaky_channel(leaky.Instruction("H", [0]), channel)
+    expected = s1.sample_batch(circuit, 1000)
+    chunks = list(s2.sample_chunks(circuit, 1000, 300))
+    assert [len(c) for c in chunks] == [512, 488]
+    np.testing.assert_array_equal(np.concatenate(chunks), expected)
+    s3 = leaky.Simulator(2, seed=5)
+    s3.bind_leaky_channel(leaky.Instruction("H", [0]), channel)
+    prefetched = list(s3.sample_chunks(circuit, 1000, 300, num_threads=2, prefetch=2))
+    np.testing.assert_array_equal(np.concatenate(prefetched), expected)
+    # Abandoning a prefetching iterator stops its producer.
+    next(s3.sample_chunks(circuit, 10**7, 256, prefetch=1))
+
+
+def test_simulator_sample_detectors():
+    circuit = stim.Circuit.generated(
+        "repetition_code:memory", rounds=3, distance=3, before_measure_flip_probability=0.1
+    )
+    s = leaky.Simulator(circuit.num_qubits, seed=3)
+    dets, obs, flags = s.sample_detectors(circuit, 1000, leakage_flags=True)
+    assert dets.shape == flags.shape == (1000, (circuit.num_detectors + 7) // 8)
+    assert obs.shape == (1000, 1)
+    assert not flags.any()
+    # The same events as numpy XORs of the raw measurements.
+    s = leaky.Simulator(circuit.num_qubits, seed=3)
+    measurements = s.sample_batch(circuit, 1000, leaky.ReadoutStrategy.RandomLeakageProjection)
+    converter = circuit.compile_m2d_converter()
+    expected_dets, expected_obs = converter.convert(
+        measurements=measurements.astype(np.bool_), separate_observables=True
+    )
+    np.testing.assert_array_equal(dets, np.packbits(expected_dets, axis=1, bitorder="little"))
+    np.testing.assert_array_equal(obs, np.packbits(expected_obs, axis=1, bitorder="little"))
+
+
+def test_simulator_sample_statistics():
+    circuit = stim.Circuit.generated(
+        "repetition_code:memory", rounds=3, distance=3, before_measure_flip_probability=0.1
+    )
+    s = leaky.Simulator(circuit.num_qubits, seed=5)
+    stats = s.sample_statistics(circuit, 2000)
+    s = leaky.Simulator(circuit.num_qubits, seed=5)
+    _, obs = s.sample_detectors(circuit, 2000)
+    assert stats["shots"] == 2000
+    assert stats["num_failures"] == np.count_nonzero(obs[:, 0] & 1)
+    np.testing.assert_array_equal(stats["observable_flip_counts"], [stats["num_failures"]])
+    np.testing.assert_array_equal(stats["leaked_counts"], np.zeros(circuit.num_measurements))
+    stopped = [
+        leaky.Simulator(circuit.num_qubits, seed=5).sample_statistics(
+            circuit, 10**6, num_threads=num_threads, max_failures=50
+        )
+        for num_threads in [1, 3]
+    ]
+    assert stopped[0]["shots"] < 10**6
+    assert stopped[0]["num_failures"] >= 50
+    assert stopped[0]["shots"] == stopped[1]["shots"]
+    assert stopped[0]["num_failures"] == stopped[1]["num_failures"]
+
+
+def test_simulator_sample_sweep():
+    circuit = stim.Circuit("H 0\nCZ 0 1\nM 0 1")
+    cz = leaky.Instruction("CZ", [0, 1])
+
+    def leaky_cz(p):
+        channel = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+        channel.add_transition(0x00, 0x00, 0, 1 - p)
+        channel.add_transition(0x00, 0x10, 0, p)
+        return channel
+
+    s = leaky.Simulator(2, seed=1)
+    s.bind_leaky_channel(cz, leaky_cz(0.5))
+    results = s.sample_sweep(circuit, [([(cz, leaky_cz(0.0))], 300), ([], 700), ([(cz, leaky_cz(1.0))], 50)])
+    assert results.shape == (1050, 2)
+    assert not (results[:300] == 2).any()
+    assert 250 < np.count_nonzero(results[300:1000, 0] == 2) < 450
+    assert (results[1000:, 0] == 2).all()
+    with pytest.raises(ValueError):
+        s.sample_sweep(circuit, [([(leaky.Instruction("CZ", [1, 0]), leaky_cz(0.1))], 10)])
+    sampler = s.compile_sampler(circuit)
+    assert sampler.sample_sweep([([], 10)]).shape == (10, 2)
+
+
+def test_simulator_compile_sampler():
+    circuit = stim.Circuit.generated("repetition_code:memory", rounds=100, distance=3)
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+    channel.add_transition(0x00, 0x10, 0, 0.01)
+    channel.add_transition(0x00, 0x00, 0, 0.99)
+    s1 = leaky.Simulator(circuit.num_qubits, seed=7)
+    s2 = leaky.Simulator(circuit.num_qubits, seed=7)
+    samplers = []
+    for s in [s1, s2]:
+        s.bind_leaky_channel(leaky.Instruction("CX", [0, 1]), channel)
+        samplers.append(s.compile_sampler(circuit))
+    s1.clear(clear_bound_channels=True)
+    sampler = samplers[0]
+    assert sampler.num_measurements == circuit.num_measurements
+    assert sampler.num_detectors == circuit.num_detectors
+    assert sampler.num_observables == circuit.num_observables
+    first = sampler.sample(500)
+    assert first.shape == (500, circuit.num_measurements)
+    assert (first == 2).any()
+    np.testing.assert_array_equal(samplers[1].sample(500), first)
+    assert not np.array_equal(sampler.sample(500), first)
+    dets, obs = sampler.sample_detectors(500)
+    assert dets.shape == (500, (circuit.num_detectors + 7) // 8)
+
+
+def test_simulator_save_and_load_bound_leaky_channels(tmp_path):
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=True)
+    channel.add_transition(0, 0, 1, 0.5)
+    channel.add_transition(0, 1, 0, 0.5)
+    s = leaky.Simulator(3)
+    s.bind_leaky_channel(leaky.Instruction("H", [0, 2]), channel)
+    path = str(tmp_path / "device.leaky")
+    s.save_bound_leaky_channels(path)
+    loaded = leaky.Simulator(3)
+    loaded.load_bound_leaky_channels(path)
+    assert set(loaded.bound_leaky_channels) == {"H 0", "H 2"}
+    assert str(loaded.bound_leaky_channels["H 2"]) == str(channel)
+    with open(path, "wb") as f:
+        f.write(b"garbage")
+    with pytest.raises(ValueError):
+        loaded.load_bound_leaky_channels(path)
+
+
+def test_simd_width():
+    assert leaky.simd_width() in [64, 128, 256]
+    assert leaky.Simulator is leaky._cpp.module.Simulator
+
+
+def test_simulator_counters():
+    channel = leaky.LeakyPauliChannel()
+    channel.add_transition(0, 1, 0, 1.0)
+    s = leaky.Simulator(2, seed=0)
+    s.bind_leaky_channel(leaky.Instruction("X", [0]), channel)
+    s.sample_batch(stim.Circuit("X 0 1\nTICK\nM 0 1"), shots=10)
+    counters = s.counters
+    assert set(counters) == {
+        "enabled",
+        "num_shots",
+        "channel_samples",
+        "transitions",
+        "leaked_qubits_per_layer",
+        "tableau_seconds",
+        "channel_seconds",
+        "readout_seconds",
+    }
+    if counters["enabled"]:
+        assert counters["num_shots"] == 10
+        assert counters["channel_samples"] == {"X 0": 10}
+        assert counters["transitions"]["U"] == 10
+        assert counters["leaked_qubits_per_layer"] == [10]
+    s.clear_counters()
+    assert s.counters["num_shots"] == 0
+
+
+def test_sample_batch_leakage_bias():
+    channel = leaky.LeakyPauliChannel()
+    channel.add_transition(0, 0, 0, 0.99)
+    channel.add_transition(0, 1, 0, 0.01)
+    s = leaky.Simulator(1, seed=0)
+    s.bind_leaky_channel(leaky.Instruction("X", [0]), channel)
+    circuit = stim.Circuit("X 0\nM 0")
+    results = s.sample_batch(circuit, 1000)
+    assert isinstance(results, np.ndarray)
+    results, weights = s.sample_batch(circuit, 20000, leakage_bias=50)
+    assert weights.shape == (20000,)
+    assert weights.dtype == np.float64
+    leaked = results[:, 0] == 2
+    assert 0.25 < np.mean(leaked) < 0.42
+    assert np.mean(weights * leaked) == pytest.approx(0.01, abs=1e-3)
+    sampler = s.compile_sampler(circuit)
+    _, weights = sampler.sample(100, leakage_bias=50)
+    assert weights.shape == (100,)
+    # Each bias is applied to its own cached copy, leaving the unbiased circuit intact.
+    results, weights = sampler.sample(20000, leakage_bias=10)
+    assert np.mean(weights * (results[:, 0] == 2)) == pytest.approx(0.01, abs=1e-3)
+    _, weights = sampler.sample(100, leakage_bias=50)
+    assert weights.shape == (100,)
+    results = sampler.sample(20000)
+    assert np.mean(results[:, 0] == 2) == pytest.approx(0.01, abs=3e-3)
+    with pytest.raises(ValueError):
+        sampler.sample(100, leakage_bias=float("nan"))
+
+
+def test_run_shard(tmp_path):
+    channel = leaky.LeakyPauliChannel(is_single_qubit_channel=False)
+    channel.add_transition(0x00, 0x00, 0, 0.5)
+    channel.add_transition(0x00, 0x10, 0, 0.5)
+    s = leaky.Simulator(2, seed=0)
+    s.bind_leaky_channel(leaky.Instruction("CNOT", [0, 1]), channel)
+    circuit = stim.Circuit("H 0\nCNOT 0 1\nM 0 1")
+    job = str(tmp_path / "job.leaky")
+    s.save_job(circuit, 1000, job, seed=5)
+    total = np.zeros(2, dtype=np.uint64)
+    shards = b""
+    for k in range(3):
+        path = tmp_path / f"shard_{k}.b8"
+        total += leaky.run_shard(job, k, 3, str(path))
+        shards += path.read_bytes()
+    again = tmp_path / "again.b8"
+    leaky.run_shard(job, 1, 3, str(again))
+    assert again.read_bytes() == (tmp_path / "shard_1.b8").read_bytes()
+    bits = np.unpackbits(np.frombuffer(shards, dtype=np.uint8).reshape(1000, 1), axis=1, bitorder="little")
+    assert list(total) == list(bits[:, :2].sum(axis=0))
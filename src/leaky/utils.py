@@ -6,6 +6,9 @@ import functools
 import numpy as np
 
 from leaky import LeakyPauliChannel
+from leaky._cpp import module as _cpp_leaky
+
+_decompose_kraus_operators = _cpp_leaky.decompose_kraus_operators
 
 
 LeakageStatus = Tuple[int, ...]
@@ -31,10 +34,13 @@ def decompose_kraus_operators_to_leaky_pauli_channel(
     num_qubits: int,
     num_level: int,
     safety_check: bool = True,
+    num_threads: int = 1,
 ) -> LeakyPauliChannel:
     """Decompose the Kraus operators into a leaky pauli channel representation with
     Generalized Pauli Twirling(GPT).
 
+    The decomposition runs in C++, without the GIL.
+
     Args:
         kraus_operators: A sequence of Kraus operators corresponding to an operation's error channel.
         num_qubits: The number of qubits in the operation.
@@ -44,10 +50,29 @@ def decompose_kraus_operators_to_leaky_pauli_channel(
             from a given initial status is 1. And the pauli channel related to the
             qubits with transition type that not in R(stay in the computational space)
             should always be I. Default is True.
+        num_threads: The number of threads to decompose the Kraus operators with. If 0,
+            use all available hardware threads. The result does not depend on it.
+            Default is 1.
 
     Returns:
         A LeakyPauliChannel object representing the error channel.
     """
+    if num_qubits not in [1, 2]:
+        raise ValueError("Only 1 or 2 qubits operators are supported.")
+    channel = _decompose_kraus_operators(
+        np.asarray(kraus_operators, dtype=np.complex128), num_qubits, num_level, num_threads
+    )
+    if safety_check:
+        channel.safety_check()
+    return channel
+
+
+def _decompose_kraus_operators_with_numpy(
+    kraus_operators: Sequence[np.ndarray],
+    num_qubits: int,
+    num_level: int,
+) -> LeakyPauliChannel:
+    """The reference numpy implementation of `decompose_kraus_operators_to_leaky_pauli_channel`."""
     if num_qubits not in [1, 2]:
         raise ValueError("Only 1 or 2 qubits operators are supported.")
     channel = LeakyPauliChannel(is_single_qubit_channel=num_qubits == 1)
@@ -114,8 +139,6 @@ def decompose_kraus_operators_to_leaky_pauli_channel(
                         idx,
                         p,
                     )
-    if safety_check:
-        channel.safety_check()
     return channel
 
 
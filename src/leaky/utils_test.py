@@ -4,6 +4,7 @@ import numpy as np
 import pytest
 
 from leaky.utils import (
+    _decompose_kraus_operators_with_numpy,
     _get_projector_slice,
     decompose_kraus_operators_to_leaky_pauli_channel,
     leakage_status_tuple_to_int,
@@ -143,3 +144,31 @@ def test_two_qubit_4level_unitary_decompose():
     }
     for check, p in equality_check.items():
         assert channel.get_prob_from_to(*check) == pytest.approx(p)
+
+
+@pytest.mark.parametrize("num_qubits,num_level", [(1, 3), (1, 4), (2, 3)])
+def test_decompose_matches_numpy_reference(num_qubits, num_level):
+    dim = num_level**num_qubits
+    kraus_operators = 0.1 * (
+        RNG.normal(size=(4, dim, dim)) + 1j * RNG.normal(size=(4, dim, dim))
+    )
+    expected = _decompose_kraus_operators_with_numpy(
+        kraus_operators, num_qubits, num_level
+    )
+    for num_threads in [1, 4]:
+        channel = decompose_kraus_operators_to_leaky_pauli_channel(
+            kraus_operators,
+            num_qubits,
+            num_level,
+            safety_check=False,
+            num_threads=num_threads,
+        )
+        # The whole ordered transition lists, so that the contributions of every
+        # Kraus operator are compared.
+        assert channel.num_transitions == expected.num_transitions
+        transitions = channel.transitions
+        expected_transitions = expected.transitions
+        assert len(transitions) == len(expected_transitions)
+        for transition, expected_transition in zip(transitions, expected_transitions):
+            assert transition[:3] == expected_transition[:3]
+            assert transition[3] == pytest.approx(expected_transition[3], abs=1e-12)